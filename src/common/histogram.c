@@ -0,0 +1,90 @@
+#include "histogram.h"
+
+// 线性区间的上界和每个区间的桶数
+#define LINEAR_LIMIT ((uint64_t)1 << HISTOGRAM_LINEAR_BITS)
+#define SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+
+// 最高有效位的位置
+static int highest_bit(uint64_t value) {
+    return 63 - __builtin_clzll(value);
+}
+
+// 值对应的桶
+static size_t bucket_index(uint64_t value) {
+    if (value < LINEAR_LIMIT) return (size_t)value;
+    if (value > UINT32_MAX) return HISTOGRAM_BUCKET_COUNT - 1;
+
+    int exponent = highest_bit(value);
+    size_t sub = (size_t)(value >> (exponent - HISTOGRAM_SUB_BITS)) & (SUB_COUNT - 1);
+    return LINEAR_LIMIT + (size_t)(exponent - HISTOGRAM_LINEAR_BITS) * SUB_COUNT + sub;
+}
+
+// 桶能表示的最大值
+static uint64_t bucket_upper(size_t index) {
+    if (index < LINEAR_LIMIT) return index;
+
+    size_t offset = index - LINEAR_LIMIT;
+    int exponent = (int)(offset / SUB_COUNT) + HISTOGRAM_LINEAR_BITS;
+    uint64_t sub = offset % SUB_COUNT;
+    int shift = exponent - HISTOGRAM_SUB_BITS;
+    return (((uint64_t)SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+// 初始化（清零）直方图
+void histogram_init(Histogram* hist) {
+    if (!hist) return;
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        atomic_init(&hist->counts[i], 0);
+    }
+    atomic_init(&hist->total, 0);
+    atomic_init(&hist->max, 0);
+}
+
+// 记录一个值
+void histogram_record(Histogram* hist, uint64_t value) {
+    if (!hist) return;
+
+    atomic_fetch_add_explicit(&hist->counts[bucket_index(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->total, 1, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&hist->max, &max, value,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// 记录数
+uint64_t histogram_count(Histogram* hist) {
+    return hist ? atomic_load_explicit(&hist->total, memory_order_relaxed) : 0;
+}
+
+// 最大值
+uint64_t histogram_max(Histogram* hist) {
+    return hist ? atomic_load_explicit(&hist->max, memory_order_relaxed) : 0;
+}
+
+// 百分位数
+uint64_t histogram_percentile(Histogram* hist, double percentile) {
+    if (!hist) return 0;
+
+    uint64_t total = histogram_count(hist);
+    if (total == 0) return 0;
+
+    // 排名向上取整，至少为1
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)total + 0.999999);
+    if (rank == 0) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t max = histogram_max(hist);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        seen += atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = bucket_upper(i);
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
@@ -0,0 +1,46 @@
+#ifndef MOUSE_HISTOGRAM_H
+#define MOUSE_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * 延迟直方图（HDR方式的对数-线性分桶）
+ *
+ * 0..31直接对应一个桶；之后每个2的幂区间再均分为16个桶，相对误差不超过1/16。
+ * 记录上限为2^32-1（微秒约71分钟），更大的值计入最后一个桶。
+ * 所有计数使用原子操作，一个线程记录的同时其他线程可以读取。
+ */
+
+// 线性区间的位数和每个区间的细分位数
+#define HISTOGRAM_LINEAR_BITS 5
+#define HISTOGRAM_SUB_BITS 4
+
+// 桶的总数
+#define HISTOGRAM_BUCKET_COUNT ((1 << HISTOGRAM_LINEAR_BITS) + \
+                                (32 - HISTOGRAM_LINEAR_BITS) * (1 << HISTOGRAM_SUB_BITS))
+
+typedef struct {
+    atomic_uint_least64_t counts[HISTOGRAM_BUCKET_COUNT]; // 每个桶的计数
+    atomic_uint_least64_t total;                          // 记录数
+    atomic_uint_least64_t max;                            // 最大值
+} Histogram;
+
+// 初始化（清零）直方图
+void histogram_init(Histogram* hist);
+
+// 记录一个值
+void histogram_record(Histogram* hist, uint64_t value);
+
+// 记录数
+uint64_t histogram_count(Histogram* hist);
+
+// 最大值
+uint64_t histogram_max(Histogram* hist);
+
+// 百分位数（percentile取0-100），返回所在桶的上界，不超过最大值；没有记录时返回0
+uint64_t histogram_percentile(Histogram* hist, double percentile);
+
+#endif // MOUSE_HISTOGRAM_H
@@ -0,0 +1,150 @@
+#include "jitter_buffer.h"
+#include <string.h>
+
+// 到达抖动估计的平滑系数（RFC 3550为1/16）
+#define JITTER_GAIN (1.0 / 16.0)
+
+// 缓冲延迟每条消息向目标调整的比例，避免播放间隔突变
+#define DELAY_STEP_SHIFT 3
+
+// 晚到峰值每条消息的衰减（125Hz时约3秒减半），偶发的长停顿之后一段时间内仍留有余量
+#define PEAK_DECAY 0.998
+
+// 初始化，max_delay_us为0时关闭缓冲
+void jitter_buffer_init(JitterBuffer* jb, uint32_t max_delay_us) {
+    if (!jb) return;
+
+    memset(jb, 0, sizeof(JitterBuffer));
+    jb->max_delay_us = max_delay_us;
+}
+
+// 是否开启了缓冲
+bool jitter_buffer_enabled(const JitterBuffer* jb) {
+    return jb && jb->max_delay_us > 0;
+}
+
+// 清空排期的消息；reset为true时同时清空统计
+void jitter_buffer_clear(JitterBuffer* jb, bool reset) {
+    if (!jb) return;
+
+    jb->head = 0;
+    jb->count = 0;
+    if (reset) {
+        jb->has_transit = false;
+        jb->jitter_us = 0;
+        jb->peak_us = 0;
+        jb->delay_us = 0;
+        jb->last_timestamp = 0;
+    }
+}
+
+// 用一条消息的传输时间更新最小传输时间和到达抖动，得到缓冲延迟
+static void update_estimates(JitterBuffer* jb, int64_t transit, uint64_t now_us) {
+    if (!jb->has_transit) {
+        jb->has_transit = true;
+        jb->last_transit = transit;
+        jb->base_transit = transit;
+        jb->window_min = transit;
+        jb->prev_window_min = transit;
+        jb->window_start_us = now_us;
+        return;
+    }
+
+    // 最近两个窗口内的最小值，时钟漂移或路由变化后旧的最小值会过期
+    if (now_us - jb->window_start_us >= JITTER_BUFFER_BASE_WINDOW_US) {
+        jb->prev_window_min = jb->window_min;
+        jb->window_min = transit;
+        jb->window_start_us = now_us;
+    } else if (transit < jb->window_min) {
+        jb->window_min = transit;
+    }
+    jb->base_transit = jb->window_min < jb->prev_window_min ? jb->window_min : jb->prev_window_min;
+
+    int64_t diff = transit - jb->last_transit;
+    if (diff < 0) diff = -diff;
+    jb->jitter_us += ((double)diff - jb->jitter_us) * JITTER_GAIN;
+    jb->last_transit = transit;
+
+    // Wi-Fi上常见的是偶发的几十毫秒停顿，平均抖动反映不出来：超过当前延迟的晚到量立即计入峰值，之后缓慢衰减
+    double excess = (double)(transit - jb->base_transit);
+    jb->peak_us *= PEAK_DECAY;
+    if (excess > jb->delay_us && excess > jb->peak_us) {
+        jb->peak_us = excess;
+    }
+
+    double target = jb->jitter_us * JITTER_BUFFER_JITTER_FACTOR;
+    bool from_peak = target < jb->peak_us;
+    if (from_peak) {
+        target = jb->peak_us;
+    }
+    if (target > jb->max_delay_us) {
+        target = jb->max_delay_us;
+    }
+
+    // 晚到时已经停顿，立即加大延迟不会让停顿更明显；减小则逐步进行
+    if (from_peak && target > jb->delay_us) {
+        jb->delay_us = (uint32_t)target;
+        return;
+    }
+    int64_t step = ((int64_t)target - (int64_t)jb->delay_us) >> DELAY_STEP_SHIFT;
+    if (step == 0 && (int64_t)target != (int64_t)jb->delay_us) {
+        step = (int64_t)target > (int64_t)jb->delay_us ? 1 : -1;
+    }
+    jb->delay_us = (uint32_t)((int64_t)jb->delay_us + step);
+}
+
+// 加入一条带采集时间的移动消息；返回false表示被丢弃
+bool jitter_buffer_push(JitterBuffer* jb, const MouseMoveMessage* msg, uint64_t now_us) {
+    if (!jb || !msg || msg->timestamp == 0) return false;
+
+    // UDP可能乱序，比已排期的更早采集的消息不再播放
+    if (jb->last_timestamp != 0 && msg->timestamp <= jb->last_timestamp) {
+        jb->dropped++;
+        return false;
+    }
+    jb->last_timestamp = msg->timestamp;
+
+    uint64_t arrival_us = msg->receive_us ? msg->receive_us : now_us;
+    int64_t transit = (int64_t)arrival_us - (int64_t)msg->timestamp;
+    update_estimates(jb, transit, now_us);
+
+    // 按最小传输时间到达的消息恰好等待delay_us，晚到的等待相应缩短
+    int64_t play_us = (int64_t)msg->timestamp + jb->base_transit + jb->delay_us;
+    if (play_us < (int64_t)arrival_us) {
+        jb->late++;
+        play_us = (int64_t)arrival_us;
+    }
+
+    if (jb->count == JITTER_BUFFER_CAPACITY) {
+        jb->head = (jb->head + 1) % JITTER_BUFFER_CAPACITY;
+        jb->count--;
+        jb->dropped++;
+    }
+
+    JitterEntry* entry = &jb->entries[(jb->head + jb->count) % JITTER_BUFFER_CAPACITY];
+    entry->msg = *msg;
+    entry->play_us = (uint64_t)play_us;
+    jb->count++;
+    return true;
+}
+
+// 最早一条的播放时间，没有消息时返回false
+bool jitter_buffer_next_due(const JitterBuffer* jb, uint64_t* due_us) {
+    if (!jb || jb->count == 0) return false;
+
+    *due_us = jb->entries[jb->head].play_us;
+    return true;
+}
+
+// 取出一条已到播放时间的消息，没有时返回false
+bool jitter_buffer_pop(JitterBuffer* jb, uint64_t now_us, MouseMoveMessage* msg) {
+    if (!jb || jb->count == 0) return false;
+
+    const JitterEntry* entry = &jb->entries[jb->head];
+    if (entry->play_us > now_us) return false;
+
+    *msg = entry->msg;
+    jb->head = (jb->head + 1) % JITTER_BUFFER_CAPACITY;
+    jb->count--;
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef MOUSE_JITTER_BUFFER_H
+#define MOUSE_JITTER_BUFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "protocol.h"
+
+/*
+ * 接收端的移动消息播放缓冲（抖动缓冲）
+ *
+ * 移动消息按发送端的采集时间排期：播放时间 = 采集时间 + 最小传输时间 + 缓冲延迟，
+ * 按原来的间隔注入，网络抖动不再表现为光标忽快忽慢。
+ * 传输时间（收到时间减采集时间）包含两端的时钟偏差，只用它与最小值的差，不需要时钟同步；
+ * 最小值取最近两个窗口内的最小值，两端时钟的漂移也能跟上。
+ * 缓冲延迟取RFC 3550到达抖动估计的倍数与最近晚到峰值中的较大者，自动调整，上限为max_delay_us。
+ * 按钮变化不经过缓冲，由调用方立即注入并清空缓冲中更早的移动。
+ * 所有时间都是微秒，除采集时间外都是接收端的单调时钟。
+ */
+
+// 最多缓冲的消息数，满了时丢弃最早的一条（移动消息是绝对位置，丢弃只少一个中间点）
+#define JITTER_BUFFER_CAPACITY 64
+
+// 缓冲延迟为到达抖动的多少倍
+#define JITTER_BUFFER_JITTER_FACTOR 4
+
+// 最小传输时间的统计窗口
+#define JITTER_BUFFER_BASE_WINDOW_US 2000000
+
+// 一条排期的消息
+typedef struct {
+    MouseMoveMessage msg;        // 移动消息
+    uint64_t play_us;            // 播放时间
+} JitterEntry;
+
+typedef struct {
+    uint32_t max_delay_us;       // 缓冲延迟上限，0表示关闭缓冲
+    JitterEntry entries[JITTER_BUFFER_CAPACITY]; // 排期的消息，按到达顺序环形存放
+    size_t head;                 // 最早一条的下标
+    size_t count;                // 消息数
+    bool has_transit;            // 是否已有传输时间样本
+    int64_t last_transit;        // 上一条的传输时间
+    int64_t base_transit;        // 最小传输时间
+    int64_t window_min;          // 当前窗口内的最小传输时间
+    int64_t prev_window_min;     // 上一个窗口内的最小传输时间
+    uint64_t window_start_us;    // 当前窗口的开始时间
+    double jitter_us;            // 到达抖动估计
+    double peak_us;              // 最近晚到的峰值（超出最小传输时间的量），缓慢衰减
+    uint32_t delay_us;           // 当前的缓冲延迟
+    uint64_t last_timestamp;     // 最后入队的采集时间，更早的（UDP乱序）丢弃
+    uint64_t late;               // 到达时已过播放时间的消息数
+    uint64_t dropped;            // 乱序或缓冲满时丢弃的消息数
+} JitterBuffer;
+
+// 初始化，max_delay_us为0时关闭缓冲
+void jitter_buffer_init(JitterBuffer* jb, uint32_t max_delay_us);
+
+// 是否开启了缓冲
+bool jitter_buffer_enabled(const JitterBuffer* jb);
+
+// 清空排期的消息；reset为true时（换了发送端）同时清空统计，重新估计传输时间和抖动
+void jitter_buffer_clear(JitterBuffer* jb, bool reset);
+
+// 加入一条带采集时间的移动消息（receive_us为收到的时间）；返回false表示被丢弃
+bool jitter_buffer_push(JitterBuffer* jb, const MouseMoveMessage* msg, uint64_t now_us);
+
+// 最早一条的播放时间，没有消息时返回false
+bool jitter_buffer_next_due(const JitterBuffer* jb, uint64_t* due_us);
+
+// 取出一条已到播放时间的消息，没有时返回false
+bool jitter_buffer_pop(JitterBuffer* jb, uint64_t now_us, MouseMoveMessage* msg);
+
+#endif // MOUSE_JITTER_BUFFER_H
@@ -0,0 +1,627 @@
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+// 每个线程的环形缓冲区容量（记录数，2的幂）
+#define LOG_RING_CAPACITY 1024
+
+// 最多使用环形缓冲区的线程数，更多的线程同步写出
+#define LOG_MAX_THREADS 16
+
+// 每条记录中复制字符串参数的空间，超出的部分截断
+#define LOG_STRING_SPACE 64
+
+// 后台线程被唤醒后等待多久再写出，这段时间的记录合为一批，记录的线程不必每条都唤醒
+#define LOG_BATCH_DELAY_NS 5000000L
+
+// 一行日志的最大长度
+#define LOG_LINE_SIZE 512
+
+// 一次写出的缓冲区大小
+#define LOG_OUTPUT_SIZE 16384
+
+// 缓存行大小，用于隔离生产者与消费者各自写入的字段
+#define CACHE_LINE_SIZE 64
+
+// 参数类型
+typedef enum {
+    ARG_NONE = 0,      // %%，不消耗参数
+    ARG_SIGNED,
+    ARG_UNSIGNED,
+    ARG_CHAR,
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_POINTER,
+    ARG_INVALID        // 不支持的转换说明，之后的内容原样输出
+} ArgKind;
+
+// 长度修饰
+typedef enum {
+    LEN_NONE = 0, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_Z, LEN_J, LEN_T, LEN_LONG_DOUBLE
+} LengthModifier;
+
+// 一个转换说明
+typedef struct {
+    size_t length;             // 整个转换说明的长度（含%）
+    size_t prefix;             // %以及标志、宽度、精度的长度（不含长度修饰）
+    char conversion;           // 转换字符
+    ArgKind kind;              // 参数类型
+    LengthModifier modifier;   // 长度修饰
+} FormatSpec;
+
+// 参数的二进制值；字符串为复制到strings中的偏移
+typedef union {
+    long long i;
+    unsigned long long u;
+    double d;
+    const void* p;
+    size_t offset;
+} LogArg;
+
+// 一条日志记录
+typedef struct {
+    uint64_t time_us;                  // 记录时间（单调时钟）
+    const char* format;                // 格式字符串（常量）
+    uint8_t level;                     // 级别
+    uint8_t arg_count;                 // 参数个数，之后的转换说明原样输出
+    LogArg args[LOG_MAX_ARGS];         // 参数
+    char strings[LOG_STRING_SPACE];    // 字符串参数的副本
+} LogRecord;
+
+// 单生产者（记录的线程）/单消费者（后台线程）环形缓冲区
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t head;    // 后台线程写入
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;    // 记录的线程写入
+    atomic_uint_least64_t dropped;                   // 缓冲区满时丢弃的记录数
+    LogRecord records[LOG_RING_CAPACITY];
+} LogRing;
+
+atomic_int log_level_threshold = LOG_LEVEL_INFO;
+
+static _Atomic(LogRing*) rings[LOG_MAX_THREADS];   // 已注册的环形缓冲区
+static atomic_int ring_count = 0;                   // 已分配的槽位数
+static _Thread_local LogRing* thread_ring = NULL;   // 当前线程的环形缓冲区
+static _Thread_local bool thread_ring_failed = false; // 当前线程没有分到环形缓冲区
+static atomic_bool running = false;                 // 后台线程是否在运行
+static atomic_bool writer_waiting = false;          // 后台线程已看到所有缓冲区为空，正在（或即将）等待唤醒
+static int wake_read_fd = -1;                        // 唤醒后台线程：Linux上为eventfd，其他系统为管道
+static int wake_write_fd = -1;
+static pthread_t writer_thread;
+static atomic_uint_least64_t start_us = 0;           // 日志时间的起点（log_start或第一条同步写出的日志）
+static uint64_t reported_dropped = 0;                // 已报告的丢弃数（仅后台线程访问）
+
+// 单调时钟（微秒）
+static uint64_t log_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// 设置级别
+void log_set_level(LogLevel level) {
+    atomic_store_explicit(&log_level_threshold, (int)level, memory_order_relaxed);
+}
+
+// 解析级别名称
+bool log_parse_level(const char* name, LogLevel* level) {
+    static const struct {
+        const char* name;
+        LogLevel level;
+    } names[] = {
+        {"error", LOG_LEVEL_ERROR},
+        {"warn", LOG_LEVEL_WARN},
+        {"info", LOG_LEVEL_INFO},
+        {"debug", LOG_LEVEL_DEBUG},
+    };
+
+    if (!name || !level) return false;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i].name) == 0) {
+            *level = names[i].level;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 解析从%开始的一个转换说明
+static void parse_spec(const char* p, FormatSpec* spec) {
+    const char* start = p++;
+    memset(spec, 0, sizeof(*spec));
+
+    if (*p == '%') {
+        spec->length = 2;
+        spec->kind = ARG_NONE;
+        return;
+    }
+
+    // 标志、宽度、精度；不支持*
+    while (*p && strchr("-+ #0", *p)) p++;
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    spec->prefix = (size_t)(p - start);
+
+    if (*p == 'h') {
+        p++;
+        spec->modifier = LEN_H;
+        if (*p == 'h') {
+            p++;
+            spec->modifier = LEN_HH;
+        }
+    } else if (*p == 'l') {
+        p++;
+        spec->modifier = LEN_L;
+        if (*p == 'l') {
+            p++;
+            spec->modifier = LEN_LL;
+        }
+    } else if (*p == 'z') {
+        p++;
+        spec->modifier = LEN_Z;
+    } else if (*p == 'j') {
+        p++;
+        spec->modifier = LEN_J;
+    } else if (*p == 't') {
+        p++;
+        spec->modifier = LEN_T;
+    } else if (*p == 'L') {
+        p++;
+        spec->modifier = LEN_LONG_DOUBLE;
+    }
+
+    spec->conversion = *p;
+    spec->length = (size_t)(p - start) + (*p ? 1 : 0);
+    switch (*p) {
+        case 'd': case 'i':
+            spec->kind = ARG_SIGNED;
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            spec->kind = ARG_UNSIGNED;
+            break;
+        case 'c':
+            spec->kind = ARG_CHAR;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec->kind = ARG_DOUBLE;
+            break;
+        case 's':
+            spec->kind = ARG_STRING;
+            break;
+        case 'p':
+            spec->kind = ARG_POINTER;
+            break;
+        default:
+            spec->kind = ARG_INVALID;
+            break;
+    }
+}
+
+// 按长度修饰读取有符号整数
+static long long fetch_signed(va_list* ap, LengthModifier modifier) {
+    switch (modifier) {
+        case LEN_HH: return (signed char)va_arg(*ap, int);
+        case LEN_H: return (short)va_arg(*ap, int);
+        case LEN_L: return va_arg(*ap, long);
+        case LEN_LL: return va_arg(*ap, long long);
+        case LEN_Z: return (long long)va_arg(*ap, size_t);
+        case LEN_J: return (long long)va_arg(*ap, intmax_t);
+        case LEN_T: return (long long)va_arg(*ap, ptrdiff_t);
+        default: return va_arg(*ap, int);
+    }
+}
+
+// 按长度修饰读取无符号整数
+static unsigned long long fetch_unsigned(va_list* ap, LengthModifier modifier) {
+    switch (modifier) {
+        case LEN_HH: return (unsigned char)va_arg(*ap, unsigned int);
+        case LEN_H: return (unsigned short)va_arg(*ap, unsigned int);
+        case LEN_L: return va_arg(*ap, unsigned long);
+        case LEN_LL: return va_arg(*ap, unsigned long long);
+        case LEN_Z: return va_arg(*ap, size_t);
+        case LEN_J: return (unsigned long long)va_arg(*ap, uintmax_t);
+        case LEN_T: return (unsigned long long)va_arg(*ap, ptrdiff_t);
+        default: return va_arg(*ap, unsigned int);
+    }
+}
+
+// 按格式字符串读取参数的二进制值，字符串复制到记录中
+static void capture_args(LogRecord* record, va_list* ap) {
+    size_t used = 0;
+    record->arg_count = 0;
+
+    for (const char* p = record->format; *p; ) {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+
+        FormatSpec spec;
+        parse_spec(p, &spec);
+        p += spec.length;
+        if (spec.kind == ARG_NONE) continue;
+        if (spec.kind == ARG_INVALID || record->arg_count == LOG_MAX_ARGS) return;
+
+        LogArg* arg = &record->args[record->arg_count++];
+        switch (spec.kind) {
+            case ARG_SIGNED:
+                arg->i = fetch_signed(ap, spec.modifier);
+                break;
+            case ARG_UNSIGNED:
+                arg->u = fetch_unsigned(ap, spec.modifier);
+                break;
+            case ARG_CHAR:
+                arg->i = va_arg(*ap, int);
+                break;
+            case ARG_DOUBLE:
+                arg->d = spec.modifier == LEN_LONG_DOUBLE ? (double)va_arg(*ap, long double) : va_arg(*ap, double);
+                break;
+            case ARG_POINTER:
+                arg->p = va_arg(*ap, void*);
+                break;
+            case ARG_STRING: {
+                const char* s = va_arg(*ap, const char*);
+                if (!s) s = "(null)";
+                if (used >= LOG_STRING_SPACE) {
+                    arg->offset = LOG_STRING_SPACE - 1; // 空间已用完，输出最后一个字符串的结尾
+                    break;
+                }
+                size_t len = strlen(s);
+                if (len > LOG_STRING_SPACE - 1 - used) {
+                    len = LOG_STRING_SPACE - 1 - used;
+                }
+                memcpy(record->strings + used, s, len);
+                record->strings[used + len] = '\0';
+                arg->offset = used;
+                used += len + 1;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+// 设置日志时间的起点，已设置时不变（多个线程可能同时第一次写出）；返回起点
+static uint64_t set_start_us(uint64_t now_us) {
+    uint64_t expected = atomic_load_explicit(&start_us, memory_order_relaxed);
+    if (expected != 0) return expected;
+    if (atomic_compare_exchange_strong(&start_us, &expected, now_us)) return now_us;
+    return expected;
+}
+
+// 格式化一条记录（不含换行），返回写入的长度
+static size_t format_record(const LogRecord* record, char* line, size_t size) {
+    static const char* const level_names[] = {"错误: ", "警告: ", "", "调试: "};
+    uint64_t origin = set_start_us(record->time_us);
+    uint64_t elapsed = record->time_us > origin ? record->time_us - origin : 0;
+    int n = snprintf(line, size, "[%llu.%06llu] %s", (unsigned long long)(elapsed / 1000000),
+                     (unsigned long long)(elapsed % 1000000), level_names[record->level & 3]);
+    size_t len = n > 0 ? (size_t)n : 0;
+    size_t arg_index = 0;
+
+    for (const char* p = record->format; *p && len + 1 < size; ) {
+        if (*p != '%') {
+            line[len++] = *p++;
+            continue;
+        }
+
+        FormatSpec spec;
+        parse_spec(p, &spec);
+        if (spec.kind == ARG_NONE) {
+            line[len++] = '%';
+            p += spec.length;
+            continue;
+        }
+
+        // 没有读取参数的转换说明（不支持或超过LOG_MAX_ARGS）原样输出
+        if (spec.kind == ARG_INVALID || arg_index >= record->arg_count) {
+            line[len++] = *p++;
+            continue;
+        }
+
+        // 整数统一按long long格式化，其余按原来的转换字符
+        char piece[32];
+        if (spec.prefix + 4 > sizeof(piece)) {
+            line[len++] = *p++;
+            continue;
+        }
+        memcpy(piece, p, spec.prefix);
+        size_t piece_len = spec.prefix;
+        if (spec.kind == ARG_SIGNED || spec.kind == ARG_UNSIGNED) {
+            piece[piece_len++] = 'l';
+            piece[piece_len++] = 'l';
+        }
+        piece[piece_len++] = spec.conversion;
+        piece[piece_len] = '\0';
+
+        const LogArg* arg = &record->args[arg_index++];
+        size_t room = size - len;
+        switch (spec.kind) {
+            case ARG_SIGNED: n = snprintf(line + len, room, piece, arg->i); break;
+            case ARG_UNSIGNED: n = snprintf(line + len, room, piece, arg->u); break;
+            case ARG_CHAR: n = snprintf(line + len, room, piece, (int)arg->i); break;
+            case ARG_DOUBLE: n = snprintf(line + len, room, piece, arg->d); break;
+            case ARG_POINTER: n = snprintf(line + len, room, piece, arg->p); break;
+            case ARG_STRING: n = snprintf(line + len, room, piece, record->strings + arg->offset); break;
+            default: n = 0; break;
+        }
+        if (n > 0) {
+            len += (size_t)n < room ? (size_t)n : room - 1;
+        }
+        p += spec.length;
+    }
+
+    line[len] = '\0';
+    return len;
+}
+
+// 写出一条记录：错误和警告写到stderr，其余写到stdout
+static void emit_record(const LogRecord* record, char* out, size_t* out_len, char* err, size_t* err_len) {
+    char line[LOG_LINE_SIZE];
+    size_t len = format_record(record, line, sizeof(line) - 1);
+    line[len++] = '\n';
+
+    bool to_stderr = record->level <= LOG_LEVEL_WARN;
+    char* buf = to_stderr ? err : out;
+    size_t* used = to_stderr ? err_len : out_len;
+    if (*used + len > LOG_OUTPUT_SIZE) {
+        fwrite(buf, 1, *used, to_stderr ? stderr : stdout);
+        *used = 0;
+    }
+    memcpy(buf + *used, line, len);
+    *used += len;
+}
+
+// 后台线程：按时间顺序合并所有线程的记录并写出，返回写出的记录数
+static size_t drain_rings(void) {
+    static char out[LOG_OUTPUT_SIZE], err[LOG_OUTPUT_SIZE];
+    size_t out_len = 0, err_len = 0;
+    size_t count = atomic_load_explicit(&ring_count, memory_order_acquire);
+    if (count > LOG_MAX_THREADS) count = LOG_MAX_THREADS;
+
+    // 只处理开始时已写入的记录，写入快的线程不会使后台线程一直不停
+    LogRing* active[LOG_MAX_THREADS];
+    size_t heads[LOG_MAX_THREADS], tails[LOG_MAX_THREADS];
+    size_t active_count = 0;
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < count; i++) {
+        LogRing* ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        if (!ring) continue;
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        active[active_count] = ring;
+        heads[active_count] = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        tails[active_count] = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        active_count++;
+    }
+
+    size_t written = 0;
+    for (;;) {
+        size_t pick = active_count;
+        uint64_t earliest = UINT64_MAX;
+        for (size_t i = 0; i < active_count; i++) {
+            if (heads[i] == tails[i]) continue;
+            const LogRecord* record = &active[i]->records[heads[i] & (LOG_RING_CAPACITY - 1)];
+            if (record->time_us < earliest) {
+                earliest = record->time_us;
+                pick = i;
+            }
+        }
+        if (pick == active_count) break;
+
+        emit_record(&active[pick]->records[heads[pick] & (LOG_RING_CAPACITY - 1)], out, &out_len, err, &err_len);
+        heads[pick]++;
+        atomic_store_explicit(&active[pick]->head, heads[pick], memory_order_release);
+        written++;
+    }
+
+    if (err_len > 0) {
+        fwrite(err, 1, err_len, stderr);
+    }
+    if (out_len > 0) {
+        fwrite(out, 1, out_len, stdout);
+        fflush(stdout);
+    }
+    if (dropped > reported_dropped) {
+        fprintf(stderr, "日志缓冲区已满，丢弃了%llu条日志\n", (unsigned long long)(dropped - reported_dropped));
+        reported_dropped = dropped;
+    }
+    return written;
+}
+
+// 创建唤醒描述符（非阻塞，记录的线程写入时从不等待）
+static bool open_wake_fds(void) {
+#ifdef __linux__
+    wake_read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    wake_write_fd = wake_read_fd;
+    return wake_read_fd >= 0;
+#else
+    int fds[2];
+    if (pipe(fds) < 0) return false;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    wake_read_fd = fds[0];
+    wake_write_fd = fds[1];
+    return true;
+#endif
+}
+
+// 关闭唤醒描述符
+static void close_wake_fds(void) {
+    if (wake_write_fd >= 0 && wake_write_fd != wake_read_fd) close(wake_write_fd);
+    if (wake_read_fd >= 0) close(wake_read_fd);
+    wake_read_fd = -1;
+    wake_write_fd = -1;
+}
+
+// 唤醒后台线程
+static void wake_writer(void) {
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t n = write(wake_write_fd, &one, sizeof(one));
+#else
+    char one = 1;
+    ssize_t n = write(wake_write_fd, &one, 1); // 管道已满时已有未处理的唤醒
+#endif
+    (void)n;
+}
+
+// 阻塞直到被唤醒，并取走所有唤醒
+static void wait_for_wake(void) {
+    struct pollfd pfd = {wake_read_fd, POLLIN, 0};
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {
+    }
+    char buf[64];
+    while (read(wake_read_fd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+// 所有环形缓冲区是否为空（仅后台线程调用，与记录的线程的检查配对）
+static bool rings_empty(void) {
+    size_t count = atomic_load(&ring_count);
+    if (count > LOG_MAX_THREADS) count = LOG_MAX_THREADS;
+    for (size_t i = 0; i < count; i++) {
+        LogRing* ring = atomic_load(&rings[i]);
+        if (ring && atomic_load_explicit(&ring->head, memory_order_relaxed) != atomic_load(&ring->tail)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 后台写出线程：没有日志时一直阻塞，不定时醒来
+static void* writer_thread_func(void* arg) {
+    (void)arg;
+
+    while (atomic_load_explicit(&running, memory_order_acquire)) {
+        drain_rings();
+
+        // 先标记等待再检查，记录的线程先写入再检查标记，两者至少有一方看到对方，唤醒不会丢失
+        atomic_store(&writer_waiting, true);
+        if (!rings_empty()) {
+            atomic_store(&writer_waiting, false);
+            continue;
+        }
+        wait_for_wake();
+        if (!atomic_load_explicit(&running, memory_order_acquire)) break;
+
+        struct timespec delay = {0, LOG_BATCH_DELAY_NS};
+        nanosleep(&delay, NULL);
+    }
+    return NULL;
+}
+
+// 启动后台线程
+bool log_start(void) {
+    if (atomic_load(&running)) return true;
+
+    set_start_us(log_time_us());
+    if (!open_wake_fds()) {
+        perror("无法创建日志线程的唤醒描述符，日志直接写出");
+        return false;
+    }
+    atomic_store(&writer_waiting, false);
+    atomic_store(&running, true);
+    if (pthread_create(&writer_thread, NULL, writer_thread_func, NULL) != 0) {
+        atomic_store(&running, false);
+        close_wake_fds();
+        fprintf(stderr, "无法创建日志线程，日志直接写出\n");
+        return false;
+    }
+    return true;
+}
+
+// 停止后台线程
+void log_stop(void) {
+    if (!atomic_load(&running)) return;
+
+    atomic_store(&running, false);
+    wake_writer();
+    pthread_join(writer_thread, NULL);
+    drain_rings();
+    close_wake_fds();
+}
+
+// 当前线程的环形缓冲区，第一次记录时分配；分不到时返回NULL
+static LogRing* get_thread_ring(void) {
+    if (thread_ring || thread_ring_failed) return thread_ring;
+
+    int slot = atomic_fetch_add(&ring_count, 1);
+    LogRing* ring = slot < LOG_MAX_THREADS ? (LogRing*)calloc(1, sizeof(LogRing)) : NULL;
+    if (!ring) {
+        thread_ring_failed = true;
+        return NULL;
+    }
+    atomic_store_explicit(&rings[slot], ring, memory_order_release);
+    thread_ring = ring;
+    return ring;
+}
+
+// 同步写出（后台线程未启动或当前线程没有环形缓冲区）
+static void write_now(LogRecord* record) {
+    char line[LOG_LINE_SIZE];
+    size_t len = format_record(record, line, sizeof(line));
+    FILE* stream = record->level <= LOG_LEVEL_WARN ? stderr : stdout;
+    fprintf(stream, "%.*s\n", (int)len, line);
+}
+
+// 记录一条日志
+void log_write(LogLevel level, const char* format, ...) {
+    if (!format) return;
+
+    LogRing* ring = atomic_load_explicit(&running, memory_order_relaxed) ? get_thread_ring() : NULL;
+    if (!ring) {
+        LogRecord record;
+        record.time_us = log_time_us();
+        record.format = format;
+        record.level = (uint8_t)level;
+        va_list ap;
+        va_start(ap, format);
+        capture_args(&record, &ap);
+        va_end(ap);
+        write_now(&record);
+        return;
+    }
+
+    // 缓冲区满时丢弃，记录的线程从不等待
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head >= LOG_RING_CAPACITY) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    LogRecord* record = &ring->records[tail & (LOG_RING_CAPACITY - 1)];
+    record->time_us = log_time_us();
+    record->format = format;
+    record->level = (uint8_t)level;
+    va_list ap;
+    va_start(ap, format);
+    capture_args(record, &ap);
+    va_end(ap);
+
+    atomic_store(&ring->tail, tail + 1);
+
+    // 只在缓冲区由空变为非空、且后台线程在等待时唤醒；后台线程忙时不产生系统调用
+    if (atomic_load(&writer_waiting) && atomic_load(&ring->head) == tail &&
+        atomic_exchange(&writer_waiting, false)) {
+        wake_writer();
+    }
+}
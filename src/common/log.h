@@ -0,0 +1,59 @@
+#ifndef MOUSE_LOG_H
+#define MOUSE_LOG_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * 异步分级日志
+ *
+ * 调用线程只把格式字符串的指针和参数的二进制值（字符串复制一份）写入自己的无锁环形缓冲区，
+ * 不格式化也不写终端；后台线程按时间顺序合并各线程的记录，格式化后一次写出。
+ * 级别在运行时设置，被关闭的级别只花一次读取和一次分支，参数不求值。
+ * 格式字符串必须是字符串常量（记录中只保存指针），支持printf的整数、浮点、%c、%s、%p和%%，
+ * 每条最多LOG_MAX_ARGS个参数；不支持宽度或精度为*。
+ * 环形缓冲区满时丢弃新记录并计数；log_start之前或线程过多时直接同步写出。
+ */
+
+// 日志级别，数值越大越详细
+typedef enum {
+    LOG_LEVEL_ERROR = 0,
+    LOG_LEVEL_WARN = 1,
+    LOG_LEVEL_INFO = 2,
+    LOG_LEVEL_DEBUG = 3
+} LogLevel;
+
+// 每条记录最多的参数个数
+#define LOG_MAX_ARGS 8
+
+// 当前级别，大于它的记录被丢弃（由LOG_*宏读取）
+extern atomic_int log_level_threshold;
+
+// 某个级别是否开启
+#define LOG_ENABLED(level) ((int)(level) <= atomic_load_explicit(&log_level_threshold, memory_order_relaxed))
+
+#define LOG_AT(level, ...) do { \
+        if (LOG_ENABLED(level)) log_write(level, __VA_ARGS__); \
+    } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// 设置级别，任意线程随时可以调用
+void log_set_level(LogLevel level);
+
+// 解析级别名称（error、warn、info、debug），无效时返回false
+bool log_parse_level(const char* name, LogLevel* level);
+
+// 启动后台写出线程；之前的记录直接同步写出
+bool log_start(void);
+
+// 写出所有剩余的记录并停止后台线程
+void log_stop(void);
+
+// 记录一条日志（通常通过LOG_*宏调用）
+void log_write(LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif // MOUSE_LOG_H
@@ -4,35 +4,215 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <signal.h>
 #include "protocol.h"
 
 // 网络连接上下文
 typedef struct NetworkContext NetworkContext;
 
+// 传输方式
+typedef enum {
+    NETWORK_TRANSPORT_TCP = 0,     // 可靠字节流
+    NETWORK_TRANSPORT_UDP = 1      // 低延迟数据报，过期或乱序的移动消息被丢弃
+} NetworkTransport;
+
+// 服务端：多个发送端同时连接时，移动消息只分发拥有控制权的发送端的
+typedef enum {
+    NETWORK_ARBITRATION_LAST_ACTIVE = 0, // 最近移动的发送端获得控制权
+    NETWORK_ARBITRATION_PRIORITY = 1     // 优先级高的发送端随时接管，同优先级按最近移动
+} NetworkArbitration;
+
+// 服务端最多同时连接的发送端数
+#define NETWORK_MAX_PEERS 64
+
+// 默认的控制权保持时间：控制者停止移动并松开按钮这么久之后，其他发送端才能接管
+#define NETWORK_DEFAULT_HOLD_MS 200
+
+// 服务端：控制者意外断开后保留它的会话（控制权和按着的按钮）这么久，等待同一发送端重连恢复
+#define NETWORK_SESSION_GRACE_MS 2000
+
+// 对端信息
+typedef struct {
+    uint32_t id;                   // 连接编号，每个连接不同
+    char address[16];              // IPv4地址
+    uint16_t port;                 // 端口
+    int priority;                  // 仲裁优先级
+    bool active;                   // 服务端：是否拥有控制权
+} NetworkPeerInfo;
+
+// 延迟分布（微秒）
+typedef struct {
+    uint64_t count;                // 样本数
+    uint64_t p50_us;               // 中位数
+    uint64_t p99_us;               // 99%分位
+    uint64_t p999_us;              // 99.9%分位
+    uint64_t max_us;               // 最大值
+} NetworkLatencyStats;
+
+// 连接统计，上下文创建以来累计（重连不清零）
+typedef struct {
+    uint64_t messages_out;         // 写出的消息数
+    uint64_t bytes_out;            // 写出的字节数
+    uint64_t messages_in;          // 分发给回调的消息数
+    uint64_t bytes_in;             // 收到的字节数
+    uint64_t would_block;          // 写入时套接字缓冲区已满（EAGAIN）的次数
+    uint64_t partial_sends;        // 只写出部分数据的次数
+    uint64_t coalesced;            // 在发送队列中被合并的移动消息数
+    uint64_t dropped;              // 丢弃的消息数（发送队列满、UDP发送失败、过期的UDP移动）
+    uint64_t reconnects;           // 重新建立连接的次数
+    uint64_t decode_errors;        // 解码错误次数
+    uint64_t arbitration_dropped;  // 服务端：没有控制权的发送端的移动消息数
+    uint64_t control_switches;     // 服务端：控制权切换次数
+    NetworkLatencyStats send_latency;     // 本地：调用发送到写入内核（本地阻塞）
+    NetworkLatencyStats dispatch_latency; // 对端发出到本地分发（网络抖动，需要时钟同步）
+} NetworkStats;
+
+// 事件循环中的连接事件
+typedef enum {
+    NETWORK_EVENT_ACCEPT = 0,      // 服务端接受了新的连接
+    NETWORK_EVENT_DISCONNECT = 1,  // 对端断开连接（服务端继续监听）
+    NETWORK_EVENT_WRITABLE = 2,    // 积压的发送数据已全部写出
+    NETWORK_EVENT_TIMEOUT = 3      // 等待超时，期间没有任何事件
+} NetworkEvent;
+
+// 事件循环最多关注的外部描述符数
+#define NETWORK_MAX_WATCHES 8
+
 // 设置接收回调函数
 typedef void (*MessageCallback)(const Message* msg, size_t msg_size, void* user_data);
 
+// 连接事件回调函数
+typedef void (*NetworkEventCallback)(NetworkContext* ctx, NetworkEvent event, void* user_data);
+
+// 外部描述符可读时的回调函数
+typedef void (*NetworkFdCallback)(int fd, void* user_data);
+
 // 初始化网络上下文
 NetworkContext* network_init(void);
 
 // 释放网络上下文
 void network_cleanup(NetworkContext* ctx);
 
-// 服务端：开始监听
+// 服务端：开始监听（TCP）；可同时接受多个发送端，每个连接独立解析，新连接不影响已有的连接
 bool network_start_server(NetworkContext* ctx, uint16_t port);
 
-// 客户端：连接到服务器
+// 服务端：使用指定传输方式开始监听
+bool network_start_server_transport(NetworkContext* ctx, uint16_t port, NetworkTransport transport);
+
+// 客户端：连接到服务器（TCP）
 bool network_connect(NetworkContext* ctx, const char* server_ip, uint16_t port);
 
-// 发送消息
+// 客户端：使用指定传输方式连接到服务器；TCP连接断开后由network_maintain_connection自动重连
+bool network_connect_transport(NetworkContext* ctx, const char* server_ip, uint16_t port,
+                               NetworkTransport transport);
+
+// 客户端（TCP）：连接到服务器；服务器暂时连不上（如尚未启动）时不失败，由network_maintain_connection
+// 按断线重连的退避时间在后台重试。只在地址无效等无法重试的情况下返回false，network_get_fd为-1表示尚未连接
+bool network_connect_or_retry(NetworkContext* ctx, const char* server_ip, uint16_t port);
+
+// 客户端（TCP）：维持连接，应在每次等待前调用。连接断开后立即非阻塞重连，失败后从10毫秒起加倍退避，最长2秒；
+// 重连时沿用同一个会话编号，连接后自动发送连接消息并补发最新的位置和按钮，接收端据此恢复会话。
+// 收到过服务端心跳后超过3秒没有任何数据也视为断开。正在连接时network_has_pending_output为true，
+// 套接字可写时调用network_flush完成连接。返回距下一次需要调用的毫秒数，-1表示不需要定时调用
+int network_maintain_connection(NetworkContext* ctx);
+
+// 发送消息：TCP下放入发送队列并尽量写出，队列已满且无法合并时返回false
+// 服务端在回调中发给消息（或事件）的来源，其他时候发给当前拥有控制权的发送端
 bool network_send_message(NetworkContext* ctx, const Message* msg, size_t msg_size);
 
+// TCP：写出发送队列中的数据，全部写出返回true
+bool network_flush(NetworkContext* ctx);
+
+// 是否有尚未写出的数据，为true时应在套接字可写后调用network_flush
+bool network_has_pending_output(NetworkContext* ctx);
+
+// 一段待写出的数据
+typedef struct {
+    const uint8_t* data;
+    size_t len;
+} NetworkSegment;
+
+// 客户端（TCP）：由调用者提交写出（如Linux发送端的io_uring）。启用后不再调用sendmsg，消息只编码进发送缓冲区，
+// 调用者用network_take_output取出待写出的帧，写出后调用network_complete_output；服务端和UDP返回false
+bool network_set_external_output(NetworkContext* ctx, bool enabled);
+
+// 取出待写出的帧，每帧一段（跨越发送缓冲区末尾的帧分两段），最多max_segments段；返回段数，
+// 未连接、没有数据或上次取出的尚未完成时返回0。取出的数据在network_complete_output之前保持不变
+int network_take_output(NetworkContext* ctx, NetworkSegment* segments, int max_segments);
+
+// 上次取出的数据按顺序写出了written字节，error为失败的负errno，0表示没有失败，written_us为写出的时间
+// （network_time_us，用于发送延迟统计）；没有写出的数据留在发送缓冲区，下次network_take_output重新取出。
+// 重连后调用时忽略
+void network_complete_output(NetworkContext* ctx, size_t written, int error, uint64_t written_us);
+
+// 设置套接字的SO_BUSY_POLL（微秒，0表示不使用），现有的和之后重连、接受的连接都使用：
+// 接收时在内核中忙等待网卡队列而不是等待中断，降低延迟但占用CPU。
+// 仅Linux支持；超过net.core.busy_read时需要CAP_NET_ADMIN，失败时返回false并设置errno
+bool network_set_busy_poll(NetworkContext* ctx, unsigned int busy_poll_us);
+
+// 当前连接的套接字描述符（TCP服务端为拥有控制权的发送端的连接），未连接返回-1
+int network_get_fd(NetworkContext* ctx);
+
+// 客户端：当前连接的编号，每次重新连接都不同，没有连接时返回0。套接字关闭后描述符可能被新的连接重用，
+// 调用者据此判断针对旧描述符的请求（如io_uring的poll和发送）是否已失效
+uint32_t network_get_connection_id(NetworkContext* ctx);
+
+// 服务端监听套接字描述符（仅TCP），未监听返回-1
+int network_get_listen_fd(NetworkContext* ctx);
+
+// 事件循环的描述符（Linux为epoll，macOS为kqueue），有事件就绪时可读；
+// 可交给其他事件循环关注，可读时调用network_poll(ctx, 0)
+int network_get_poll_fd(NetworkContext* ctx);
+
+// 设置连接事件回调函数（接受连接、断开、积压数据写完、超时）
+void network_set_event_callback(NetworkContext* ctx, NetworkEventCallback callback, void* user_data);
+
+// 在事件循环中关注外部描述符（如定时器），可读时调用回调函数；最多NETWORK_MAX_WATCHES个
+bool network_watch_fd(NetworkContext* ctx, int fd, NetworkFdCallback callback, void* user_data);
+
+// 取消关注外部描述符（关闭描述符前调用）
+void network_unwatch_fd(NetworkContext* ctx, int fd);
+
+// 等待并处理一轮事件：接受连接、读取并分发消息、写出积压数据、外部描述符；
+// timeout_ms为-1时一直等待，超时无事件时触发NETWORK_EVENT_TIMEOUT。返回分发的消息数，出错返回-1
+int network_poll(NetworkContext* ctx, int timeout_ms);
+
+// 循环调用network_poll，直到*running为0（信号处理函数中设置）或出错；出错返回false
+bool network_run(NetworkContext* ctx, int timeout_ms, volatile sig_atomic_t* running);
+
 // 快捷方法：发送鼠标移动消息
 bool network_send_mouse_move(NetworkContext* ctx, float rel_x, float rel_y, uint8_t buttons);
 
-// 接收消息，非阻塞，如果没有消息则返回false
+// 发送心跳请求；对端自动回复，回复用于估计往返时间和时钟偏差；服务端发给所有发送端
+bool network_send_heartbeat(NetworkContext* ctx);
+
+// 读取时钟偏差估计（服务端为当前对端，见network_get_current_peer）：offset_us为对端单调时钟减本地单调时钟，rtt_us为对应的往返时间；尚无样本时返回false
+bool network_get_clock_offset(NetworkContext* ctx, int64_t* offset_us, uint64_t* rtt_us);
+
+// 读取统计，计数器为原子变量，可在其他线程调用
+bool network_get_stats(NetworkContext* ctx, NetworkStats* stats);
+
+// 服务端：设置控制权仲裁策略和保持时间
+void network_set_arbitration(NetworkContext* ctx, NetworkArbitration policy, unsigned int hold_ms);
+
+// 服务端：按IPv4地址设置发送端的优先级（默认0），对已连接的发送端立即生效
+bool network_set_peer_priority(NetworkContext* ctx, const char* address, int priority);
+
+// 已连接的对端数
+size_t network_get_peer_count(NetworkContext* ctx);
+
+// 当前对端：回调中为消息或事件的来源，服务端其他时候为拥有控制权的发送端；没有时返回false
+bool network_get_current_peer(NetworkContext* ctx, NetworkPeerInfo* info);
+
+// 本地单调时钟当前时间（微秒），与消息中的时间戳同一时基
+uint64_t network_time_us(void);
+
+// 接收消息，非阻塞，如果没有消息则返回false（心跳由网络层处理，不返回）
 bool network_receive_message(NetworkContext* ctx, Message* msg, size_t* msg_size);
 
+// 非阻塞：读取一次套接字，把所有完整的消息分发给回调函数，返回分发的消息数
+size_t network_process_messages(NetworkContext* ctx);
+
 // 设置接收回调函数
 void network_set_callback(NetworkContext* ctx, MessageCallback callback, void* user_data);
 
@@ -1,29 +1,231 @@
 #include "network.h"
+#include "wire.h"
+#include "histogram.h"
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <errno.h>
+#include <limits.h>
 #include <time.h>
-#include <sys/time.h>
+#include <stdatomic.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#endif
+
+// TCP接收缓冲区大小，可容纳多帧
+#define RX_BUFFER_SIZE 4096
+
+// TCP发送队列容量（消息数）
+#define TX_QUEUE_CAPACITY 256
+
+// TCP发送缓冲区大小（已编码的字节）
+#define TX_BUFFER_SIZE 4096
+
+// 发送缓冲区中最多的帧数（每帧至少2字节）
+#define TX_FRAME_CAPACITY (TX_BUFFER_SIZE / 2)
+
+// 事件循环一次最多取出的事件数
+#define POLL_BATCH_SIZE 16
+
+// 事件循环中的事件来源：服务端套接字、外部描述符（POLL_TAG_WATCH + 下标）、对端连接（POLL_TAG_PEER + 下标）
+#define POLL_TAG_SERVER 0
+#define POLL_TAG_WATCH 1
+#define POLL_TAG_PEER (POLL_TAG_WATCH + NETWORK_MAX_WATCHES)
+
+// 时钟同步保留的心跳样本数，取其中往返时间最短的一个
+#define CLOCK_SAMPLE_COUNT 8
+
+// 服务端等待接受的连接数
+#define LISTEN_BACKLOG 16
+
+// UDP服务端：对端超过此时间没有任何数据（包括心跳回复）即视为断开
+#define UDP_PEER_TIMEOUT_US 5000000
+
+// 客户端（TCP）：连接断开后立即重连，失败后的退避时间从RECONNECT_MIN_US开始每次加倍，最长RECONNECT_MAX_US
+#define RECONNECT_MIN_US 10000
+#define RECONNECT_MAX_US 2000000
+
+// 客户端（TCP）：一次非阻塞连接最多等待的时间，超时按失败处理
+#define CONNECT_TIMEOUT_US 1000000
+
+// 客户端（TCP）：服务端每秒发送心跳，超过此时间没有收到任何数据即视为链路已中断（可能收不到RST）
+#define CLIENT_IDLE_TIMEOUT_US 3000000
+
+// 按地址设置的优先级规则数
+#define MAX_PRIORITY_RULES NETWORK_MAX_PEERS
+
+// 写入已关闭的连接时不产生SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+// 发送缓冲区中一帧的结束位置和进入发送队列的时间，用于统计发送延迟
+typedef struct {
+    uint64_t end;                  // 帧结束处的累计编码字节数
+    uint64_t queued_us;            // 进入发送队列的时间
+} TxFrame;
+
+// 计数器和延迟直方图，原子更新，可在其他线程读取
+typedef struct {
+    atomic_uint_least64_t messages_out;   // 写出的消息数
+    atomic_uint_least64_t bytes_out;      // 写出的字节数
+    atomic_uint_least64_t messages_in;    // 收到的消息数
+    atomic_uint_least64_t bytes_in;       // 收到的字节数
+    atomic_uint_least64_t would_block;    // 写入时遇到EAGAIN的次数
+    atomic_uint_least64_t partial_sends;  // 只写出部分数据的次数
+    atomic_uint_least64_t coalesced;      // 在发送队列中被合并的移动消息数
+    atomic_uint_least64_t dropped;        // 丢弃的消息数
+    atomic_uint_least64_t reconnects;     // 重新建立连接的次数
+    atomic_uint_least64_t decode_errors;  // 解码错误次数
+    atomic_uint_least64_t arbitration_dropped; // 没有控制权的发送端的移动消息数
+    atomic_uint_least64_t control_switches;    // 控制权切换次数
+    Histogram send_latency;               // 调用发送到写入内核的耗时
+    Histogram dispatch_latency;           // 对端发出到本地分发的耗时
+} ContextStats;
+
+// 事件循环关注的外部描述符
+typedef struct {
+    int fd;                        // 描述符，-1表示空位
+    NetworkFdCallback callback;    // 可读时调用
+    void* user_data;               // 用户数据
+} PollWatch;
+
+// 一个就绪事件
+typedef struct {
+    uintptr_t tag;                 // 事件来源
+    bool readable;                 // 可读（或连接关闭、出错）
+    bool writable;                 // 可写
+} PollEvent;
+
+// 一个对端连接：客户端只有一个（连接到的服务端），服务端每个发送端一个，各自独立解析和编码
+typedef struct {
+    int fd;                        // 连接套接字；UDP服务端的对端为-1，使用服务端套接字和addr收发
+    uint32_t id;                   // 连接编号（从1开始递增，不重复使用）
+    struct sockaddr_in addr;       // 对端地址
+    bool connected;                // 是否已连接
+    bool connecting;               // 客户端：非阻塞连接尚未完成
+    uint64_t session_id;           // 服务端：发送端在连接消息中带来的会话编号，0表示没有
+    bool has_motion;               // 客户端：是否发出过移动消息（重连后补发最新状态）
+    bool heartbeat_seen;           // 客户端：是否收到过服务端的心跳（之后才检查链路空闲）
+    int priority;                  // 仲裁优先级，数值大的优先
+    uint8_t buttons;               // 最近一条移动消息的按钮状态
+    float last_x, last_y;          // 最近一条分发（客户端：发出）的移动消息的位置
+    uint64_t last_active_us;       // 最近一条分发的移动消息的时间
+    uint64_t last_seen_us;         // 最近一次收到任何数据的时间
+    WireCodec tx_codec;            // 发送方向的线路编码状态
+    WireCodec rx_codec;            // 接收方向的线路编码状态
+    uint32_t send_seq;             // 下一个移动消息序号（消息未指定序号时使用）
+    uint32_t last_motion_seq;      // 最后接收（客户端：发出）的移动消息序号
+    bool motion_seq_valid;         // UDP：last_motion_seq是否有效
+    Message tx_queue[TX_QUEUE_CAPACITY]; // TCP发送队列，尚未编码的消息
+    size_t tx_queue_head;          // 队列头位置
+    size_t tx_queue_count;         // 队列中的消息数
+    uint64_t tx_queue_time[TX_QUEUE_CAPACITY]; // 队列中每条消息进入队列的时间
+    uint8_t tx_buf[TX_BUFFER_SIZE]; // TCP已编码待写出的字节（环形）
+    size_t tx_head;                // 待写出数据的起始位置
+    size_t tx_len;                 // 待写出的字节数
+    TxFrame tx_frames[TX_FRAME_CAPACITY]; // 发送缓冲区中尚未完全写出的帧
+    size_t tx_frame_head;          // 帧记录的起始位置
+    size_t tx_frame_count;         // 帧记录数
+    uint64_t tx_encoded;           // 累计编码的字节数
+    uint64_t tx_written;           // 累计写出的字节数
+    size_t tx_taken;               // 调用者提交写出、尚未完成的字节数（network_take_output）
+    uint8_t rx_buf[RX_BUFFER_SIZE]; // TCP接收缓冲区，未完整的帧保留到下次读取
+    size_t rx_start;               // 缓冲区中未解析数据的起始位置
+    size_t rx_end;                 // 缓冲区中数据的结束位置
+    uint64_t rx_time_us;           // 最近一次读取到数据的时间
+    int64_t clock_offsets[CLOCK_SAMPLE_COUNT]; // 心跳样本：对端时钟减本地时钟
+    uint64_t clock_rtts[CLOCK_SAMPLE_COUNT];   // 心跳样本：往返时间
+    size_t clock_sample_count;     // 有效样本数
+    size_t clock_sample_next;      // 下一个样本写入位置
+    bool poll_registered;          // 是否已注册到事件循环
+    bool poll_write;               // 是否关注可写
+} Peer;
+
+// 服务端：意外断开的控制者的会话，同一发送端在NETWORK_SESSION_GRACE_MS内重连时恢复控制权、按钮和位置
+typedef struct {
+    uint64_t session_id;           // 会话编号，0表示没有
+    uint8_t buttons;               // 断开时按着的按钮，恢复或过期前不释放
+    float last_x, last_y;          // 断开时的位置
+    uint32_t last_motion_seq;      // 断开前最后收到的移动消息序号
+    uint64_t detached_us;          // 断开的时间
+} DetachedSession;
+
+// 按地址设置的优先级
+typedef struct {
+    struct in_addr addr;           // 发送端地址
+    int priority;                  // 优先级
+} PriorityRule;
 
 struct NetworkContext {
-    int socket_fd;                 // 套接字描述符
-    int client_fd;                 // 客户端套接字（仅服务端使用）
+    int socket_fd;                 // 服务端套接字（TCP监听或UDP数据报），客户端不使用
     bool is_server;                // 是否是服务端
-    bool connected;                // 是否已连接
+    bool ever_connected;           // 是否曾经连接过（用于统计重连）
+    NetworkTransport transport;    // 传输方式
+    Peer* peers[NETWORK_MAX_PEERS]; // 对端连接，客户端只使用peers[0]
+    uint32_t next_peer_id;         // 下一个连接编号
+    Peer* current;                 // 正在分发消息或通知事件的对端，回调中发送的消息发给它
+    Peer* active;                  // 服务端：当前拥有控制权的发送端
+    NetworkArbitration arbitration; // 服务端：控制权仲裁策略
+    uint64_t hold_us;              // 控制者空闲多久后其他发送端才能接管
+    PriorityRule priority_rules[MAX_PRIORITY_RULES]; // 按地址设置的优先级
+    size_t priority_rule_count;    // 规则数
+    DetachedSession detached;      // 服务端：等待重连恢复的会话
+    uint64_t session_id;           // 客户端：会话编号，同一上下文重连时不变
+    struct sockaddr_in remote_addr; // 客户端：服务端地址，用于重连
+    bool reconnect_enabled;        // 客户端（TCP）：连接断开后是否自动重连
+    uint64_t reconnect_at_us;      // 客户端：下一次重连的时间，0表示没有安排
+    uint64_t reconnect_delay_us;   // 客户端：再失败一次后的退避时间
+    uint64_t connect_started_us;   // 客户端：正在进行的非阻塞连接的开始时间
+    unsigned int busy_poll_us;     // 套接字的SO_BUSY_POLL，0表示不使用
+    bool external_output;          // 客户端（TCP）：由调用者提交写出，不调用sendmsg
+    ContextStats stats;            // 统计
     MessageCallback callback;      // 消息回调函数
     void* user_data;               // 用户数据（传递给回调函数）
+    int poll_fd;                   // 事件循环（Linux为epoll，其他系统为kqueue），首次使用时创建
+    int poll_server_fd;            // 已注册到事件循环的服务端套接字
+    PollWatch watches[NETWORK_MAX_WATCHES]; // 外部描述符
+    NetworkEventCallback event_callback; // 连接事件回调函数
+    void* event_user_data;         // 用户数据（传递给连接事件回调函数）
 };
 
-// 获取当前时间戳（毫秒）
-static uint64_t get_timestamp_ms(void) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (uint64_t)(tv.tv_sec) * 1000 + (uint64_t)(tv.tv_usec) / 1000;
+// 单调时钟当前时间（微秒）
+uint64_t network_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// 统计计数器累加
+static inline void stat_add(atomic_uint_least64_t* counter, uint64_t value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+// 读取统计计数器
+static inline uint64_t stat_load(atomic_uint_least64_t* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// 标记连接已建立，之前连接过时计为一次重连
+static void mark_connected(NetworkContext* ctx, Peer* peer) {
+    if (!peer->connected) {
+        if (ctx->ever_connected) {
+            stat_add(&ctx->stats.reconnects, 1);
+        }
+        ctx->ever_connected = true;
+    }
+    peer->connected = true;
 }
 
 // 初始化网络上下文
@@ -31,25 +233,107 @@ NetworkContext* network_init(void) {
     NetworkContext* ctx = (NetworkContext*)malloc(sizeof(NetworkContext));
     if (ctx) {
         memset(ctx, 0, sizeof(NetworkContext));
+        histogram_init(&ctx->stats.send_latency);
+        histogram_init(&ctx->stats.dispatch_latency);
         ctx->socket_fd = -1;
-        ctx->client_fd = -1;
         ctx->is_server = false;
-        ctx->connected = false;
+        ctx->transport = NETWORK_TRANSPORT_TCP;
+        ctx->next_peer_id = 1;
+        ctx->arbitration = NETWORK_ARBITRATION_LAST_ACTIVE;
+        ctx->hold_us = (uint64_t)NETWORK_DEFAULT_HOLD_MS * 1000;
         ctx->callback = NULL;
         ctx->user_data = NULL;
+        ctx->poll_fd = -1;
+        ctx->poll_server_fd = -1;
+        for (int i = 0; i < NETWORK_MAX_WATCHES; i++) {
+            ctx->watches[i].fd = -1;
+        }
     }
     return ctx;
 }
 
+// 释放已断开的对端（客户端断开后保留的连接状态）
+static void free_peers(NetworkContext* ctx) {
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        free(ctx->peers[i]);
+        ctx->peers[i] = NULL;
+    }
+}
+
 // 释放网络上下文
 void network_cleanup(NetworkContext* ctx) {
     if (!ctx) return;
     
     network_disconnect(ctx);
+    free_peers(ctx);
+    
+    if (ctx->poll_fd >= 0) {
+        close(ctx->poll_fd);
+    }
     
     free(ctx);
 }
 
+// 重置对端的线路编码和收发缓冲区，UDP可能丢包，只使用关键帧
+static void reset_peer(NetworkContext* ctx, Peer* peer) {
+    bool keyframes_only = ctx->transport == NETWORK_TRANSPORT_UDP;
+    wire_codec_init(&peer->tx_codec, keyframes_only);
+    wire_codec_init(&peer->rx_codec, keyframes_only);
+    peer->motion_seq_valid = false;
+    peer->rx_start = 0;
+    peer->rx_end = 0;
+    peer->tx_queue_head = 0;
+    peer->tx_queue_count = 0;
+    peer->tx_head = 0;
+    peer->tx_len = 0;
+    peer->tx_frame_head = 0;
+    peer->tx_frame_count = 0;
+    peer->tx_encoded = 0;
+    peer->tx_written = 0;
+    peer->tx_taken = 0;
+    peer->clock_sample_count = 0;
+    peer->clock_sample_next = 0;
+    peer->connecting = false;
+    peer->heartbeat_seen = false;
+}
+
+// 客户端：生成会话编号（非0），同一台机器上的多个发送端也不会相同
+static uint64_t new_session_id(const NetworkContext* ctx) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t x = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+    x ^= ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)ctx;
+    
+    // splitmix64混合
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x ? x : 1;
+}
+
+// TCP：关闭Nagle算法，小消息立即发出；禁止写入触发SIGPIPE
+static void set_stream_options(int fd) {
+    int option = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &option, sizeof(option));
+#endif
+}
+
+// 接收时忙等待网卡队列的时间（SO_BUSY_POLL），未设置或不支持时不做任何事
+static bool apply_busy_poll(NetworkContext* ctx, int fd) {
+    if (ctx->busy_poll_us == 0 || fd < 0) return true;
+    
+#ifdef SO_BUSY_POLL
+    int value = (int)ctx->busy_poll_us;
+    return setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) == 0;
+#else
+    errno = ENOPROTOOPT;
+    return false;
+#endif
+}
+
 // 设置非阻塞模式
 static bool set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
@@ -61,15 +345,247 @@ static bool set_nonblocking(int fd) {
     return true;
 }
 
-// 服务端：开始监听
+// 根据消息类型确定消息大小，未知类型返回0
+static size_t message_size_for_type(uint8_t type) {
+    switch (type) {
+        case MSG_MOUSE_MOVE:
+            return sizeof(MouseMoveMessage);
+        case MSG_CONNECT:
+            return sizeof(ConnectMessage);
+        case MSG_DISCONNECT:
+            return sizeof(DisconnectMessage);
+        case MSG_HEARTBEAT:
+            return sizeof(HeartbeatMessage);
+        case MSG_SCROLL:
+            return sizeof(ScrollMessage);
+        case MSG_KEY:
+            return sizeof(KeyMessage);
+        default:
+            return 0;
+    }
+}
+
+// 注册描述符（始终关注可读），已注册时只修改是否关注可写
+static bool poll_register(NetworkContext* ctx, int fd, uintptr_t tag, bool want_write,
+                          bool registered, bool was_writing) {
+#ifdef __linux__
+    (void)was_writing; // epoll一次设置全部关注的事件
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+    ev.data.u64 = tag;
+    return epoll_ctl(ctx->poll_fd, registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+    // kqueue按过滤器注册，只提交有变化的部分
+    struct kevent changes[2];
+    int count = 0;
+    if (!registered) {
+        EV_SET(&changes[count++], fd, EVFILT_READ, EV_ADD, 0, 0, (void*)tag);
+    }
+    if (want_write != was_writing) {
+        EV_SET(&changes[count++], fd, EVFILT_WRITE, want_write ? EV_ADD : EV_DELETE, 0, 0, (void*)tag);
+    }
+    return count == 0 || kevent(ctx->poll_fd, changes, count, NULL, 0, NULL) == 0;
+#endif
+}
+
+// 从事件循环中移除描述符（关闭描述符前调用，避免编号被重用后漏掉注册）
+static void poll_unregister(NetworkContext* ctx, int fd, bool was_writing) {
+    if (ctx->poll_fd < 0 || fd < 0) return;
+    
+#ifdef __linux__
+    (void)was_writing; // epoll一次移除全部事件
+    epoll_ctl(ctx->poll_fd, EPOLL_CTL_DEL, fd, NULL);
+#else
+    struct kevent changes[2];
+    int count = 0;
+    EV_SET(&changes[count++], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    if (was_writing) {
+        EV_SET(&changes[count++], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    }
+    kevent(ctx->poll_fd, changes, count, NULL, 0, NULL);
+#endif
+}
+
+// 关闭服务端套接字
+static void close_server_socket(NetworkContext* ctx) {
+    if (ctx->socket_fd < 0) return;
+    
+    if (ctx->poll_server_fd == ctx->socket_fd) {
+        poll_unregister(ctx, ctx->socket_fd, false);
+        ctx->poll_server_fd = -1;
+    }
+    close(ctx->socket_fd);
+    ctx->socket_fd = -1;
+}
+
+// 通知连接事件，回调中network_get_current_peer返回对应的对端
+static void notify_event(NetworkContext* ctx, Peer* peer, NetworkEvent event) {
+    if (!ctx->event_callback) return;
+    
+    Peer* previous = ctx->current;
+    ctx->current = peer;
+    ctx->event_callback(ctx, event, ctx->event_user_data);
+    ctx->current = previous;
+}
+
+// 按地址查找优先级
+static int priority_for_address(NetworkContext* ctx, const struct sockaddr_in* addr) {
+    for (size_t i = 0; i < ctx->priority_rule_count; i++) {
+        if (ctx->priority_rules[i].addr.s_addr == addr->sin_addr.s_addr) {
+            return ctx->priority_rules[i].priority;
+        }
+    }
+    return 0;
+}
+
+// 创建对端，连接数已满时返回NULL
+static Peer* peer_create(NetworkContext* ctx, int fd, const struct sockaddr_in* addr) {
+    int slot = -1;
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        if (!ctx->peers[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) return NULL;
+    
+    Peer* peer = (Peer*)calloc(1, sizeof(Peer));
+    if (!peer) return NULL;
+    
+    peer->fd = fd;
+    peer->id = ctx->next_peer_id++;
+    peer->addr = *addr;
+    peer->priority = priority_for_address(ctx, addr);
+    peer->send_seq = 1;
+    peer->last_seen_us = network_time_us();
+    reset_peer(ctx, peer);
+    ctx->peers[slot] = peer;
+    return peer;
+}
+
+// 分发一条在给定位置释放所有按钮的移动消息，source为消息的来源（可以为NULL）
+static void dispatch_release(NetworkContext* ctx, Peer* source, float x, float y, uint32_t sequence) {
+    if (!ctx->callback) return;
+    
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.mouse_move.type = MSG_MOUSE_MOVE;
+    msg.mouse_move.rel_x = x;
+    msg.mouse_move.rel_y = y;
+    msg.mouse_move.buttons = 0;
+    msg.mouse_move.sequence = sequence;
+    msg.mouse_move.receive_us = network_time_us();
+    
+    Peer* previous = ctx->current;
+    ctx->current = source;
+    ctx->callback(&msg, sizeof(MouseMoveMessage), ctx->user_data);
+    ctx->current = previous;
+}
+
+// 控制者离开或被接管时如果还按着按钮，补发一条释放消息，接收端不会留下按下的按钮
+static void release_buttons(NetworkContext* ctx, Peer* peer) {
+    if (peer->buttons == 0) return;
+    
+    peer->buttons = 0;
+    dispatch_release(ctx, peer, peer->last_x, peer->last_y, peer->last_motion_seq + 1);
+}
+    
+// 服务端：放弃等待恢复的会话，释放它按着的按钮
+static void drop_detached(NetworkContext* ctx) {
+    DetachedSession* session = &ctx->detached;
+    if (session->session_id == 0) return;
+    
+    session->session_id = 0;
+    if (session->buttons != 0) {
+        session->buttons = 0;
+        dispatch_release(ctx, NULL, session->last_x, session->last_y, session->last_motion_seq + 1);
+    }
+}
+
+// 客户端：安排下一次重连；第一次立即重连，之后每次失败退避时间加倍
+static void schedule_reconnect(NetworkContext* ctx, uint64_t now_us) {
+    ctx->reconnect_at_us = now_us + ctx->reconnect_delay_us;
+    if (ctx->reconnect_delay_us == 0) {
+        ctx->reconnect_delay_us = RECONNECT_MIN_US;
+    } else if (ctx->reconnect_delay_us < RECONNECT_MAX_US) {
+        ctx->reconnect_delay_us *= 2;
+        if (ctx->reconnect_delay_us > RECONNECT_MAX_US) {
+            ctx->reconnect_delay_us = RECONNECT_MAX_US;
+        }
+    }
+}
+
+// 关闭对端连接：服务端通知后释放对端，客户端保留连接状态（统计、时钟样本、序号）
+static void peer_close(NetworkContext* ctx, Peer* peer) {
+    if (peer->fd >= 0) {
+        if (peer->poll_registered) {
+            poll_unregister(ctx, peer->fd, peer->poll_write);
+            peer->poll_registered = false;
+            peer->poll_write = false;
+        }
+        close(peer->fd);
+        peer->fd = -1;
+    }
+    peer->connected = false;
+    peer->connecting = false;
+    
+    if (!ctx->is_server) {
+        if (ctx->reconnect_enabled) {
+            schedule_reconnect(ctx, network_time_us());
+        }
+        return;
+    }
+    
+    if (ctx->active == peer) {
+        // 控制者意外断开（TCP）时保留会话等待重连，按着的按钮暂不释放；主动断开或UDP时立即释放
+        if (peer->session_id != 0 && ctx->transport == NETWORK_TRANSPORT_TCP) {
+            drop_detached(ctx);
+            ctx->detached.session_id = peer->session_id;
+            ctx->detached.buttons = peer->buttons;
+            ctx->detached.last_x = peer->last_x;
+            ctx->detached.last_y = peer->last_y;
+            ctx->detached.last_motion_seq = peer->last_motion_seq;
+            ctx->detached.detached_us = network_time_us();
+        } else {
+            release_buttons(ctx, peer);
+        }
+        ctx->active = NULL;
+    }
+    notify_event(ctx, peer, NETWORK_EVENT_DISCONNECT);
+    
+    if (ctx->current == peer) {
+        ctx->current = NULL;
+    }
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        if (ctx->peers[i] == peer) {
+            ctx->peers[i] = NULL;
+        }
+    }
+    free(peer);
+}
+
+// 客户端的连接
+static Peer* client_peer(NetworkContext* ctx) {
+    return ctx->is_server ? NULL : ctx->peers[0];
+}
+
+// 服务端：开始监听（TCP）
 bool network_start_server(NetworkContext* ctx, uint16_t port) {
+    return network_start_server_transport(ctx, port, NETWORK_TRANSPORT_TCP);
+}
+
+// 服务端：使用指定传输方式开始监听
+bool network_start_server_transport(NetworkContext* ctx, uint16_t port, NetworkTransport transport) {
     if (!ctx) return false;
     
     // 断开现有连接
     network_disconnect(ctx);
+    free_peers(ctx);
     
     // 创建套接字
-    ctx->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+    ctx->transport = transport;
+    ctx->socket_fd = socket(AF_INET, transport == NETWORK_TRANSPORT_UDP ? SOCK_DGRAM : SOCK_STREAM, 0);
     if (ctx->socket_fd < 0) return false;
     
     // 允许地址重用
@@ -89,8 +605,8 @@ bool network_start_server(NetworkContext* ctx, uint16_t port) {
         return false;
     }
     
-    // 开始监听
-    if (listen(ctx->socket_fd, 1) < 0) {
+    // 开始监听（UDP无需监听），多个发送端可以同时连接
+    if (transport == NETWORK_TRANSPORT_TCP && listen(ctx->socket_fd, LISTEN_BACKLOG) < 0) {
         close(ctx->socket_fd);
         ctx->socket_fd = -1;
         return false;
@@ -103,20 +619,57 @@ bool network_start_server(NetworkContext* ctx, uint16_t port) {
         return false;
     }
     
+    apply_busy_poll(ctx, ctx->socket_fd);
     ctx->is_server = true;
     return true;
 }
 
-// 客户端：连接到服务器
+static bool send_to_peer(NetworkContext* ctx, Peer* peer, const Message* msg, size_t msg_size);
+static void check_connection(NetworkContext* ctx, Peer* peer);
+
+// 客户端：发送连接消息，携带线路编码版本、会话编号和最后发出的移动序号；
+// 断开期间的移动和按钮变化已经丢失，随后补发最新的位置和按钮（同一序号，不带采集时间，不计入延迟统计）
+static bool send_connect(NetworkContext* ctx, Peer* peer) {
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.connect.type = MSG_CONNECT;
+    msg.connect.version = WIRE_VERSION;
+    msg.connect.refresh_hz = 0;
+    msg.connect.session_id = ctx->session_id;
+    msg.connect.last_sequence = peer->has_motion ? peer->last_motion_seq : 0;
+    if (!send_to_peer(ctx, peer, &msg, sizeof(ConnectMessage))) return false;
+    if (!peer->has_motion) return true;
+    
+    memset(&msg, 0, sizeof(msg));
+    msg.mouse_move.type = MSG_MOUSE_MOVE;
+    msg.mouse_move.rel_x = peer->last_x;
+    msg.mouse_move.rel_y = peer->last_y;
+    msg.mouse_move.buttons = peer->buttons;
+    msg.mouse_move.sequence = peer->last_motion_seq;
+    return send_to_peer(ctx, peer, &msg, sizeof(MouseMoveMessage));
+}
+
+// 客户端：连接到服务器（TCP）
 bool network_connect(NetworkContext* ctx, const char* server_ip, uint16_t port) {
+    return network_connect_transport(ctx, server_ip, port, NETWORK_TRANSPORT_TCP);
+}
+
+// 客户端：使用指定传输方式连接到服务器
+bool network_connect_transport(NetworkContext* ctx, const char* server_ip, uint16_t port,
+                               NetworkTransport transport) {
     if (!ctx || !server_ip) return false;
     
     // 断开现有连接
     network_disconnect(ctx);
+    if (ctx->is_server) {
+        free_peers(ctx);
+        ctx->is_server = false;
+    }
     
-    // 创建套接字
-    ctx->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (ctx->socket_fd < 0) return false;
+    // 创建套接字，UDP的connect()只设置默认对端
+    ctx->transport = transport;
+    int fd = socket(AF_INET, transport == NETWORK_TRANSPORT_UDP ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (fd < 0) return false;
     
     // 连接到服务器
     struct sockaddr_in server_addr;
@@ -125,228 +678,1464 @@ bool network_connect(NetworkContext* ctx, const char* server_ip, uint16_t port)
     server_addr.sin_port = htons(port);
     
     if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) {
-        close(ctx->socket_fd);
-        ctx->socket_fd = -1;
+        close(fd);
         return false;
     }
     
-    if (connect(ctx->socket_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        close(ctx->socket_fd);
-        ctx->socket_fd = -1;
+    if (connect(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        close(fd);
         return false;
     }
     
     // 设置非阻塞模式
-    if (!set_nonblocking(ctx->socket_fd)) {
-        close(ctx->socket_fd);
-        ctx->socket_fd = -1;
+    if (!set_nonblocking(fd)) {
+        close(fd);
         return false;
     }
     
-    ctx->is_server = false;
-    ctx->connected = true;
+    if (transport == NETWORK_TRANSPORT_TCP) {
+        set_stream_options(fd);
+    }
+    apply_busy_poll(ctx, fd);
     
-    // 发送连接消息
-    ConnectMessage connect_msg;
-    connect_msg.type = MSG_CONNECT;
-    connect_msg.version = 1;
+    // 重新连接时沿用之前的连接状态，只重置编码和缓冲区
+    Peer* peer = ctx->peers[0];
+    if (!peer) {
+        peer = peer_create(ctx, fd, &server_addr);
+        if (!peer) {
+            close(fd);
+            return false;
+        }
+    } else {
+        peer->fd = fd;
+        peer->addr = server_addr;
+        reset_peer(ctx, peer);
+    }
+    peer->send_seq = 1;
+    mark_connected(ctx, peer);
+    peer->last_seen_us = network_time_us();
     
-    Message msg;
-    memcpy(&msg, &connect_msg, sizeof(connect_msg));
+    // TCP连接断开后自动重连，沿用同一个会话
+    if (ctx->session_id == 0) {
+        ctx->session_id = new_session_id(ctx);
+    }
+    ctx->remote_addr = server_addr;
+    ctx->reconnect_enabled = transport == NETWORK_TRANSPORT_TCP;
+    ctx->reconnect_at_us = 0;
+    ctx->reconnect_delay_us = 0;
     
-    return network_send_message(ctx, &msg, sizeof(connect_msg));
+    return send_connect(ctx, peer);
 }
-
-// 服务端：接受客户端连接
-static bool accept_client(NetworkContext* ctx) {
-    if (!ctx || !ctx->is_server || ctx->socket_fd < 0) return false;
     
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
+// 客户端（TCP）：连接到服务器，暂时连不上时在后台重试
+bool network_connect_or_retry(NetworkContext* ctx, const char* server_ip, uint16_t port) {
+    if (network_connect_transport(ctx, server_ip, port, NETWORK_TRANSPORT_TCP)) return true;
+    if (!ctx || !server_ip) return false;
     
-    int client_fd = accept(ctx->socket_fd, (struct sockaddr*)&client_addr, &addr_len);
-    if (client_fd < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            // 没有新的连接，非错误
-            return true;
-        }
-        return false;
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) return false;
+    
+    // 保留一个未连接的对端，第一次连接与断线重连相同：由network_maintain_connection按退避时间进行
+    Peer* peer = ctx->peers[0];
+    if (!peer) {
+        peer = peer_create(ctx, -1, &server_addr);
+        if (!peer) return false;
+    } else {
+        peer->addr = server_addr;
     }
     
-    // 关闭之前的客户端连接
-    if (ctx->client_fd >= 0) {
-        close(ctx->client_fd);
+    if (ctx->session_id == 0) {
+        ctx->session_id = new_session_id(ctx);
     }
+    ctx->remote_addr = server_addr;
+    ctx->reconnect_enabled = true;
+    ctx->reconnect_delay_us = RECONNECT_MIN_US;
+    schedule_reconnect(ctx, network_time_us());
+    return true;
+}
     
-    // 设置非阻塞模式
-    if (!set_nonblocking(client_fd)) {
-        close(client_fd);
+// 客户端：完成非阻塞连接，套接字还不可写时返回false；失败时关闭并按退避时间安排下一次重连
+static bool finish_connect(NetworkContext* ctx, Peer* peer) {
+    struct pollfd pfd = { .fd = peer->fd, .events = POLLOUT, .revents = 0 };
+    if (poll(&pfd, 1, 0) <= 0) return false;
+    
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(peer->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+        error = errno;
+    }
+    peer->connecting = false;
+    if (error != 0) {
+        peer_close(ctx, peer);
         return false;
     }
     
-    ctx->client_fd = client_fd;
-    ctx->connected = true;
-    
-    return true;
+    mark_connected(ctx, peer);
+    peer->last_seen_us = network_time_us();
+    ctx->reconnect_delay_us = 0;
+    return send_connect(ctx, peer);
 }
 
-// 发送消息
-bool network_send_message(NetworkContext* ctx, const Message* msg, size_t msg_size) {
-    if (!ctx || !msg || msg_size == 0) return false;
+// 客户端：开始一次非阻塞重连，连接在套接字可写时由finish_connect完成
+static void start_reconnect(NetworkContext* ctx, Peer* peer, uint64_t now_us) {
+    ctx->reconnect_at_us = 0;
     
-    if (!ctx->connected) {
-        if (ctx->is_server) {
-            if (!accept_client(ctx) || !ctx->connected) {
-                return false;
-            }
-        } else {
-            return false;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || !set_nonblocking(fd)) {
+        if (fd >= 0) {
+            close(fd);
         }
+        schedule_reconnect(ctx, now_us);
+        return;
     }
+    set_stream_options(fd);
+    apply_busy_poll(ctx, fd);
     
-    int fd = ctx->is_server ? ctx->client_fd : ctx->socket_fd;
-    
-    ssize_t sent = send(fd, msg, msg_size, 0);
-    if (sent < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            // 缓冲区已满，非错误
-            return false;
-        }
-        ctx->connected = false;
-        return false;
-    } else if (sent == 0) {
-        // 连接已关闭
-        ctx->connected = false;
-        return false;
+    int rc = connect(fd, (struct sockaddr*)&ctx->remote_addr, sizeof(ctx->remote_addr));
+    if (rc < 0 && errno != EINPROGRESS) {
+        close(fd);
+        schedule_reconnect(ctx, now_us);
+        return;
     }
     
-    return (size_t)sent == msg_size;
+    peer->fd = fd;
+    peer->id = ctx->next_peer_id++; // 新的连接使用新的编号
+    reset_peer(ctx, peer);
+    peer->connecting = true;
+    ctx->connect_started_us = now_us;
+    if (rc == 0) {
+        finish_connect(ctx, peer);
+    }
 }
 
-// 快捷方法：发送鼠标移动消息
-bool network_send_mouse_move(NetworkContext* ctx, float rel_x, float rel_y, uint8_t buttons) {
-    if (!ctx) return false;
+// 客户端（TCP）：维持连接，连接断开后按退避时间重连；返回距下一次需要调用的毫秒数，-1表示不需要定时调用
+int network_maintain_connection(NetworkContext* ctx) {
+    if (!ctx || ctx->is_server || !ctx->reconnect_enabled) return -1;
     
-    MouseMoveMessage mouse_msg;
-    mouse_msg.type = MSG_MOUSE_MOVE;
-    mouse_msg.rel_x = rel_x;
-    mouse_msg.rel_y = rel_y;
-    mouse_msg.buttons = buttons;
-    mouse_msg.timestamp = get_timestamp_ms();
+    Peer* peer = client_peer(ctx);
+    if (!peer) return -1;
     
-    Message msg;
-    memcpy(&msg, &mouse_msg, sizeof(mouse_msg));
+    uint64_t now_us = network_time_us();
+    uint64_t deadline_us = 0;
     
-    return network_send_message(ctx, &msg, sizeof(mouse_msg));
+    if (peer->connected) {
+        // 链路中断时可能一直收不到RST，收到过服务端心跳后长时间没有数据即视为断开
+        if (peer->heartbeat_seen && now_us - peer->last_seen_us > CLIENT_IDLE_TIMEOUT_US) {
+            peer->connected = false;
+        } else if (peer->heartbeat_seen) {
+            deadline_us = peer->last_seen_us + CLIENT_IDLE_TIMEOUT_US;
+        }
+    } else if (peer->connecting) {
+        // 连接迟迟不完成（对方没有响应）时放弃，按失败重试
+        if (!finish_connect(ctx, peer) && peer->connecting) {
+            if (now_us - ctx->connect_started_us >= CONNECT_TIMEOUT_US) {
+                peer_close(ctx, peer);
+            } else {
+                deadline_us = ctx->connect_started_us + CONNECT_TIMEOUT_US;
+            }
+        }
+    }
+    check_connection(ctx, peer);
+    
+    if (peer->fd < 0 && ctx->reconnect_at_us != 0) {
+        if (now_us >= ctx->reconnect_at_us) {
+            start_reconnect(ctx, peer, now_us);
+        }
+        if (peer->connecting) {
+            deadline_us = ctx->connect_started_us + CONNECT_TIMEOUT_US;
+        } else if (ctx->reconnect_at_us != 0) {
+            deadline_us = ctx->reconnect_at_us;
+        }
+    }
+    
+    if (deadline_us == 0) return -1;
+    if (deadline_us <= now_us) return 0;
+    uint64_t wait_ms = (deadline_us - now_us + 999) / 1000;
+    return wait_ms > INT_MAX ? INT_MAX : (int)wait_ms;
 }
 
-// 接收消息
-bool network_receive_message(NetworkContext* ctx, Message* msg, size_t* msg_size) {
-    if (!ctx || !msg || !msg_size) return false;
+// 服务端：接受所有等待的连接，每个连接是一个独立的对端；已满时拒绝新的连接，已有的连接不受影响
+static bool accept_clients(NetworkContext* ctx) {
+    if (!ctx || !ctx->is_server || ctx->socket_fd < 0) return false;
     
-    if (!ctx->connected) {
-        if (ctx->is_server) {
-            if (!accept_client(ctx) || !ctx->connected) {
-                return false;
+    // UDP没有连接，收到第一个数据报后才有对端
+    if (ctx->transport == NETWORK_TRANSPORT_UDP) return true;
+    
+    for (;;) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+    
+        int client_fd = accept(ctx->socket_fd, (struct sockaddr*)&client_addr, &addr_len);
+        if (client_fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                // 没有新的连接，非错误
+                return true;
             }
-        } else {
             return false;
         }
-    }
     
-    int fd = ctx->is_server ? ctx->client_fd : ctx->socket_fd;
+        // 设置非阻塞模式
+        if (!set_nonblocking(client_fd)) {
+            close(client_fd);
+            continue;
+        }
     
-    // 首先接收消息类型（1字节）
-    uint8_t type;
-    ssize_t received = recv(fd, &type, 1, MSG_PEEK);
+        set_stream_options(client_fd);
+        apply_busy_poll(ctx, client_fd);
     
-    if (received < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            // 没有数据，非错误
-            return false;
+        Peer* peer = peer_create(ctx, client_fd, &client_addr);
+        if (!peer) {
+            close(client_fd);
+            continue;
+        }
+    
+        mark_connected(ctx, peer);
+        notify_event(ctx, peer, NETWORK_EVENT_ACCEPT);
+    }
+}
+
+// UDP服务端：按来源地址查找对端，新的地址创建对端；已满时替换最久没有数据的对端
+static Peer* find_datagram_peer(NetworkContext* ctx, const struct sockaddr_in* from) {
+    Peer* oldest = NULL;
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        Peer* peer = ctx->peers[i];
+        if (!peer) continue;
+        if (peer->addr.sin_addr.s_addr == from->sin_addr.s_addr && peer->addr.sin_port == from->sin_port) {
+            return peer;
+        }
+        if (!oldest || peer->last_seen_us < oldest->last_seen_us) {
+            oldest = peer;
         }
-        ctx->connected = false;
-        return false;
-    } else if (received == 0) {
-        // 连接已关闭
-        ctx->connected = false;
-        return false;
     }
     
-    // 根据消息类型确定消息大小
-    size_t expected_size;
-    switch (type) {
-        case MSG_MOUSE_MOVE:
-            expected_size = sizeof(MouseMoveMessage);
-            break;
-        case MSG_CONNECT:
-            expected_size = sizeof(ConnectMessage);
-            break;
-        case MSG_DISCONNECT:
-            expected_size = sizeof(DisconnectMessage);
-            break;
-        case MSG_HEARTBEAT:
-            expected_size = sizeof(HeartbeatMessage);
-            break;
-        default:
-            // 未知消息类型
-            return false;
+    Peer* peer = peer_create(ctx, -1, from);
+    if (!peer && oldest) {
+        peer_close(ctx, oldest);
+        peer = peer_create(ctx, -1, from);
     }
+    if (!peer) return NULL;
     
-    // 接收完整消息
-    received = recv(fd, msg, expected_size, 0);
+    mark_connected(ctx, peer);
+    notify_event(ctx, peer, NETWORK_EVENT_ACCEPT);
+    return peer;
+}
+
+// UDP：发送一个数据报（一帧关键帧编码），缓冲区满时直接丢弃
+static bool send_datagram(NetworkContext* ctx, Peer* peer, const uint8_t* frame, size_t frame_size) {
+    ssize_t sent;
+    if (peer->fd < 0) {
+        sent = sendto(ctx->socket_fd, frame, frame_size, SEND_FLAGS,
+                      (struct sockaddr*)&peer->addr, sizeof(peer->addr));
+    } else {
+        sent = send(peer->fd, frame, frame_size, SEND_FLAGS);
+    }
     
-    if (received < 0) {
+    if (sent < 0) {
+        // 对端端口不可达等错误不影响后续发送
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            // 没有足够的数据，非错误
-            return false;
+            stat_add(&ctx->stats.would_block, 1);
         }
-        ctx->connected = false;
-        return false;
-    } else if (received == 0) {
-        // 连接已关闭
-        ctx->connected = false;
+        stat_add(&ctx->stats.dropped, 1);
         return false;
     }
     
-    *msg_size = received;
-    
-    // 调用回调函数
-    if (ctx->callback) {
-        ctx->callback(msg, *msg_size, ctx->user_data);
+    stat_add(&ctx->stats.messages_out, 1);
+    stat_add(&ctx->stats.bytes_out, (uint64_t)sent);
+    return (size_t)sent == frame_size;
+}
+
+// 处理心跳：回复对端的请求，用收到的回复更新时钟偏差样本
+static void handle_heartbeat(NetworkContext* ctx, Peer* peer, const HeartbeatMessage* hb, uint64_t receive_us) {
+    if (!hb->is_reply) {
+        if (!ctx->is_server) {
+            peer->heartbeat_seen = true;
+        }
+        Message reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.heartbeat.type = MSG_HEARTBEAT;
+        reply.heartbeat.is_reply = 1;
+        reply.heartbeat.timestamp = hb->timestamp;
+        reply.heartbeat.receive_us = receive_us;
+        reply.heartbeat.transmit_us = network_time_us();
+        send_to_peer(ctx, peer, &reply, sizeof(HeartbeatMessage));
+        return;
     }
     
-    return true;
+    // t0请求发出、t1对端收到、t2对端回复、t3收到回复
+    uint64_t t0 = hb->timestamp, t1 = hb->receive_us, t2 = hb->transmit_us, t3 = receive_us;
+    if (t3 < t0 || t2 < t1 || t3 - t0 < t2 - t1) return;
+    
+    size_t i = peer->clock_sample_next;
+    peer->clock_offsets[i] = ((int64_t)(t1 - t0) + (int64_t)(t2 - t3)) / 2;
+    peer->clock_rtts[i] = (t3 - t0) - (t2 - t1);
+    peer->clock_sample_next = (i + 1) % CLOCK_SAMPLE_COUNT;
+    if (peer->clock_sample_count < CLOCK_SAMPLE_COUNT) {
+        peer->clock_sample_count++;
+    }
 }
 
-// 设置接收回调函数
-void network_set_callback(NetworkContext* ctx, MessageCallback callback, void* user_data) {
-    if (!ctx) return;
+// UDP：接收数据报，丢弃过期或乱序的移动消息；服务端按来源地址区分发送端
+static bool receive_datagram(NetworkContext* ctx, int fd, Peer** from_peer, Message* msg, size_t* msg_size) {
+    uint8_t datagram[WIRE_MAX_FRAME_SIZE];
     
-    ctx->callback = callback;
-    ctx->user_data = user_data;
+    for (;;) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t received = recvfrom(fd, datagram, sizeof(datagram), 0,
+                                    (struct sockaddr*)&from, &from_len);
+        if (received < 0) {
+            // 没有数据（或ICMP错误），非致命
+            return false;
+        }
+    
+        uint64_t receive_us = network_time_us();
+        stat_add(&ctx->stats.bytes_in, (uint64_t)received);
+    
+        Peer* peer = ctx->is_server ? find_datagram_peer(ctx, &from) : client_peer(ctx);
+        if (!peer) continue;
+        peer->last_seen_us = receive_us;
+    
+        // 每个数据报恰好是一个关键帧
+        if (wire_decode(&peer->rx_codec, datagram, (size_t)received, msg, msg_size) != received) {
+            stat_add(&ctx->stats.decode_errors, 1);
+            continue; // 格式错误或截断的数据报
+        }
+    
+        // 心跳由网络层处理，不交给回调
+        if (msg->type == MSG_HEARTBEAT) {
+            handle_heartbeat(ctx, peer, &msg->heartbeat, receive_us);
+            continue;
+        }
+    
+        // 新的连接请求重新开始计算序号
+        if (msg->type == MSG_CONNECT) {
+            peer->motion_seq_valid = false;
+        }
+    
+        // 丢弃比已处理的移动更旧的移动消息
+        if (msg->type == MSG_MOUSE_MOVE) {
+            uint32_t seq = msg->mouse_move.sequence;
+            if (peer->motion_seq_valid && (int32_t)(seq - peer->last_motion_seq) <= 0) {
+                stat_add(&ctx->stats.dropped, 1);
+                continue;
+            }
+            peer->last_motion_seq = seq;
+            peer->motion_seq_valid = true;
+            msg->mouse_move.receive_us = receive_us;
+        }
+    
+        *from_peer = peer;
+        return true;
+    }
 }
 
-// 断开连接
-void network_disconnect(NetworkContext* ctx) {
-    if (!ctx) return;
+// TCP：消息放入发送队列
+// 队列尾部是移动时新的移动直接替换它（消息携带绝对位置，合并不丢失状态）；
+// 队列尾部是滚轮时新的滚动量加到它上面；
+// 队列已满时丢弃最旧的移动为新消息腾出空间，按钮变化等其他消息从不丢弃
+static bool enqueue_message(NetworkContext* ctx, Peer* peer, const Message* msg, size_t msg_size,
+                            uint64_t now_us) {
+    bool is_motion = msg->type == MSG_MOUSE_MOVE;
+    
+    if (msg->type == MSG_SCROLL && peer->tx_queue_count > 0) {
+        Message* tail = &peer->tx_queue[(peer->tx_queue_head + peer->tx_queue_count - 1) % TX_QUEUE_CAPACITY];
+        int64_t dx = (int64_t)tail->scroll.delta_x + msg->scroll.delta_x;
+        int64_t dy = (int64_t)tail->scroll.delta_y + msg->scroll.delta_y;
+        if (tail->type == MSG_SCROLL && dx >= INT32_MIN && dx <= INT32_MAX && dy >= INT32_MIN && dy <= INT32_MAX) {
+            tail->scroll.delta_x = (int32_t)dx;
+            tail->scroll.delta_y = (int32_t)dy;
+            stat_add(&ctx->stats.coalesced, 1);
+            return true;
+        }
+    }
+    
+    if (is_motion && peer->tx_queue_count > 0) {
+        size_t tail_index = (peer->tx_queue_head + peer->tx_queue_count - 1) % TX_QUEUE_CAPACITY;
+        Message* tail = &peer->tx_queue[tail_index];
+        if (tail->type == MSG_MOUSE_MOVE && tail->mouse_move.buttons == msg->mouse_move.buttons) {
+            // 延迟按实际发出的（最新的）位置计算
+            memcpy(tail, msg, msg_size);
+            peer->tx_queue_time[tail_index] = now_us;
+            stat_add(&ctx->stats.coalesced, 1);
+            return true;
+        }
+    }
+    
+    if (peer->tx_queue_count == TX_QUEUE_CAPACITY) {
+        // 查找最旧的移动消息（按钮状态与下一条消息相同，丢弃不影响按钮边沿）
+        size_t victim = TX_QUEUE_CAPACITY;
+        for (size_t i = 0; i + 1 < peer->tx_queue_count; i++) {
+            const Message* m = &peer->tx_queue[(peer->tx_queue_head + i) % TX_QUEUE_CAPACITY];
+            const Message* next = &peer->tx_queue[(peer->tx_queue_head + i + 1) % TX_QUEUE_CAPACITY];
+            if (m->type == MSG_MOUSE_MOVE &&
+                (next->type != MSG_MOUSE_MOVE || next->mouse_move.buttons == m->mouse_move.buttons)) {
+                victim = i;
+                break;
+            }
+        }
+        stat_add(&ctx->stats.dropped, 1);
+        if (victim == TX_QUEUE_CAPACITY) {
+            return false;
+        }
+    
+        // 后面的消息前移一位
+        for (size_t i = victim; i + 1 < peer->tx_queue_count; i++) {
+            size_t to = (peer->tx_queue_head + i) % TX_QUEUE_CAPACITY;
+            size_t from = (peer->tx_queue_head + i + 1) % TX_QUEUE_CAPACITY;
+            peer->tx_queue[to] = peer->tx_queue[from];
+            peer->tx_queue_time[to] = peer->tx_queue_time[from];
+        }
+        peer->tx_queue_count--;
+    }
+    
+    // 只复制该类型的大小，调用者可能传入具体消息结构的指针
+    size_t index = (peer->tx_queue_head + peer->tx_queue_count) % TX_QUEUE_CAPACITY;
+    memcpy(&peer->tx_queue[index], msg, msg_size);
+    peer->tx_queue_time[index] = now_us;
+    peer->tx_queue_count++;
+    return true;
+}
+
+// TCP：把队列中的消息编码进发送缓冲区（只在缓冲区能放下最长一帧时编码，保证编码状态与写出顺序一致）
+static void encode_queued(Peer* peer) {
+    while (peer->tx_queue_count > 0 && TX_BUFFER_SIZE - peer->tx_len >= WIRE_MAX_FRAME_SIZE &&
+           peer->tx_frame_count < TX_FRAME_CAPACITY) {
+        uint8_t frame[WIRE_MAX_FRAME_SIZE];
+        size_t frame_size = wire_encode(&peer->tx_codec, &peer->tx_queue[peer->tx_queue_head], frame, sizeof(frame));
+        uint64_t queued_us = peer->tx_queue_time[peer->tx_queue_head];
+    
+        peer->tx_queue_head = (peer->tx_queue_head + 1) % TX_QUEUE_CAPACITY;
+        peer->tx_queue_count--;
+        if (frame_size == 0) continue;
+    
+        // 记录帧的结束位置，整帧写出后统计发送延迟
+        peer->tx_encoded += frame_size;
+        TxFrame* record = &peer->tx_frames[(peer->tx_frame_head + peer->tx_frame_count) % TX_FRAME_CAPACITY];
+        record->end = peer->tx_encoded;
+        record->queued_us = queued_us;
+        peer->tx_frame_count++;
+    
+        // 复制到环形缓冲区尾部
+        size_t tail = (peer->tx_head + peer->tx_len) % TX_BUFFER_SIZE;
+        size_t first = TX_BUFFER_SIZE - tail;
+        if (first > frame_size) first = frame_size;
+        memcpy(peer->tx_buf + tail, frame, first);
+        memcpy(peer->tx_buf, frame + first, frame_size - first);
+        peer->tx_len += frame_size;
+    }
+}
+
+// 写出若干字节后，统计已完整写出的帧
+static void complete_frames(NetworkContext* ctx, Peer* peer, size_t sent, uint64_t now_us) {
+    peer->tx_written += sent;
+    
+    while (peer->tx_frame_count > 0 && peer->tx_frames[peer->tx_frame_head].end <= peer->tx_written) {
+        const TxFrame* record = &peer->tx_frames[peer->tx_frame_head];
+        histogram_record(&ctx->stats.send_latency, now_us - record->queued_us);
+        stat_add(&ctx->stats.messages_out, 1);
+        peer->tx_frame_head = (peer->tx_frame_head + 1) % TX_FRAME_CAPACITY;
+        peer->tx_frame_count--;
+    }
+}
+
+// 从发送缓冲区移除在now_us写出的字节
+static void consume_output(NetworkContext* ctx, Peer* peer, size_t sent, size_t attempted, uint64_t now_us) {
+    stat_add(&ctx->stats.bytes_out, (uint64_t)sent);
+    if (sent < attempted) {
+        stat_add(&ctx->stats.partial_sends, 1);
+    }
+    complete_frames(ctx, peer, sent, now_us);
+    
+    // 部分写出：剩余字节保留在缓冲区
+    peer->tx_head = (peer->tx_head + sent) % TX_BUFFER_SIZE;
+    peer->tx_len -= sent;
+    if (peer->tx_len == 0) {
+        peer->tx_head = 0;
+    }
+}
+
+// TCP：写出一个对端的发送队列，一次sendmsg写出缓冲区中的所有帧
+static bool flush_peer(NetworkContext* ctx, Peer* peer) {
+    if (peer->connecting && !finish_connect(ctx, peer)) return false;
+    if (!peer->connected || peer->fd < 0) return false;
+    
+    // 由调用者提交写出时只编码，等调用者取出
+    if (ctx->external_output) {
+        encode_queued(peer);
+        return peer->tx_len == 0;
+    }
+    
+    for (;;) {
+        encode_queued(peer);
+        if (peer->tx_len == 0) return true;
+    
+        // 环形缓冲区最多分成两段
+        struct iovec iov[2];
+        int iov_count = 1;
+        size_t first = TX_BUFFER_SIZE - peer->tx_head;
+        if (first >= peer->tx_len) {
+            iov[0].iov_base = peer->tx_buf + peer->tx_head;
+            iov[0].iov_len = peer->tx_len;
+        } else {
+            iov[0].iov_base = peer->tx_buf + peer->tx_head;
+            iov[0].iov_len = first;
+            iov[1].iov_base = peer->tx_buf;
+            iov[1].iov_len = peer->tx_len - first;
+            iov_count = 2;
+        }
+    
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = iov;
+        mh.msg_iovlen = iov_count;
+    
+        ssize_t sent = sendmsg(peer->fd, &mh, SEND_FLAGS);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // 套接字缓冲区已满，剩余数据等可写时再发
+                stat_add(&ctx->stats.would_block, 1);
+                return false;
+            }
+            peer->connected = false;
+            return false;
+        }
+    
+        consume_output(ctx, peer, (size_t)sent, peer->tx_len, network_time_us());
+    }
+}
+
+// 由调用者提交写出
+bool network_set_external_output(NetworkContext* ctx, bool enabled) {
+    if (!ctx || ctx->is_server || ctx->transport != NETWORK_TRANSPORT_TCP) return false;
+    
+    ctx->external_output = enabled;
+    return true;
+}
+
+// 取出待写出的帧
+int network_take_output(NetworkContext* ctx, NetworkSegment* segments, int max_segments) {
+    if (!ctx || !ctx->external_output) return 0;
+    
+    Peer* peer = client_peer(ctx);
+    if (!peer || !peer->connected || peer->fd < 0 || peer->tx_taken > 0) return 0;
+    
+    encode_queued(peer);
+    
+    // 按帧记录分段，第一帧可能已部分写出
+    int count = 0;
+    uint64_t start = peer->tx_written;
+    for (size_t i = 0; i < peer->tx_frame_count && count + 2 <= max_segments; i++) {
+        uint64_t end = peer->tx_frames[(peer->tx_frame_head + i) % TX_FRAME_CAPACITY].end;
+        size_t len = (size_t)(end - start);
+        size_t pos = (peer->tx_head + (size_t)(start - peer->tx_written)) % TX_BUFFER_SIZE;
+        size_t first = TX_BUFFER_SIZE - pos;
+        if (first > len) {
+            first = len;
+        }
+    
+        segments[count].data = peer->tx_buf + pos;
+        segments[count].len = first;
+        count++;
+        if (first < len) {
+            segments[count].data = peer->tx_buf;
+            segments[count].len = len - first;
+            count++;
+        }
+        peer->tx_taken += len;
+        start = end;
+    }
+    return count;
+}
+
+// 调用者提交的写出完成
+void network_complete_output(NetworkContext* ctx, size_t written, int error, uint64_t written_us) {
+    if (!ctx || !ctx->external_output) return;
+    
+    // 重连时发送缓冲区已重置，之前取出的数据已无效
+    Peer* peer = client_peer(ctx);
+    if (!peer || peer->tx_taken == 0) return;
+    
+    size_t taken = peer->tx_taken;
+    peer->tx_taken = 0;
+    if (written > taken) {
+        written = taken;
+    }
+    if (written > 0) {
+        consume_output(ctx, peer, written, taken, written_us);
+    }
+    
+    if (error == -EAGAIN) {
+        stat_add(&ctx->stats.would_block, 1);
+    } else if (error != 0 && error != -ECANCELED) {
+        peer->connected = false;
+    }
+}
+
+// 对端是否有尚未写出的数据
+static bool peer_has_pending_output(const Peer* peer) {
+    return peer->connecting || peer->tx_queue_count > 0 || peer->tx_len > 0;
+}
+
+// 写出发送队列（服务端写出所有对端）
+bool network_flush(NetworkContext* ctx) {
+    if (!ctx || ctx->transport != NETWORK_TRANSPORT_TCP) return true;
+    
+    if (!ctx->is_server) {
+        Peer* peer = client_peer(ctx);
+        return peer && flush_peer(ctx, peer);
+    }
+    
+    bool all_written = true;
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        Peer* peer = ctx->peers[i];
+        if (peer && peer_has_pending_output(peer) && !flush_peer(ctx, peer)) {
+            all_written = false;
+        }
+    }
+    return all_written;
+}
+
+// 是否有尚未写出的数据（等待套接字可写）
+bool network_has_pending_output(NetworkContext* ctx) {
+    if (!ctx || ctx->transport != NETWORK_TRANSPORT_TCP) return false;
+    
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        if (ctx->peers[i] && peer_has_pending_output(ctx->peers[i])) return true;
+    }
+    return false;
+}
+
+// 发送消息给指定对端
+static bool send_to_peer(NetworkContext* ctx, Peer* peer, const Message* msg, size_t msg_size) {
+    // 消息大小必须与类型一致
+    size_t expected_size = message_size_for_type(msg->type);
+    if (expected_size == 0 || msg_size < expected_size) return false;
+    
+    // 未指定序号的移动消息由网络层编号
+    Message stamped;
+    if (msg->type == MSG_MOUSE_MOVE && msg->mouse_move.sequence == 0) {
+        memcpy(&stamped, msg, sizeof(MouseMoveMessage));
+        stamped.mouse_move.sequence = peer->send_seq++;
+        msg = &stamped;
+    }
+    
+    // 客户端记住最新的位置和按钮（断开期间也更新），重连后补发
+    if (!ctx->is_server && msg->type == MSG_MOUSE_MOVE) {
+        peer->last_x = msg->mouse_move.rel_x;
+        peer->last_y = msg->mouse_move.rel_y;
+        peer->buttons = msg->mouse_move.buttons;
+        peer->last_motion_seq = msg->mouse_move.sequence;
+        peer->has_motion = true;
+    }
+    
+    // 服务端的连接回复带上发送端的会话编号和该会话最后收到的移动序号
+    if (ctx->is_server && msg->type == MSG_CONNECT) {
+        memcpy(&stamped, msg, sizeof(ConnectMessage));
+        stamped.connect.session_id = peer->session_id;
+        stamped.connect.last_sequence = peer->last_motion_seq;
+        msg = &stamped;
+    }
+    
+    if (!peer->connected) return false;
+    
+    uint64_t now_us = network_time_us();
+    
+    if (ctx->transport == NETWORK_TRANSPORT_UDP) {
+        // 数据报直接编码发出，缓冲区满时丢弃
+        uint8_t frame[WIRE_MAX_FRAME_SIZE];
+        size_t frame_size = wire_encode(&peer->tx_codec, msg, frame, sizeof(frame));
+        if (frame_size == 0) return false;
+        if (!send_datagram(ctx, peer, frame, frame_size)) return false;
+        histogram_record(&ctx->stats.send_latency, network_time_us() - now_us);
+        return true;
+    }
+    
+    // TCP：放入发送队列后尽量写出；队列满且无法合并时返回false
+    if (!enqueue_message(ctx, peer, msg, expected_size, now_us)) {
+        flush_peer(ctx, peer);
+        return false;
+    }
+    
+    flush_peer(ctx, peer);
+    return peer->connected;
+}
+
+// 消息默认发给谁：回调中为消息或事件的来源，服务端其他时候为当前控制者
+static Peer* target_peer(NetworkContext* ctx) {
+    if (ctx->current) return ctx->current;
+    return ctx->is_server ? ctx->active : client_peer(ctx);
+}
+
+// 发送消息
+bool network_send_message(NetworkContext* ctx, const Message* msg, size_t msg_size) {
+    if (!ctx || !msg || msg_size == 0) return false;
     
     if (ctx->is_server) {
-        if (ctx->client_fd >= 0) {
-            close(ctx->client_fd);
-            ctx->client_fd = -1;
+        accept_clients(ctx);
+    }
+    
+    Peer* peer = target_peer(ctx);
+    if (!peer) return false;
+    
+    return send_to_peer(ctx, peer, msg, msg_size);
+}
+
+// 快捷方法：发送鼠标移动消息
+bool network_send_mouse_move(NetworkContext* ctx, float rel_x, float rel_y, uint8_t buttons) {
+    if (!ctx) return false;
+    
+    MouseMoveMessage mouse_msg;
+    mouse_msg.type = MSG_MOUSE_MOVE;
+    mouse_msg.rel_x = rel_x;
+    mouse_msg.rel_y = rel_y;
+    mouse_msg.buttons = buttons;
+    mouse_msg.sequence = 0; // 由网络层编号
+    mouse_msg.timestamp = network_time_us();
+    mouse_msg.read_delay_us = 0;
+    mouse_msg.queue_delay_us = 0;
+    mouse_msg.receive_us = 0;
+    
+    Message msg;
+    memcpy(&msg, &mouse_msg, sizeof(mouse_msg));
+    
+    return network_send_message(ctx, &msg, sizeof(mouse_msg));
+}
+
+// TCP：从接收缓冲区解析一帧，返回1成功，0数据不足，-1格式错误或连接已断开
+// 心跳在此处理，不返回给调用者
+static int parse_buffered(NetworkContext* ctx, Peer* peer, Message* msg, size_t* msg_size) {
+    for (;;) {
+        if (peer->rx_start == peer->rx_end) return 0;
+    
+        int consumed = wire_decode(&peer->rx_codec, peer->rx_buf + peer->rx_start,
+                                   peer->rx_end - peer->rx_start, msg, msg_size);
+        if (consumed == WIRE_DECODE_NEED_MORE) {
+            return 0;
         }
-        
-        if (ctx->socket_fd >= 0) {
-            close(ctx->socket_fd);
-            ctx->socket_fd = -1;
+        if (consumed < 0 || (msg->type == MSG_CONNECT && msg->connect.version != WIRE_VERSION)) {
+            // 格式错误或版本不匹配，无法继续解析此连接
+            stat_add(&ctx->stats.decode_errors, 1);
+            peer->connected = false;
+            peer->rx_start = 0;
+            peer->rx_end = 0;
+            return -1;
+        }
+    
+        peer->rx_start += (size_t)consumed;
+        if (peer->rx_start == peer->rx_end) {
+            peer->rx_start = 0;
+            peer->rx_end = 0;
+        }
+    
+        if (msg->type == MSG_HEARTBEAT) {
+            handle_heartbeat(ctx, peer, &msg->heartbeat, peer->rx_time_us);
+            if (!peer->connected) return -1;
+            continue;
+        }
+        if (msg->type == MSG_MOUSE_MOVE) {
+            msg->mouse_move.receive_us = peer->rx_time_us;
+        }
+        return 1;
+    }
+}
+
+// TCP：读取一次套接字追加到接收缓冲区，返回读取的字节数，没有数据返回0，连接断开返回-1
+static ssize_t fill_buffer(NetworkContext* ctx, Peer* peer) {
+    if (peer->fd < 0) return -1;
+    
+    // 把未完整的帧移到缓冲区开头，腾出连续空间
+    if (peer->rx_start > 0) {
+        memmove(peer->rx_buf, peer->rx_buf + peer->rx_start, peer->rx_end - peer->rx_start);
+        peer->rx_end -= peer->rx_start;
+        peer->rx_start = 0;
+    }
+    
+    ssize_t received = recv(peer->fd, peer->rx_buf + peer->rx_end, RX_BUFFER_SIZE - peer->rx_end, 0);
+    
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            // 没有数据，非错误
+            return 0;
+        }
+        peer->connected = false;
+        return -1;
+    } else if (received == 0) {
+        // 连接已关闭
+        peer->connected = false;
+        return -1;
+    }
+    
+    peer->rx_end += (size_t)received;
+    peer->rx_time_us = network_time_us();
+    peer->last_seen_us = peer->rx_time_us;
+    stat_add(&ctx->stats.bytes_in, (uint64_t)received);
+    return received;
+}
+
+// 服务端：移动、滚轮和按键消息的控制权仲裁，没有控制权的发送端的消息不分发
+// 控制者按着按钮或空闲不到hold_us时保持控制；优先级策略下更高优先级的发送端可以随时接管
+static bool arbitrate(NetworkContext* ctx, Peer* peer, const Message* msg) {
+    uint64_t now_us = network_time_us();
+    Peer* active = ctx->active;
+    bool is_motion = msg->type == MSG_MOUSE_MOVE;
+    uint8_t buttons = is_motion ? msg->mouse_move.buttons : peer->buttons;
+    
+    if (active && active != peer) {
+        bool active_idle = active->buttons == 0 && now_us - active->last_active_us >= ctx->hold_us;
+        bool preempt = ctx->arbitration == NETWORK_ARBITRATION_PRIORITY && peer->priority > active->priority;
+        if (!active_idle && !preempt) {
+            peer->buttons = buttons;
+            stat_add(&ctx->stats.arbitration_dropped, 1);
+            return false;
+        }
+    
+        // 被接管的控制者如果还按着按钮，先释放
+        release_buttons(ctx, active);
+    }
+    if (active != peer) {
+        // 另一个发送端取得控制权，不再等待断开的控制者恢复
+        drop_detached(ctx);
+        ctx->active = peer;
+        stat_add(&ctx->stats.control_switches, 1);
+    }
+    
+    peer->buttons = buttons;
+    peer->last_active_us = now_us;
+    if (is_motion) {
+        peer->last_x = msg->mouse_move.rel_x;
+        peer->last_y = msg->mouse_move.rel_y;
+        peer->last_motion_seq = msg->mouse_move.sequence;
+    }
+    return true;
+}
+
+// 服务端：发送端在连接消息中带上会话编号。同一会话的旧连接（半开）由新连接接替；
+// 断开不久的控制者重连时恢复控制权、按钮和位置，按着的按钮不会被释放
+static void resume_session(NetworkContext* ctx, Peer* peer, uint64_t session_id) {
+    peer->session_id = session_id;
+    if (session_id == 0) return;
+    
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        Peer* old = ctx->peers[i];
+        if (!old || old == peer || old->session_id != session_id) continue;
+    
+        peer->buttons = old->buttons;
+        peer->last_x = old->last_x;
+        peer->last_y = old->last_y;
+        peer->last_motion_seq = old->last_motion_seq;
+        peer->last_active_us = old->last_active_us;
+        if (ctx->active == old) {
+            ctx->active = peer;
+        }
+        old->session_id = 0;
+        old->buttons = 0;
+        peer_close(ctx, old);
+    }
+    
+    DetachedSession* session = &ctx->detached;
+    if (session->session_id == session_id && !ctx->active) {
+        peer->buttons = session->buttons;
+        peer->last_x = session->last_x;
+        peer->last_y = session->last_y;
+        peer->last_motion_seq = session->last_motion_seq;
+        peer->last_active_us = network_time_us();
+        session->session_id = 0;
+        ctx->active = peer;
+    }
+}
+
+// 把收到的消息交给回调函数，统计对端发出到分发的延迟；被仲裁丢弃时返回false
+static bool dispatch_message(NetworkContext* ctx, Peer* peer, const Message* msg, size_t msg_size) {
+    bool needs_control = msg->type == MSG_MOUSE_MOVE || msg->type == MSG_SCROLL || msg->type == MSG_KEY;
+    if (ctx->is_server && needs_control && !arbitrate(ctx, peer, msg)) {
+        return false;
+    }
+    
+    // 发送端主动断开：UDP没有连接状态，靠此消息及时释放对端和它按着的按钮
+    if (ctx->is_server && msg->type == MSG_DISCONNECT) {
+        peer->session_id = 0;
+        peer->connected = false;
+        if (ctx->transport == NETWORK_TRANSPORT_UDP) {
+            peer_close(ctx, peer);
+        }
+        return false;
+    }
+    
+    if (ctx->is_server && msg->type == MSG_CONNECT) {
+        resume_session(ctx, peer, msg->connect.session_id);
+    }
+    
+    stat_add(&ctx->stats.messages_in, 1);
+    
+    // 回调中发送的消息（如连接回复）发给消息的来源
+    Peer* previous = ctx->current;
+    ctx->current = peer;
+    
+    // 对端的时间换算到本地时钟需要时钟偏差估计
+    int64_t offset;
+    if (msg->type == MSG_MOUSE_MOVE && msg->mouse_move.timestamp != 0 &&
+        network_get_clock_offset(ctx, &offset, NULL)) {
+        const MouseMoveMessage* mm = &msg->mouse_move;
+        int64_t sent_local = (int64_t)(mm->timestamp + mm->read_delay_us + mm->queue_delay_us) - offset;
+        int64_t latency = (int64_t)network_time_us() - sent_local;
+        histogram_record(&ctx->stats.dispatch_latency, latency > 0 ? (uint64_t)latency : 0);
+    }
+    
+    if (ctx->callback) {
+        ctx->callback(msg, msg_size, ctx->user_data);
+    }
+    
+    ctx->current = previous;
+    return true;
+}
+
+// TCP：连接已断开时关闭；关闭后的套接字一直可读，不关闭会使事件循环空转
+static void check_connection(NetworkContext* ctx, Peer* peer) {
+    if (ctx->transport == NETWORK_TRANSPORT_TCP && !peer->connected && !peer->connecting && peer->fd >= 0) {
+        peer_close(ctx, peer);
+    }
+}
+
+// TCP：读取一次对端的套接字并分发所有完整的消息，返回分发的消息数（调用后peer可能已释放）
+static size_t process_stream(NetworkContext* ctx, Peer* peer) {
+    Message msg;
+    size_t msg_size;
+    size_t count = 0;
+    
+    // 一次recv读取所有可读数据，再逐帧解析；之前残留的完整帧先处理
+    bool filled = false;
+    while (peer->connected) {
+        int rc = parse_buffered(ctx, peer, &msg, &msg_size);
+        if (rc < 0) break;
+        if (rc == 0) {
+            if (filled || fill_buffer(ctx, peer) <= 0) break;
+            filled = true;
+            continue;
+        }
+    
+        if (dispatch_message(ctx, peer, &msg, msg_size)) {
+            count++;
+        }
+    }
+    
+    check_connection(ctx, peer);
+    return count;
+}
+
+// UDP：读取所有到达的数据报并分发，返回分发的消息数
+static size_t process_datagrams(NetworkContext* ctx, int fd) {
+    Message msg;
+    size_t msg_size;
+    size_t count = 0;
+    Peer* peer;
+    
+    // 每个数据报一次recvfrom，直到没有数据
+    while (fd >= 0 && receive_datagram(ctx, fd, &peer, &msg, &msg_size)) {
+        if (dispatch_message(ctx, peer, &msg, msg_size)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// UDP：接收数据报的套接字
+static int datagram_fd(NetworkContext* ctx) {
+    if (ctx->is_server) return ctx->socket_fd;
+    
+    Peer* peer = client_peer(ctx);
+    return peer ? peer->fd : -1;
+}
+
+// 接收消息
+bool network_receive_message(NetworkContext* ctx, Message* msg, size_t* msg_size) {
+    if (!ctx || !msg || !msg_size) return false;
+    
+    if (ctx->transport == NETWORK_TRANSPORT_UDP) {
+        int fd = datagram_fd(ctx);
+        Peer* peer;
+        while (fd >= 0 && receive_datagram(ctx, fd, &peer, msg, msg_size)) {
+            // 调用回调函数
+            if (dispatch_message(ctx, peer, msg, *msg_size)) return true;
+        }
+        return false;
+    }
+    
+    if (ctx->is_server) {
+        accept_clients(ctx);
+    }
+    
+    // 依次检查每个对端：先解析缓冲区中已有的帧，不足一帧时才读取套接字
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        Peer* peer = ctx->peers[i];
+        if (!peer || !peer->connected) continue;
+    
+        int rc = parse_buffered(ctx, peer, msg, msg_size);
+        if (rc == 0 && fill_buffer(ctx, peer) > 0) {
+            rc = parse_buffered(ctx, peer, msg, msg_size);
+        }
+        if (rc <= 0) {
+            check_connection(ctx, peer);
+            continue;
+        }
+    
+        // 调用回调函数
+        if (dispatch_message(ctx, peer, msg, *msg_size)) return true;
+    }
+    
+    return false;
+}
+
+// 读取一次所有连接并分发所有完整的消息，返回分发的消息数
+size_t network_process_messages(NetworkContext* ctx) {
+    if (!ctx) return 0;
+    
+    if (ctx->transport == NETWORK_TRANSPORT_UDP) {
+        return process_datagrams(ctx, datagram_fd(ctx));
+    }
+    
+    if (ctx->is_server) {
+        accept_clients(ctx);
+    }
+    
+    size_t count = 0;
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        Peer* peer = ctx->peers[i];
+        if (peer && peer->fd >= 0) {
+            count += process_stream(ctx, peer);
+        }
+    }
+    return count;
+}
+
+// 发送心跳请求，对端的回复用于估计时钟偏差；服务端发给所有发送端，并移除长时间没有数据的UDP发送端
+bool network_send_heartbeat(NetworkContext* ctx) {
+    if (!ctx) return false;
+    
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.heartbeat.type = MSG_HEARTBEAT;
+    msg.heartbeat.is_reply = 0;
+    msg.heartbeat.timestamp = network_time_us();
+    
+    if (!ctx->is_server) {
+        Peer* peer = client_peer(ctx);
+        return peer && send_to_peer(ctx, peer, &msg, sizeof(HeartbeatMessage));
+    }
+    
+    // 断开的控制者没有及时重连，释放它按着的按钮
+    if (ctx->detached.session_id != 0 &&
+        msg.heartbeat.timestamp - ctx->detached.detached_us > (uint64_t)NETWORK_SESSION_GRACE_MS * 1000) {
+        drop_detached(ctx);
+    }
+    
+    bool sent = false;
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        Peer* peer = ctx->peers[i];
+        if (!peer) continue;
+    
+        if (ctx->transport == NETWORK_TRANSPORT_UDP &&
+            msg.heartbeat.timestamp - peer->last_seen_us > UDP_PEER_TIMEOUT_US) {
+            peer_close(ctx, peer);
+            continue;
+        }
+        if (send_to_peer(ctx, peer, &msg, sizeof(HeartbeatMessage))) {
+            sent = true;
+        }
+        check_connection(ctx, peer);
+    }
+    return sent;
+}
+
+// 读取时钟偏差估计（对端时钟减本地时钟），取最近样本中往返时间最短的一个
+bool network_get_clock_offset(NetworkContext* ctx, int64_t* offset_us, uint64_t* rtt_us) {
+    if (!ctx) return false;
+    
+    Peer* peer = target_peer(ctx);
+    if (!peer || peer->clock_sample_count == 0) return false;
+    
+    size_t best = 0;
+    for (size_t i = 1; i < peer->clock_sample_count; i++) {
+        if (peer->clock_rtts[i] < peer->clock_rtts[best]) {
+            best = i;
+        }
+    }
+    
+    if (offset_us) *offset_us = peer->clock_offsets[best];
+    if (rtt_us) *rtt_us = peer->clock_rtts[best];
+    return true;
+}
+
+// 读取一个直方图的百分位数
+static void read_latency(Histogram* hist, NetworkLatencyStats* out) {
+    out->count = histogram_count(hist);
+    out->p50_us = histogram_percentile(hist, 50.0);
+    out->p99_us = histogram_percentile(hist, 99.0);
+    out->p999_us = histogram_percentile(hist, 99.9);
+    out->max_us = histogram_max(hist);
+}
+
+// 读取统计（可在其他线程调用）
+bool network_get_stats(NetworkContext* ctx, NetworkStats* stats) {
+    if (!ctx || !stats) return false;
+    
+    stats->messages_out = stat_load(&ctx->stats.messages_out);
+    stats->bytes_out = stat_load(&ctx->stats.bytes_out);
+    stats->messages_in = stat_load(&ctx->stats.messages_in);
+    stats->bytes_in = stat_load(&ctx->stats.bytes_in);
+    stats->would_block = stat_load(&ctx->stats.would_block);
+    stats->partial_sends = stat_load(&ctx->stats.partial_sends);
+    stats->coalesced = stat_load(&ctx->stats.coalesced);
+    stats->dropped = stat_load(&ctx->stats.dropped);
+    stats->reconnects = stat_load(&ctx->stats.reconnects);
+    stats->decode_errors = stat_load(&ctx->stats.decode_errors);
+    stats->arbitration_dropped = stat_load(&ctx->stats.arbitration_dropped);
+    stats->control_switches = stat_load(&ctx->stats.control_switches);
+    read_latency(&ctx->stats.send_latency, &stats->send_latency);
+    read_latency(&ctx->stats.dispatch_latency, &stats->dispatch_latency);
+    return true;
+}
+
+// 设置SO_BUSY_POLL，立即应用到现有的套接字
+bool network_set_busy_poll(NetworkContext* ctx, unsigned int busy_poll_us) {
+    if (!ctx) return false;
+    
+    ctx->busy_poll_us = busy_poll_us;
+    if (busy_poll_us == 0) return true;
+    
+    bool ok = ctx->socket_fd < 0 || apply_busy_poll(ctx, ctx->socket_fd);
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        if (ctx->peers[i] && ctx->peers[i]->fd >= 0 && ctx->peers[i]->fd != ctx->socket_fd &&
+            !apply_busy_poll(ctx, ctx->peers[i]->fd)) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// 当前连接的套接字描述符
+int network_get_fd(NetworkContext* ctx) {
+    if (!ctx) return -1;
+    
+    if (ctx->is_server && ctx->transport == NETWORK_TRANSPORT_UDP) {
+        return ctx->socket_fd;
+    }
+    Peer* peer = target_peer(ctx);
+    return peer ? peer->fd : -1;
+}
+
+// 客户端：当前连接的编号
+uint32_t network_get_connection_id(NetworkContext* ctx) {
+    Peer* peer = ctx ? client_peer(ctx) : NULL;
+    return peer && peer->fd >= 0 ? peer->id : 0;
+}
+
+// 服务端监听套接字描述符
+int network_get_listen_fd(NetworkContext* ctx) {
+    if (!ctx || !ctx->is_server || ctx->transport != NETWORK_TRANSPORT_TCP) return -1;
+    
+    return ctx->socket_fd;
+}
+
+// 设置控制权仲裁策略
+void network_set_arbitration(NetworkContext* ctx, NetworkArbitration policy, unsigned int hold_ms) {
+    if (!ctx) return;
+    
+    ctx->arbitration = policy;
+    ctx->hold_us = (uint64_t)hold_ms * 1000;
+}
+
+// 按地址设置发送端的优先级，对已连接的发送端立即生效
+bool network_set_peer_priority(NetworkContext* ctx, const char* address, int priority) {
+    if (!ctx || !address) return false;
+    
+    struct in_addr addr;
+    if (inet_pton(AF_INET, address, &addr) <= 0) return false;
+    
+    size_t i = 0;
+    while (i < ctx->priority_rule_count && ctx->priority_rules[i].addr.s_addr != addr.s_addr) {
+        i++;
+    }
+    if (i == MAX_PRIORITY_RULES) return false;
+    if (i == ctx->priority_rule_count) {
+        ctx->priority_rule_count++;
+    }
+    ctx->priority_rules[i].addr = addr;
+    ctx->priority_rules[i].priority = priority;
+    
+    for (int p = 0; p < NETWORK_MAX_PEERS; p++) {
+        if (ctx->peers[p] && ctx->peers[p]->addr.sin_addr.s_addr == addr.s_addr) {
+            ctx->peers[p]->priority = priority;
+        }
+    }
+    return true;
+}
+
+// 已连接的对端数
+size_t network_get_peer_count(NetworkContext* ctx) {
+    if (!ctx) return 0;
+    
+    size_t count = 0;
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        if (ctx->peers[i] && ctx->peers[i]->connected) count++;
+    }
+    return count;
+}
+
+// 当前对端的编号和地址
+bool network_get_current_peer(NetworkContext* ctx, NetworkPeerInfo* info) {
+    if (!ctx || !info) return false;
+    
+    Peer* peer = target_peer(ctx);
+    if (!peer) return false;
+    
+    info->id = peer->id;
+    inet_ntop(AF_INET, &peer->addr.sin_addr, info->address, sizeof(info->address));
+    info->port = ntohs(peer->addr.sin_port);
+    info->priority = peer->priority;
+    info->active = ctx->is_server ? ctx->active == peer : peer->connected;
+    return true;
+}
+
+// 创建事件循环
+static bool ensure_poll(NetworkContext* ctx) {
+    if (ctx->poll_fd >= 0) return true;
+    
+#ifdef __linux__
+    ctx->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    ctx->poll_fd = kqueue();
+    if (ctx->poll_fd >= 0) {
+        fcntl(ctx->poll_fd, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    return ctx->poll_fd >= 0;
+}
+
+// 让事件循环的注册与当前的套接字一致：接受新连接、断开或有积压数据后调用
+static bool sync_poll(NetworkContext* ctx) {
+    if (!ensure_poll(ctx)) return false;
+    
+    if (ctx->socket_fd != ctx->poll_server_fd) {
+        if (ctx->poll_server_fd >= 0) {
+            poll_unregister(ctx, ctx->poll_server_fd, false);
+            ctx->poll_server_fd = -1;
         }
-    } else {
         if (ctx->socket_fd >= 0) {
-            close(ctx->socket_fd);
-            ctx->socket_fd = -1;
+            if (!poll_register(ctx, ctx->socket_fd, POLL_TAG_SERVER, false, false, false)) return false;
+            ctx->poll_server_fd = ctx->socket_fd;
+        }
+    }
+    
+    // 有积压的发送数据时才关注可写，否则套接字一直可写会使循环空转
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        Peer* peer = ctx->peers[i];
+        if (!peer || peer->fd < 0) continue;
+    
+        bool want_write = ctx->transport == NETWORK_TRANSPORT_TCP && peer_has_pending_output(peer);
+        if (peer->poll_registered && want_write == peer->poll_write) continue;
+    
+        if (!poll_register(ctx, peer->fd, POLL_TAG_PEER + (uintptr_t)i, want_write,
+                           peer->poll_registered, peer->poll_write)) {
+            return false;
+        }
+        peer->poll_registered = true;
+        peer->poll_write = want_write;
+    }
+    
+    return true;
+}
+
+// 等待就绪事件，返回事件数，超时返回0，被信号打断返回0，出错返回-1
+static int poll_wait(NetworkContext* ctx, PollEvent* events, int max_events, int timeout_ms) {
+#ifdef __linux__
+    struct epoll_event ready[POLL_BATCH_SIZE];
+    int count = epoll_wait(ctx->poll_fd, ready, max_events < POLL_BATCH_SIZE ? max_events : POLL_BATCH_SIZE,
+                           timeout_ms);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        events[i].tag = (uintptr_t)ready[i].data.u64;
+        events[i].readable = (ready[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0;
+        events[i].writable = (ready[i].events & EPOLLOUT) != 0;
+    }
+    return count;
+#else
+    struct kevent ready[POLL_BATCH_SIZE];
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+    int count = kevent(ctx->poll_fd, NULL, 0, ready,
+                       max_events < POLL_BATCH_SIZE ? max_events : POLL_BATCH_SIZE,
+                       timeout_ms < 0 ? NULL : &timeout);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    
+    // 每个过滤器单独报告，同一描述符的可读和可写是两个事件
+    for (int i = 0; i < count; i++) {
+        events[i].tag = (uintptr_t)ready[i].udata;
+        events[i].readable = ready[i].filter == EVFILT_READ;
+        events[i].writable = ready[i].filter == EVFILT_WRITE;
+    }
+    return count;
+#endif
+}
+
+// 事件循环的描述符，任一事件就绪时可读
+int network_get_poll_fd(NetworkContext* ctx) {
+    if (!ctx || !sync_poll(ctx)) return -1;
+    
+    return ctx->poll_fd;
+}
+
+// 设置连接事件回调函数
+void network_set_event_callback(NetworkContext* ctx, NetworkEventCallback callback, void* user_data) {
+    if (!ctx) return;
+    
+    ctx->event_callback = callback;
+    ctx->event_user_data = user_data;
+}
+
+// 关注外部描述符
+bool network_watch_fd(NetworkContext* ctx, int fd, NetworkFdCallback callback, void* user_data) {
+    if (!ctx || fd < 0 || !callback || !ensure_poll(ctx)) return false;
+    
+    for (int i = 0; i < NETWORK_MAX_WATCHES; i++) {
+        if (ctx->watches[i].fd >= 0) continue;
+    
+        if (!poll_register(ctx, fd, POLL_TAG_WATCH + (uintptr_t)i, false, false, false)) {
+            return false;
+        }
+        ctx->watches[i].fd = fd;
+        ctx->watches[i].callback = callback;
+        ctx->watches[i].user_data = user_data;
+        return true;
+    }
+    return false;
+}
+
+// 取消关注外部描述符
+void network_unwatch_fd(NetworkContext* ctx, int fd) {
+    if (!ctx || fd < 0 || ctx->poll_fd < 0) return;
+    
+    for (int i = 0; i < NETWORK_MAX_WATCHES; i++) {
+        if (ctx->watches[i].fd != fd) continue;
+    
+        poll_unregister(ctx, fd, false);
+        ctx->watches[i].fd = -1;
+        return;
+    }
+}
+
+// 处理一个对端连接的就绪事件
+static size_t handle_peer_event(NetworkContext* ctx, int slot, const PollEvent* ev) {
+    // 同一批中先前的事件可能已经关闭了连接
+    Peer* peer = ctx->peers[slot];
+    if (!peer || peer->fd < 0) return 0;
+    
+    size_t dispatched = 0;
+    if (ev->readable) {
+        if (ctx->transport == NETWORK_TRANSPORT_UDP) {
+            return process_datagrams(ctx, peer->fd);
+        }
+        dispatched = process_stream(ctx, peer);
+    
+        // 读取时可能断开并释放了对端
+        if (ctx->peers[slot] != peer || peer->fd < 0) return dispatched;
+    }
+    if (ev->writable) {
+        if (flush_peer(ctx, peer)) {
+            notify_event(ctx, peer, NETWORK_EVENT_WRITABLE);
+        }
+        check_connection(ctx, peer);
+    }
+    return dispatched;
+}
+
+// 等待并处理一轮事件
+int network_poll(NetworkContext* ctx, int timeout_ms) {
+    if (!ctx || !sync_poll(ctx)) return -1;
+    
+    PollEvent events[POLL_BATCH_SIZE];
+    int ready = poll_wait(ctx, events, POLL_BATCH_SIZE, timeout_ms);
+    if (ready < 0) return -1;
+    if (ready == 0 && timeout_ms >= 0) {
+        notify_event(ctx, NULL, NETWORK_EVENT_TIMEOUT);
+    }
+    
+    size_t dispatched = 0;
+    for (int i = 0; i < ready; i++) {
+        uintptr_t tag = events[i].tag;
+    
+        if (tag == POLL_TAG_SERVER) {
+            // TCP：有新连接时立即接受，而不是等到下次收发；UDP：所有发送端的数据报
+            if (ctx->transport == NETWORK_TRANSPORT_UDP) {
+                dispatched += process_datagrams(ctx, ctx->socket_fd);
+            } else {
+                accept_clients(ctx);
+            }
+        } else if (tag >= POLL_TAG_WATCH && tag < POLL_TAG_PEER) {
+            PollWatch* watch = &ctx->watches[tag - POLL_TAG_WATCH];
+            if (watch->fd >= 0) {
+                watch->callback(watch->fd, watch->user_data);
+            }
+        } else if (tag < POLL_TAG_PEER + NETWORK_MAX_PEERS) {
+            dispatched += handle_peer_event(ctx, (int)(tag - POLL_TAG_PEER), &events[i]);
         }
     }
     
-    ctx->connected = false;
-} 
\ No newline at end of file
+    // 回调中可能发送了消息或断开了连接
+    if (!sync_poll(ctx)) return -1;
+    return (int)dispatched;
+}
+
+// 循环处理事件
+bool network_run(NetworkContext* ctx, int timeout_ms, volatile sig_atomic_t* running) {
+    if (!ctx) return false;
+    
+    while (!running || *running) {
+        if (network_poll(ctx, timeout_ms) < 0) return false;
+    }
+    return true;
+}
+
+// 设置接收回调函数
+void network_set_callback(NetworkContext* ctx, MessageCallback callback, void* user_data) {
+    if (!ctx) return;
+    
+    ctx->callback = callback;
+    ctx->user_data = user_data;
+}
+
+// 断开连接（服务端断开所有发送端并停止监听）
+void network_disconnect(NetworkContext* ctx) {
+    if (!ctx) return;
+    
+    // 主动断开不再重连；客户端通知服务端，服务端立即释放这个发送端
+    ctx->reconnect_enabled = false;
+    ctx->reconnect_at_us = 0;
+    Peer* peer = client_peer(ctx);
+    if (peer && peer->connected) {
+        Message msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.disconnect.type = MSG_DISCONNECT;
+        send_to_peer(ctx, peer, &msg, sizeof(DisconnectMessage));
+    }
+    
+    for (int i = 0; i < NETWORK_MAX_PEERS; i++) {
+        if (ctx->peers[i]) {
+            peer_close(ctx, ctx->peers[i]);
+        }
+    }
+    close_server_socket(ctx);
+    
+    ctx->current = NULL;
+    ctx->active = NULL;
+    drop_detached(ctx);
+}
@@ -0,0 +1,182 @@
+#include "predictor.h"
+#include <string.h>
+
+// 样本停止到达多久后认为鼠标已停下：平均间隔的两倍再加上这个余量
+#define STALE_MARGIN_US 2000
+
+// 限制在屏幕范围内
+static float clamp_unit(float value) {
+    if (value < 0.0f) return 0.0f;
+    if (value > 1.0f) return 1.0f;
+    return value;
+}
+
+// 第age新的样本（0为最新）
+static const PredictorSample* sample_at(const MotionPredictor* pred, size_t age) {
+    return &pred->samples[(pred->head + PREDICTOR_HISTORY - age) % PREDICTOR_HISTORY];
+}
+
+// 用窗口内最早和最新的样本估计速度
+static void estimate_velocity(MotionPredictor* pred) {
+    pred->vx = 0.0f;
+    pred->vy = 0.0f;
+    if (pred->count < 2) return;
+
+    const PredictorSample* newest = sample_at(pred, 0);
+    const PredictorSample* oldest = NULL;
+    for (size_t age = 1; age < pred->count; age++) {
+        const PredictorSample* sample = sample_at(pred, age);
+        if (newest->sample_us - sample->sample_us > PREDICTOR_WINDOW_US) break;
+        oldest = sample;
+    }
+    if (!oldest) return;
+
+    float dt = (float)(newest->sample_us - oldest->sample_us);
+    pred->vx = (newest->x - oldest->x) / dt;
+    pred->vy = (newest->y - oldest->y) / dt;
+}
+
+// 初始化，horizon_us为0时关闭预测
+void predictor_init(MotionPredictor* pred, uint32_t horizon_us) {
+    if (!pred) return;
+
+    memset(pred, 0, sizeof(MotionPredictor));
+    pred->horizon_us = horizon_us;
+}
+
+// 是否开启了预测
+bool predictor_enabled(const MotionPredictor* pred) {
+    return pred && pred->horizon_us > 0;
+}
+
+// 不带修正量的预测位置；返回是否在外推（allow为false时不外推，只取最后的真实位置）
+static bool predict_target(const MotionPredictor* pred, uint64_t now_us, bool allow, float* x, float* y) {
+    const PredictorSample* newest = sample_at(pred, 0);
+    *x = newest->x;
+    *y = newest->y;
+
+    // 移动中、样本还在到达且不在按钮变化附近时，从最后一个样本沿估计的速度外推
+    bool moving = pred->count >= 2 && (pred->vx != 0.0f || pred->vy != 0.0f);
+    bool stale = now_us - pred->last_arrival_us > pred->interval_us * 2 + STALE_MARGIN_US;
+    if (!allow || !moving || stale || now_us < pred->guard_until_us) return false;
+
+    uint64_t lead = now_us > newest->local_us ? now_us - newest->local_us : 0;
+    if (lead > pred->horizon_us) {
+        lead = pred->horizon_us;
+    }
+    *x = clamp_unit(*x + pred->vx * (float)lead);
+    *y = clamp_unit(*y + pred->vy * (float)lead);
+    return true;
+}
+
+// 修正量按经过的时间衰减：剩余 SMOOTH/(SMOOTH+dt)，相当于一阶低通
+static void decay_correction(MotionPredictor* pred, uint64_t now_us) {
+    float dt = (float)(now_us > pred->correction_us ? now_us - pred->correction_us : 0);
+    float keep = (float)PREDICTOR_SMOOTH_US / ((float)PREDICTOR_SMOOTH_US + dt);
+    pred->correction_x *= keep;
+    pred->correction_y *= keep;
+    pred->correction_us = now_us;
+}
+
+// 清空历史并立即显示给定位置；guard为true时（按钮变化）一段时间内不外推
+void predictor_reset(MotionPredictor* pred, float x, float y, uint64_t now_us, bool guard) {
+    if (!pred) return;
+
+    pred->count = 0;
+    pred->vx = 0.0f;
+    pred->vy = 0.0f;
+    pred->last_arrival_us = 0;
+    pred->correction_x = 0.0f;
+    pred->correction_y = 0.0f;
+    pred->correction_us = now_us;
+    pred->extrapolating = false;
+    pred->has_position = true;
+    if (guard) {
+        pred->guard_until_us = now_us + PREDICTOR_BUTTON_GUARD_US;
+    }
+
+    // 保留位置作为下一次移动的起点
+    pred->head = 0;
+    pred->samples[0].x = x;
+    pred->samples[0].y = y;
+    pred->samples[0].sample_us = 0;
+    pred->samples[0].local_us = now_us;
+}
+
+// 加入一个移动样本
+void predictor_add_sample(MotionPredictor* pred, float x, float y, uint64_t sample_us, uint64_t local_us,
+                          uint64_t now_us) {
+    if (!pred) return;
+
+    if (pred->count > 0) {
+        const PredictorSample* newest = sample_at(pred, 0);
+        // UDP可能乱序，旧样本不参与估计
+        if (sample_us <= newest->sample_us) return;
+        // 间隔太长是一次新的移动，之前的速度不再有效
+        if (sample_us - newest->sample_us > PREDICTOR_WINDOW_US) {
+            pred->count = 0;
+        }
+    }
+
+    // 加入前后预测位置的差作为修正量，显示的位置不跳变
+    float before_x = x, before_y = y;
+    if (pred->has_position) {
+        decay_correction(pred, now_us);
+        predict_target(pred, now_us, pred->extrapolating, &before_x, &before_y);
+    } else {
+        pred->correction_us = now_us;
+        pred->has_position = true;
+    }
+
+    // 连续移动中样本到达的平均间隔，用于判断鼠标是否已停下
+    if (pred->count > 0 && pred->last_arrival_us > 0 && now_us > pred->last_arrival_us) {
+        uint64_t gap = now_us - pred->last_arrival_us;
+        pred->interval_us = pred->interval_us ? (pred->interval_us * 7 + gap) / 8 : gap;
+    }
+    pred->last_arrival_us = now_us;
+
+    pred->head = (pred->head + 1) % PREDICTOR_HISTORY;
+    PredictorSample* sample = &pred->samples[pred->head];
+    sample->x = x;
+    sample->y = y;
+    sample->sample_us = sample_us;
+    sample->local_us = local_us;
+    if (pred->count < PREDICTOR_HISTORY) {
+        pred->count++;
+    }
+    estimate_velocity(pred);
+
+    float after_x, after_y;
+    pred->extrapolating = predict_target(pred, now_us, true, &after_x, &after_y);
+    pred->correction_x += before_x - after_x;
+    pred->correction_y += before_y - after_y;
+}
+
+// 推进到now_us并取出应显示的位置；返回位置是否还会继续变化
+bool predictor_update(MotionPredictor* pred, uint64_t now_us, float* x, float* y) {
+    if (!pred || !pred->has_position) return false;
+
+    decay_correction(pred, now_us);
+
+    // 外推开始或结束（鼠标停下、按钮保护结束）时预测位置也会跳变，同样转为修正量
+    float target_x, target_y;
+    bool extrapolating = predict_target(pred, now_us, true, &target_x, &target_y);
+    if (extrapolating != pred->extrapolating) {
+        float before_x, before_y;
+        predict_target(pred, now_us, pred->extrapolating, &before_x, &before_y);
+        pred->correction_x += before_x - target_x;
+        pred->correction_y += before_y - target_y;
+        pred->extrapolating = extrapolating;
+    }
+
+    // 修正量小于屏幕的十万分之一时视为已完成
+    bool settled = pred->correction_x * pred->correction_x + pred->correction_y * pred->correction_y < 1e-10f;
+    if (settled) {
+        pred->correction_x = 0.0f;
+        pred->correction_y = 0.0f;
+    }
+
+    *x = clamp_unit(target_x + pred->correction_x);
+    *y = clamp_unit(target_y + pred->correction_y);
+    return extrapolating || !settled;
+}
@@ -0,0 +1,71 @@
+#ifndef MOUSE_PREDICTOR_H
+#define MOUSE_PREDICTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * 接收端的移动预测（航位推算）
+ *
+ * 用最近的移动样本估计速度，把光标从最后一个样本外推最多horizon_us，抵消网络延迟。
+ * 新样本到达时预测的位置会跳变，跳变的量作为修正量叠加在新的预测上，
+ * 以PREDICTOR_SMOOTH_US为时间常数衰减到0，预测误差在几毫秒内平滑修正而匀速移动没有滞后。
+ * 样本停止到达时认为鼠标已停下，同样平滑地回到最后的真实位置。
+ * 按钮变化时清空历史，并在PREDICTOR_BUTTON_GUARD_US内不外推，点击落在真实位置上。
+ * 所有时间都是微秒；样本时间用于估计速度，可以是发送端的时钟，其余为接收端的单调时钟。
+ */
+
+// 保留的样本数
+#define PREDICTOR_HISTORY 8
+
+// 只用最近这么长时间内的样本估计速度，间隔更长的样本视为一次新的移动
+#define PREDICTOR_WINDOW_US 50000
+
+// 修正量衰减的时间常数
+#define PREDICTOR_SMOOTH_US 8000
+
+// 按钮变化前后不外推的时间
+#define PREDICTOR_BUTTON_GUARD_US 100000
+
+// 一个移动样本
+typedef struct {
+    float x, y;                // 相对位置（0.0-1.0）
+    uint64_t sample_us;        // 采集时间（估计速度用）
+    uint64_t local_us;         // 采集时间换算到本地时钟（外推起点）
+} PredictorSample;
+
+typedef struct {
+    uint32_t horizon_us;       // 最多外推多远，0表示关闭预测
+    PredictorSample samples[PREDICTOR_HISTORY]; // 最近的样本，环形存放
+    size_t head;               // 最新样本的下标
+    size_t count;              // 样本数
+    float vx, vy;              // 估计的速度（每微秒）
+    uint64_t last_arrival_us;  // 最后一个样本到达的本地时间
+    uint64_t interval_us;      // 样本到达的平均间隔
+    float correction_x;        // 叠加在预测位置上、尚未衰减完的修正量
+    float correction_y;
+    uint64_t correction_us;    // 修正量的更新时间
+    bool extrapolating;        // 上次更新时是否在外推
+    uint64_t guard_until_us;   // 此前不外推
+    bool has_position;         // 是否已有位置
+} MotionPredictor;
+
+// 初始化，horizon_us为0时关闭预测
+void predictor_init(MotionPredictor* pred, uint32_t horizon_us);
+
+// 是否开启了预测
+bool predictor_enabled(const MotionPredictor* pred);
+
+// 清空历史并立即显示给定位置；guard为true时（按钮变化）一段时间内不外推
+void predictor_reset(MotionPredictor* pred, float x, float y, uint64_t now_us, bool guard);
+
+// 加入一个移动样本
+void predictor_add_sample(MotionPredictor* pred, float x, float y, uint64_t sample_us, uint64_t local_us,
+                          uint64_t now_us);
+
+// 推进到now_us并取出应显示的位置；返回位置是否还会继续变化（外推中或修正尚未完成），
+// 为false时可以停止定时更新，直到下一个样本；还没有位置时返回false且不写x、y
+bool predictor_update(MotionPredictor* pred, uint64_t now_us, float* x, float* y);
+
+#endif // MOUSE_PREDICTOR_H
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+// 以下为内存中的消息结构，线路上的字节格式见wire.h
+
 // 默认端口号
 #define DEFAULT_PORT 8765
 
@@ -11,22 +13,45 @@ typedef enum {
     MSG_MOUSE_MOVE = 1,    // 鼠标移动消息
     MSG_CONNECT = 2,       // 连接请求
     MSG_DISCONNECT = 3,    // 断开连接
-    MSG_HEARTBEAT = 4      // 心跳包
+    MSG_HEARTBEAT = 4,     // 心跳包
+    MSG_SCROLL = 5,        // 滚轮
+    MSG_KEY = 6            // 键盘按键
 } MessageType;
 
+// 按钮位（MouseMoveMessage.buttons），前三位与旧版本相同
+#define MOUSE_BUTTON_LEFT    0x01
+#define MOUSE_BUTTON_MIDDLE  0x02
+#define MOUSE_BUTTON_RIGHT   0x04
+#define MOUSE_BUTTON_SIDE    0x08  // BTN_SIDE（多数鼠标的后退侧键）
+#define MOUSE_BUTTON_EXTRA   0x10  // BTN_EXTRA（多数鼠标的前进侧键）
+#define MOUSE_BUTTON_FORWARD 0x20  // BTN_FORWARD
+#define MOUSE_BUTTON_BACK    0x40  // BTN_BACK
+#define MOUSE_BUTTON_TASK    0x80  // BTN_TASK
+#define MOUSE_BUTTON_COUNT   8
+
+// 滚轮一格的滚动量（与Linux的REL_WHEEL_HI_RES相同，高精度滚轮一格内有多个刻度）
+#define SCROLL_UNITS_PER_NOTCH 120
+
 // 鼠标移动消息
 typedef struct {
     uint8_t type;          // 消息类型，值为MSG_MOUSE_MOVE
     float rel_x;           // X轴相对移动（0.0-1.0）
     float rel_y;           // Y轴相对移动（0.0-1.0）
     uint8_t buttons;       // 按钮状态（按位表示）
-    uint64_t timestamp;    // 时间戳（毫秒）
+    uint32_t sequence;     // 消息序号，为0时由网络层分配
+    uint64_t timestamp;    // 输入采集时间（微秒，发送端单调时钟，取自内核事件时间），为0时不发送
+    uint32_t read_delay_us;  // 采集到发送端读取的耗时（微秒）
+    uint32_t queue_delay_us; // 发送端读取到发出的耗时（微秒）
+    uint64_t receive_us;   // 接收端收到的时间（接收端单调时钟，由网络层填写，不在线路上传输）
 } MouseMoveMessage;
 
 // 连接消息
 typedef struct {
     uint8_t type;          // 消息类型，值为MSG_CONNECT
-    uint32_t version;      // 协议版本
+    uint32_t version;      // 协议版本（线路编码版本WIRE_VERSION）
+    uint16_t refresh_hz;   // 接收端显示刷新率（Hz），接收端在回复中填写，0表示未知
+    uint64_t session_id;   // 发送端的会话编号，重连时不变，接收端据此恢复会话；回复中原样返回（由网络层填写）
+    uint32_t last_sequence; // 发送端：最后发出的移动消息序号；接收端回复：该会话最后收到的移动消息序号（由网络层填写）
 } ConnectMessage;
 
 // 断开连接消息
@@ -35,12 +60,44 @@ typedef struct {
     uint8_t reason;        // 断开原因
 } DisconnectMessage;
 
-// 心跳包消息
+// 心跳包消息，请求与回复用于估计往返时间和双方时钟偏差（NTP方式）
 typedef struct {
     uint8_t type;          // 消息类型，值为MSG_HEARTBEAT
-    uint64_t timestamp;    // 时间戳（毫秒）
+    uint8_t is_reply;      // 0为请求，1为回复
+    uint64_t timestamp;    // 请求方发出请求的时间（微秒，请求方单调时钟）
+    uint64_t receive_us;   // 回复方收到请求的时间（微秒，回复方单调时钟，仅回复）
+    uint64_t transmit_us;  // 回复方发出回复的时间（微秒，回复方单调时钟，仅回复）
 } HeartbeatMessage;
 
+// 滚轮消息，滚动量为自上一条滚轮消息以来的累计值，合并时直接相加
+typedef struct {
+    uint8_t type;          // 消息类型，值为MSG_SCROLL
+    int32_t delta_x;       // 水平滚动（1/SCROLL_UNITS_PER_NOTCH格），正值向右
+    int32_t delta_y;       // 垂直滚动（1/SCROLL_UNITS_PER_NOTCH格），正值向上（远离用户）
+} ScrollMessage;
+
+// 一条按键消息最多携带的按键事件数，一帧更多时拆为多条
+#define KEY_MESSAGE_MAX_KEYS 8
+
+// 按键事件值
+#define KEY_VALUE_UP     0
+#define KEY_VALUE_DOWN   1
+#define KEY_VALUE_REPEAT 2
+
+// 一个按键事件
+typedef struct {
+    uint16_t code;         // Linux键码（KEY_*）
+    uint8_t value;         // KEY_VALUE_UP/DOWN/REPEAT
+    uint32_t scancode;     // 硬件扫描码（EV_MSC/MSC_SCAN），0表示未知
+} KeyEvent;
+
+// 按键消息：键盘一个EV_SYN帧内的按键事件，按发生顺序排列
+typedef struct {
+    uint8_t type;          // 消息类型，值为MSG_KEY
+    uint8_t count;         // 按键事件数（1..KEY_MESSAGE_MAX_KEYS）
+    KeyEvent keys[KEY_MESSAGE_MAX_KEYS];
+} KeyMessage;
+
 // 统一消息结构
 typedef union {
     uint8_t type;
@@ -48,6 +105,8 @@ typedef union {
     ConnectMessage connect;
     DisconnectMessage disconnect;
     HeartbeatMessage heartbeat;
+    ScrollMessage scroll;
+    KeyMessage key;
 } Message;
 
 #endif // MOUSE_PROTOCOL_H 
\ No newline at end of file
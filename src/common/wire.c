@@ -0,0 +1,398 @@
+#include "wire.h"
+#include <string.h>
+#include <math.h>
+
+// 初始化编解码状态
+void wire_codec_init(WireCodec* codec, bool keyframes_only) {
+    if (!codec) return;
+
+    memset(codec, 0, sizeof(WireCodec));
+    codec->keyframes_only = keyframes_only;
+}
+
+// 写入uvarint
+static bool put_uvarint(uint8_t* out, size_t out_size, size_t* pos, uint64_t value) {
+    do {
+        if (*pos >= out_size) return false;
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[(*pos)++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return true;
+}
+
+// 写入svarint
+static bool put_svarint(uint8_t* out, size_t out_size, size_t* pos, int64_t value) {
+    return put_uvarint(out, out_size, pos, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+// 读取uvarint，返回1成功，WIRE_DECODE_NEED_MORE数据不足，WIRE_DECODE_ERROR超长
+static int get_uvarint(const uint8_t* in, size_t in_size, size_t* pos, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*pos >= in_size) return WIRE_DECODE_NEED_MORE;
+        uint8_t byte = in[(*pos)++];
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 1;
+        }
+    }
+    return WIRE_DECODE_ERROR;
+}
+
+// 读取svarint
+static int get_svarint(const uint8_t* in, size_t in_size, size_t* pos, int64_t* value) {
+    uint64_t raw;
+    int rc = get_uvarint(in, in_size, pos, &raw);
+    if (rc == 1) {
+        *value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+    }
+    return rc;
+}
+
+// 相对位置转定点数
+static uint16_t pos_to_fixed(float rel) {
+    if (!(rel > 0.0f)) return 0; // 同时处理NaN
+    if (rel >= 1.0f) return WIRE_POS_SCALE;
+    return (uint16_t)lroundf(rel * WIRE_POS_SCALE);
+}
+
+// 写入时间戳之后的两个耗时字段
+static bool put_delays(uint8_t* out, size_t out_size, size_t* pos, const MouseMoveMessage* mm) {
+    return put_uvarint(out, out_size, pos, mm->read_delay_us) &&
+           put_uvarint(out, out_size, pos, mm->queue_delay_us);
+}
+
+// 差分帧是否需要带耗时字段：间隔已满或与上次发出的值相差较多
+static bool delays_due(const WireCodec* codec, const MouseMoveMessage* mm) {
+    uint32_t read_diff = mm->read_delay_us > codec->read_delay_us ? mm->read_delay_us - codec->read_delay_us
+                                                                   : codec->read_delay_us - mm->read_delay_us;
+    uint32_t queue_diff = mm->queue_delay_us > codec->queue_delay_us ? mm->queue_delay_us - codec->queue_delay_us
+                                                                      : codec->queue_delay_us - mm->queue_delay_us;
+    return codec->delay_age + 1 >= WIRE_DELAY_INTERVAL || read_diff > WIRE_DELAY_TOLERANCE_US ||
+           queue_diff > WIRE_DELAY_TOLERANCE_US;
+}
+
+// 编码移动消息
+static size_t encode_mouse_move(WireCodec* codec, const MouseMoveMessage* mm, uint8_t* out, size_t out_size) {
+    uint16_t x = pos_to_fixed(mm->rel_x);
+    uint16_t y = pos_to_fixed(mm->rel_y);
+    size_t pos = 1;
+    uint8_t flags = 0;
+    bool ok = true;
+    bool with_delays = false;
+
+    if (codec->keyframes_only || !codec->valid) {
+        flags = WIRE_FLAG_KEYFRAME | WIRE_FLAG_BUTTONS;
+        if (mm->timestamp != 0) flags |= WIRE_FLAG_TIMESTAMP;
+
+        ok = ok && put_uvarint(out, out_size, &pos, mm->sequence);
+        if (ok && pos < out_size) out[pos++] = mm->buttons; else ok = false;
+        if (flags & WIRE_FLAG_TIMESTAMP) {
+            with_delays = true;
+            ok = ok && put_uvarint(out, out_size, &pos, mm->timestamp);
+            ok = ok && put_delays(out, out_size, &pos, mm);
+        }
+        ok = ok && put_uvarint(out, out_size, &pos, x);
+        ok = ok && put_uvarint(out, out_size, &pos, y);
+    } else {
+        if (mm->sequence == codec->seq + 1) flags |= WIRE_FLAG_SEQ_NEXT;
+        if (mm->buttons != codec->buttons) flags |= WIRE_FLAG_BUTTONS;
+        if (mm->timestamp != 0) flags |= WIRE_FLAG_TIMESTAMP;
+
+        if (!(flags & WIRE_FLAG_SEQ_NEXT)) {
+            ok = ok && put_uvarint(out, out_size, &pos, (uint32_t)(mm->sequence - codec->seq));
+        }
+        if (flags & WIRE_FLAG_BUTTONS) {
+            if (ok && pos < out_size) out[pos++] = mm->buttons; else ok = false;
+        }
+        if (flags & WIRE_FLAG_TIMESTAMP) {
+            // 时间差的最低位表示是否带耗时字段
+            with_delays = delays_due(codec, mm);
+            int64_t delta = (int64_t)(mm->timestamp - codec->timestamp);
+            ok = ok && put_svarint(out, out_size, &pos, delta * 2 + (with_delays ? 1 : 0));
+            if (with_delays) {
+                ok = ok && put_delays(out, out_size, &pos, mm);
+            }
+        }
+        ok = ok && put_svarint(out, out_size, &pos, (int64_t)x - codec->x);
+        ok = ok && put_svarint(out, out_size, &pos, (int64_t)y - codec->y);
+    }
+
+    if (!ok) return 0;
+
+    out[0] = (uint8_t)(MSG_MOUSE_MOVE | flags);
+
+    // 编码成功后才更新状态
+    codec->valid = true;
+    codec->seq = mm->sequence;
+    codec->x = x;
+    codec->y = y;
+    codec->buttons = mm->buttons;
+    if (mm->timestamp != 0) codec->timestamp = mm->timestamp;
+    if (with_delays) {
+        codec->read_delay_us = mm->read_delay_us;
+        codec->queue_delay_us = mm->queue_delay_us;
+        codec->delay_age = 0;
+    } else if (flags & WIRE_FLAG_TIMESTAMP) {
+        codec->delay_age++;
+    }
+
+    return pos;
+}
+
+// 编码按键消息
+static size_t encode_key(const KeyMessage* km, uint8_t* out, size_t out_size) {
+    if (km->count == 0 || km->count > KEY_MESSAGE_MAX_KEYS) return 0;
+
+    size_t pos = 1;
+    if (pos >= out_size) return 0;
+    out[pos++] = km->count;
+    for (uint8_t i = 0; i < km->count; i++) {
+        const KeyEvent* key = &km->keys[i];
+        if (!put_uvarint(out, out_size, &pos, key->code)) return 0;
+        if (pos >= out_size) return 0;
+        out[pos++] = key->value;
+        if (!put_uvarint(out, out_size, &pos, key->scancode)) return 0;
+    }
+
+    out[0] = MSG_KEY;
+    return pos;
+}
+
+// 编码一条消息
+size_t wire_encode(WireCodec* codec, const Message* msg, uint8_t* out, size_t out_size) {
+    if (!codec || !msg || !out || out_size == 0) return 0;
+
+    size_t pos = 1;
+    uint8_t flags = 0;
+    switch (msg->type) {
+        case MSG_MOUSE_MOVE:
+            return encode_mouse_move(codec, &msg->mouse_move, out, out_size);
+        case MSG_CONNECT:
+            if (!put_uvarint(out, out_size, &pos, msg->connect.version)) return 0;
+            if (!put_uvarint(out, out_size, &pos, msg->connect.refresh_hz)) return 0;
+            if (!put_uvarint(out, out_size, &pos, msg->connect.session_id)) return 0;
+            if (!put_uvarint(out, out_size, &pos, msg->connect.last_sequence)) return 0;
+            break;
+        case MSG_DISCONNECT:
+            if (pos >= out_size) return 0;
+            out[pos++] = msg->disconnect.reason;
+            break;
+        case MSG_SCROLL:
+            if (!put_svarint(out, out_size, &pos, msg->scroll.delta_x)) return 0;
+            if (!put_svarint(out, out_size, &pos, msg->scroll.delta_y)) return 0;
+            break;
+        case MSG_KEY:
+            return encode_key(&msg->key, out, out_size);
+        case MSG_HEARTBEAT:
+            if (!put_uvarint(out, out_size, &pos, msg->heartbeat.timestamp)) return 0;
+            if (msg->heartbeat.is_reply) {
+                if (!put_uvarint(out, out_size, &pos, msg->heartbeat.receive_us)) return 0;
+                if (!put_uvarint(out, out_size, &pos, msg->heartbeat.transmit_us)) return 0;
+                flags = WIRE_FLAG_REPLY;
+            }
+            break;
+        default:
+            return 0;
+    }
+
+    out[0] = (uint8_t)(msg->type | flags);
+    return pos;
+}
+
+// 解码移动消息
+static int decode_mouse_move(WireCodec* codec, uint8_t flags, const uint8_t* in, size_t in_size,
+                             size_t pos, MouseMoveMessage* mm) {
+    uint64_t value;
+    int64_t delta;
+    int rc;
+    uint32_t seq;
+    uint8_t buttons;
+    uint64_t timestamp = 0;
+    uint64_t read_delay = 0, queue_delay = 0;
+    int64_t x, y;
+
+    if (flags & WIRE_FLAG_KEYFRAME) {
+        if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+        seq = (uint32_t)value;
+        if (pos >= in_size) return WIRE_DECODE_NEED_MORE;
+        buttons = in[pos++];
+        if (flags & WIRE_FLAG_TIMESTAMP) {
+            if ((rc = get_uvarint(in, in_size, &pos, &timestamp)) != 1) return rc;
+            if ((rc = get_uvarint(in, in_size, &pos, &read_delay)) != 1) return rc;
+            if ((rc = get_uvarint(in, in_size, &pos, &queue_delay)) != 1) return rc;
+        }
+        if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+        x = (int64_t)value;
+        if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+        y = (int64_t)value;
+    } else {
+        // 差分帧之前必须有关键帧
+        if (!codec->valid) return WIRE_DECODE_ERROR;
+
+        if (flags & WIRE_FLAG_SEQ_NEXT) {
+            seq = codec->seq + 1;
+        } else {
+            if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+            seq = codec->seq + (uint32_t)value;
+        }
+        if (flags & WIRE_FLAG_BUTTONS) {
+            if (pos >= in_size) return WIRE_DECODE_NEED_MORE;
+            buttons = in[pos++];
+        } else {
+            buttons = codec->buttons;
+        }
+        if (flags & WIRE_FLAG_TIMESTAMP) {
+            if ((rc = get_svarint(in, in_size, &pos, &delta)) != 1) return rc;
+            bool with_delays = (delta & 1) != 0;
+            timestamp = codec->timestamp + (uint64_t)((delta - (with_delays ? 1 : 0)) / 2);
+            if (with_delays) {
+                if ((rc = get_uvarint(in, in_size, &pos, &read_delay)) != 1) return rc;
+                if ((rc = get_uvarint(in, in_size, &pos, &queue_delay)) != 1) return rc;
+            } else {
+                read_delay = codec->read_delay_us;
+                queue_delay = codec->queue_delay_us;
+            }
+        }
+        if ((rc = get_svarint(in, in_size, &pos, &delta)) != 1) return rc;
+        x = codec->x + delta;
+        if ((rc = get_svarint(in, in_size, &pos, &delta)) != 1) return rc;
+        y = codec->y + delta;
+    }
+
+    if (x < 0 || x > WIRE_POS_SCALE || y < 0 || y > WIRE_POS_SCALE) {
+        return WIRE_DECODE_ERROR;
+    }
+
+    // 完整解码后才更新状态
+    codec->valid = true;
+    codec->seq = seq;
+    codec->x = (uint16_t)x;
+    codec->y = (uint16_t)y;
+    codec->buttons = buttons;
+    if (flags & WIRE_FLAG_TIMESTAMP) {
+        codec->timestamp = timestamp;
+        codec->read_delay_us = (uint32_t)read_delay;
+        codec->queue_delay_us = (uint32_t)queue_delay;
+    }
+
+    memset(mm, 0, sizeof(MouseMoveMessage));
+    mm->type = MSG_MOUSE_MOVE;
+    mm->rel_x = (float)x / WIRE_POS_SCALE;
+    mm->rel_y = (float)y / WIRE_POS_SCALE;
+    mm->buttons = buttons;
+    mm->sequence = seq;
+    mm->timestamp = timestamp;
+    mm->read_delay_us = (uint32_t)read_delay;
+    mm->queue_delay_us = (uint32_t)queue_delay;
+
+    return (int)pos;
+}
+
+// 解码按键消息
+static int decode_key(const uint8_t* in, size_t in_size, size_t pos, KeyMessage* km) {
+    uint64_t value;
+    int rc;
+
+    if (pos >= in_size) return WIRE_DECODE_NEED_MORE;
+    uint8_t count = in[pos++];
+    if (count == 0 || count > KEY_MESSAGE_MAX_KEYS) return WIRE_DECODE_ERROR;
+
+    memset(km, 0, sizeof(KeyMessage));
+    km->type = MSG_KEY;
+    km->count = count;
+    for (uint8_t i = 0; i < count; i++) {
+        KeyEvent* key = &km->keys[i];
+        if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+        if (value > UINT16_MAX) return WIRE_DECODE_ERROR;
+        key->code = (uint16_t)value;
+        if (pos >= in_size) return WIRE_DECODE_NEED_MORE;
+        key->value = in[pos++];
+        if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+        key->scancode = (uint32_t)value;
+    }
+
+    return (int)pos;
+}
+
+// 解码一帧
+int wire_decode(WireCodec* codec, const uint8_t* in, size_t in_size, Message* msg, size_t* msg_size) {
+    if (!codec || !in || !msg || !msg_size) return WIRE_DECODE_ERROR;
+    if (in_size == 0) return WIRE_DECODE_NEED_MORE;
+
+    uint8_t type = in[0] & 0x0F;
+    uint8_t flags = in[0] & 0xF0;
+    size_t pos = 1;
+    uint64_t value;
+    int rc;
+
+    // 只有移动帧和心跳帧使用标志位
+    if (type == MSG_HEARTBEAT ? (flags & ~WIRE_FLAG_REPLY) != 0 : (type != MSG_MOUSE_MOVE && flags != 0)) {
+        return WIRE_DECODE_ERROR;
+    }
+
+    switch (type) {
+        case MSG_MOUSE_MOVE:
+            rc = decode_mouse_move(codec, flags, in, in_size, pos, &msg->mouse_move);
+            if (rc > 0) *msg_size = sizeof(MouseMoveMessage);
+            return rc;
+        case MSG_CONNECT:
+            if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+            memset(&msg->connect, 0, sizeof(ConnectMessage));
+            msg->connect.type = MSG_CONNECT;
+            msg->connect.version = (uint32_t)value;
+            if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+            msg->connect.refresh_hz = (uint16_t)value;
+            if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+            msg->connect.session_id = value;
+            if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+            msg->connect.last_sequence = (uint32_t)value;
+            *msg_size = sizeof(ConnectMessage);
+            break;
+        case MSG_DISCONNECT:
+            if (pos >= in_size) return WIRE_DECODE_NEED_MORE;
+            memset(&msg->disconnect, 0, sizeof(DisconnectMessage));
+            msg->disconnect.type = MSG_DISCONNECT;
+            msg->disconnect.reason = in[pos++];
+            *msg_size = sizeof(DisconnectMessage);
+            break;
+        case MSG_SCROLL: {
+            int64_t dx, dy;
+            if ((rc = get_svarint(in, in_size, &pos, &dx)) != 1) return rc;
+            if ((rc = get_svarint(in, in_size, &pos, &dy)) != 1) return rc;
+            if (dx < INT32_MIN || dx > INT32_MAX || dy < INT32_MIN || dy > INT32_MAX) {
+                return WIRE_DECODE_ERROR;
+            }
+            memset(&msg->scroll, 0, sizeof(ScrollMessage));
+            msg->scroll.type = MSG_SCROLL;
+            msg->scroll.delta_x = (int32_t)dx;
+            msg->scroll.delta_y = (int32_t)dy;
+            *msg_size = sizeof(ScrollMessage);
+            break;
+        }
+        case MSG_KEY:
+            rc = decode_key(in, in_size, pos, &msg->key);
+            if (rc > 0) *msg_size = sizeof(KeyMessage);
+            return rc;
+        case MSG_HEARTBEAT:
+            if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+            memset(&msg->heartbeat, 0, sizeof(HeartbeatMessage));
+            msg->heartbeat.type = MSG_HEARTBEAT;
+            msg->heartbeat.timestamp = value;
+            if (flags & WIRE_FLAG_REPLY) {
+                msg->heartbeat.is_reply = 1;
+                if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+                msg->heartbeat.receive_us = value;
+                if ((rc = get_uvarint(in, in_size, &pos, &value)) != 1) return rc;
+                msg->heartbeat.transmit_us = value;
+            }
+            *msg_size = sizeof(HeartbeatMessage);
+            break;
+        default:
+            return WIRE_DECODE_ERROR;
+    }
+
+    return (int)pos;
+}
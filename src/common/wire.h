@@ -0,0 +1,97 @@
+#ifndef MOUSE_WIRE_H
+#define MOUSE_WIRE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "protocol.h"
+
+/*
+ * 线路编码格式（版本8），network.c与network_mac.c共用
+ *
+ * 每个帧以1字节头部开始：
+ *   低4位  消息类型（MessageType）
+ *   高4位  类型相关的标志位
+ *
+ * 整数编码：
+ *   uvarint  无符号LEB128，每字节低7位为数据，最高位为1表示后续还有字节
+ *   svarint  zigzag编码（(n << 1) ^ (n >> 63)）后按uvarint写入
+ *
+ * 位置使用定点数：pos = round(rel * WIRE_POS_SCALE)，范围0..WIRE_POS_SCALE
+ *
+ * MSG_MOUSE_MOVE（标志位）：
+ *   0x10 KEYFRAME   后续字段为绝对值，不依赖之前的帧
+ *   0x20 BUTTONS    带按钮字节（KEYFRAME时总是带）
+ *   0x40 SEQ_NEXT   序号为上一帧+1，省略序号字段（KEYFRAME时不使用）
+ *   0x80 TIMESTAMP  带时间戳字段
+ *   字段依次为：
+ *     [seq]        KEYFRAME: uvarint绝对序号；否则（无SEQ_NEXT时）uvarint序号差
+ *     [buttons]    1字节
+ *     [timestamp]  KEYFRAME: uvarint绝对值，之后紧跟uvarint read_delay_us、uvarint queue_delay_us；
+ *                  否则svarint (与上一时间戳的差 * 2 + D)，D为1时之后紧跟两个耗时字段，
+ *                  为0时两个耗时沿用上一次收到的值
+ *     x, y         KEYFRAME: uvarint绝对位置；否则svarint位置差
+ *   编码器每WIRE_DELAY_INTERVAL帧，或耗时与上次发出的值相差超过WIRE_DELAY_TOLERANCE_US时才带耗时字段。
+ *   典型的小幅移动（SEQ_NEXT，无按钮变化，带时间戳、不带耗时）为5字节，不带时间戳时为3字节
+ *
+ * MSG_CONNECT:    uvarint version, uvarint refresh_hz, uvarint session_id, uvarint last_sequence
+ * MSG_DISCONNECT: 1字节reason
+ * MSG_SCROLL:     svarint delta_x, svarint delta_y（不依赖之前的帧）
+ * MSG_KEY:        1字节count，之后每个按键：uvarint code、1字节value、uvarint scancode
+ * MSG_HEARTBEAT（标志位0x10 REPLY表示回复）：
+ *   uvarint timestamp，回复时后接uvarint receive_us、uvarint transmit_us
+ *
+ * 差分编码依赖连接上按顺序到达的帧，UDP等可能丢包的传输须使用只发关键帧的编码器
+ */
+
+// 线路编码版本，在MSG_CONNECT中交换
+#define WIRE_VERSION 8
+
+// 单帧最大长度（满载的按键帧）
+#define WIRE_MAX_FRAME_SIZE 96
+
+// 位置定点数比例
+#define WIRE_POS_SCALE 16384
+
+// 差分移动帧最多隔多少帧带一次耗时字段
+#define WIRE_DELAY_INTERVAL 16
+
+// 耗时与上次发出的值相差超过这个值（微秒）时立即带上
+#define WIRE_DELAY_TOLERANCE_US 100
+
+// 移动帧标志位
+#define WIRE_FLAG_KEYFRAME  0x10
+#define WIRE_FLAG_BUTTONS   0x20
+#define WIRE_FLAG_SEQ_NEXT  0x40
+#define WIRE_FLAG_TIMESTAMP 0x80
+
+// 心跳帧标志位
+#define WIRE_FLAG_REPLY     0x10
+
+// 解码结果
+#define WIRE_DECODE_NEED_MORE 0    // 数据不足一帧
+#define WIRE_DECODE_ERROR    -1    // 格式错误，连接已无法继续解析
+
+// 编解码状态（每个连接每个方向一个）
+typedef struct {
+    bool keyframes_only;   // 只编码关键帧（用于可能丢包的传输）
+    bool valid;            // 以下上一帧的状态是否有效
+    uint32_t seq;          // 上一帧序号
+    uint16_t x, y;         // 上一帧位置（定点数）
+    uint8_t buttons;       // 上一帧按钮状态
+    uint64_t timestamp;    // 上一帧时间戳
+    uint32_t read_delay_us;  // 上一次传输的耗时字段，省略时沿用
+    uint32_t queue_delay_us;
+    uint32_t delay_age;    // 编码器：距上次带耗时字段的帧数
+} WireCodec;
+
+// 初始化编解码状态
+void wire_codec_init(WireCodec* codec, bool keyframes_only);
+
+// 编码一条消息，返回写入的字节数，失败返回0
+size_t wire_encode(WireCodec* codec, const Message* msg, uint8_t* out, size_t out_size);
+
+// 解码一帧，返回消耗的字节数；数据不足返回WIRE_DECODE_NEED_MORE，格式错误返回WIRE_DECODE_ERROR
+int wire_decode(WireCodec* codec, const uint8_t* in, size_t in_size, Message* msg, size_t* msg_size);
+
+#endif // MOUSE_WIRE_H
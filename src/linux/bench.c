@@ -0,0 +1,343 @@
+#define _GNU_SOURCE // clock_nanosleep, pthread_attr_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+#include <sched.h>
+#include <errno.h>
+#include <linux/input.h>
+#include "../common/network.h"
+#include "../common/histogram.h"
+#include "sender.h"
+#include "realtime.h"
+
+/*
+ * 回环端到端基准测试
+ *
+ * 合成的移动和点击事件直接注入发送端的事件处理（sender_process_events），
+ * 经过环形缓冲区、发送线程和真实的网络层，发到本机一个无界面的接收端。
+ * 接收端统计吞吐量、丢失的消息（序号缺口）和按钮边沿，以及从事件时间戳到接收端分发的延迟。
+ */
+
+// 基准测试使用的端口
+#define BENCH_PORT 18765
+
+// 每次点击间隔的事件帧数（0表示不点击）
+#define DEFAULT_CLICK_EVERY 50
+
+// 测试参数
+typedef struct {
+    unsigned int rate_hz;          // 合成事件帧频率
+    double duration_s;             // 持续时间
+    unsigned int click_every;      // 每多少帧点击一次
+    unsigned int emit_rate_hz;     // 发送端移动消息的最大频率，0表示不限速
+    NetworkTransport transport;    // 传输方式
+    RealtimeConfig realtime;       // 发送端的实时模式（合成事件的线程作为读取线程）
+    unsigned int busy_poll_us;     // 发送端套接字的SO_BUSY_POLL，0表示不使用
+    bool use_io_uring;             // 发送线程用io_uring等待和发送
+} BenchConfig;
+
+// 启动时的CPU集合，接收线程总是使用默认调度和全部CPU，只比较发送端的设置
+static cpu_set_t initial_cpus;
+
+// 接收端状态（仅接收线程写入）
+typedef struct {
+    NetworkContext *network;
+    volatile int running;
+    uint64_t messages;             // 收到的移动消息数
+    uint64_t lost;                 // 序号缺口，即发出后丢失的消息数
+    uint64_t edges;                // 收到的按钮边沿数
+    uint32_t last_seq;
+    bool seq_valid;
+    uint8_t last_buttons;
+    uint64_t first_us, last_us;    // 第一条和最后一条消息的到达时间
+    Histogram latency;             // 事件时间戳到分发的延迟
+} BenchReceiver;
+
+// 单调时钟当前时间（与内核事件时间、网络层时间戳同一时基）
+static uint64_t now_us(void) {
+    return network_time_us();
+}
+
+// 接收端消息回调
+static void receiver_callback(const Message *msg, size_t msg_size, void *user_data) {
+    (void)msg_size; // 避免未使用警告
+    BenchReceiver *rx = (BenchReceiver *)user_data;
+
+    // 与Mac接收端相同：回复连接请求，刷新率为0表示不限制发送端
+    if (msg->type == MSG_CONNECT) {
+        ConnectMessage reply;
+        reply.type = MSG_CONNECT;
+        reply.version = msg->connect.version;
+        reply.refresh_hz = 0;
+        network_send_message(rx->network, (const Message *)&reply, sizeof(reply));
+        return;
+    }
+
+    if (msg->type != MSG_MOUSE_MOVE) return;
+
+    const MouseMoveMessage *mm = &msg->mouse_move;
+    uint64_t now = now_us();
+
+    if (rx->seq_valid && (int32_t)(mm->sequence - rx->last_seq) > 1) {
+        rx->lost += mm->sequence - rx->last_seq - 1;
+    }
+    rx->last_seq = mm->sequence;
+    rx->seq_valid = true;
+
+    if (mm->buttons != rx->last_buttons) {
+        rx->edges++;
+        rx->last_buttons = mm->buttons;
+    }
+
+    if (rx->messages == 0) rx->first_us = now;
+    rx->last_us = now;
+    rx->messages++;
+
+    // 同一台机器，时间戳无需时钟偏差换算
+    if (mm->timestamp != 0 && now >= mm->timestamp) {
+        histogram_record(&rx->latency, now - mm->timestamp);
+    }
+}
+
+// 接收线程：在网络层的事件循环中接受连接并分发消息，每10毫秒检查一次是否结束
+static void *receiver_thread_func(void *arg) {
+    BenchReceiver *rx = (BenchReceiver *)arg;
+
+    while (rx->running) {
+        if (network_poll(rx->network, 10) < 0) {
+            perror("接收端事件循环出错");
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// 合成一帧事件：移动，必要时附带一个按钮边沿
+static size_t make_frame(struct input_event *events, uint64_t frame, const BenchConfig *config,
+                         bool *pressed) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    size_t n = 0;
+
+    // 画圆，保证位置一直在屏幕内变化
+    double angle = (double)frame * 0.01;
+    events[n].type = EV_REL; events[n].code = REL_X; events[n].value = (int)lround(cos(angle) * 4.0); n++;
+    events[n].type = EV_REL; events[n].code = REL_Y; events[n].value = (int)lround(sin(angle) * 4.0); n++;
+
+    if (config->click_every > 0 && frame % config->click_every == 0) {
+        *pressed = !*pressed;
+        events[n].type = EV_KEY; events[n].code = BTN_LEFT; events[n].value = *pressed ? 1 : 0; n++;
+    }
+
+    events[n].type = EV_SYN; events[n].code = SYN_REPORT; events[n].value = 0; n++;
+
+    for (size_t i = 0; i < n; i++) {
+        events[i].input_event_sec = ts.tv_sec;
+        events[i].input_event_usec = ts.tv_nsec / 1000;
+    }
+    return n;
+}
+
+// 运行一轮测试，成功返回true
+static bool run_bench(const BenchConfig *config) {
+    BenchReceiver rx;
+    memset(&rx, 0, sizeof(rx));
+    histogram_init(&rx.latency);
+
+    // 无界面接收端
+    rx.network = network_init();
+    if (!rx.network || !network_start_server_transport(rx.network, BENCH_PORT, config->transport)) {
+        fprintf(stderr, "无法监听端口 %d\n", BENCH_PORT);
+        network_cleanup(rx.network);
+        return false;
+    }
+    network_set_callback(rx.network, receiver_callback, &rx);
+
+    rx.running = 1;
+    pthread_t receiver_thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setaffinity_np(&attr, sizeof(initial_cpus), &initial_cpus);
+    pthread_create(&receiver_thread, &attr, receiver_thread_func, &rx);
+    pthread_attr_destroy(&attr);
+
+    // 发送端：真实的连接、环形缓冲区和发送线程
+    NetworkContext *network = network_init();
+    if (!network || !network_connect_transport(network, "127.0.0.1", BENCH_PORT, config->transport)) {
+        fprintf(stderr, "无法连接到本机接收端\n");
+        network_cleanup(network);
+        rx.running = 0;
+        pthread_join(receiver_thread, NULL);
+        network_cleanup(rx.network);
+        return false;
+    }
+
+    if (config->busy_poll_us > 0 && !network_set_busy_poll(network, config->busy_poll_us)) {
+        fprintf(stderr, "无法设置SO_BUSY_POLL: %s\n", strerror(errno));
+    }
+
+    SenderConfig sender_config = {config->emit_rate_hz, true, &config->realtime, config->use_io_uring};
+    if (!sender_add_target(network, "bench") || !sender_start(&sender_config)) {
+        sender_cleanup();
+        network_cleanup(network);
+        rx.running = 0;
+        pthread_join(receiver_thread, NULL);
+        network_cleanup(rx.network);
+        return false;
+    }
+
+    // 合成设备，事件直接注入，不经过evdev
+    InputDevice dev;
+    memset(&dev, 0, sizeof(dev));
+    dev.fd = -1;
+    dev.kind = INPUT_DEVICE_MOUSE;
+    snprintf(dev.path, sizeof(dev.path), "bench");
+    snprintf(dev.name, sizeof(dev.name), "合成鼠标");
+
+    // 合成事件的线程相当于读取线程，在发送线程创建之后设置
+    realtime_setup_thread("合成线程", config->realtime.enabled ? config->realtime.reader_priority : 0,
+                          config->realtime.reader_cpu);
+
+    uint64_t frames = (uint64_t)(config->duration_s * config->rate_hz);
+    uint64_t interval_ns = 1000000000ULL / config->rate_hz;
+    uint64_t edges_sent = 0;
+    bool pressed = false;
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint64_t start_us = now_us();
+
+    for (uint64_t frame = 1; frame <= frames; frame++) {
+        struct input_event events[4];
+        memset(events, 0, sizeof(events));
+        bool was_pressed = pressed;
+        size_t n = make_frame(events, frame, config, &pressed);
+        if (pressed != was_pressed) edges_sent++;
+
+        sender_process_events(&dev, events, n, NULL);
+
+        // 按绝对时间推进，避免累积误差
+        next.tv_nsec += (long)interval_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    // 最后一个按钮状态释放，等待发送队列排空
+    if (pressed) {
+        struct input_event events[2];
+        memset(events, 0, sizeof(events));
+        events[0].type = EV_KEY; events[0].code = BTN_LEFT; events[0].value = 0;
+        events[1].type = EV_SYN; events[1].code = SYN_REPORT;
+        sender_process_events(&dev, events, 2, NULL);
+        edges_sent++;
+    }
+    uint64_t gen_us = now_us() - start_us;
+    usleep(200000);
+
+    sender_stop();
+    rx.running = 0;
+    pthread_join(receiver_thread, NULL);
+
+    // 报告
+    double elapsed_s = rx.last_us > rx.first_us ? (double)(rx.last_us - rx.first_us) / 1e6 : 0.0;
+    printf("== %s, 事件 %u Hz, 发送限速 %u Hz, %.1f 秒%s%s ==\n",
+           config->transport == NETWORK_TRANSPORT_UDP ? "UDP" : "TCP",
+           config->rate_hz, config->emit_rate_hz, config->duration_s,
+           config->realtime.enabled ? ", 实时模式" : "", config->use_io_uring ? ", io_uring" : "");
+    printf("合成帧: %llu (%.0f 帧/秒), 按钮边沿: %llu\n", (unsigned long long)frames,
+           gen_us > 0 ? (double)frames * 1e6 / (double)gen_us : 0.0, (unsigned long long)edges_sent);
+    printf("接收: %llu 条 (%.0f 条/秒), 丢失: %llu, 按钮边沿: %llu/%llu\n",
+           (unsigned long long)rx.messages, elapsed_s > 0 ? (double)rx.messages / elapsed_s : 0.0,
+           (unsigned long long)rx.lost, (unsigned long long)rx.edges, (unsigned long long)edges_sent);
+    printf("延迟(微秒): p50=%llu, p99=%llu, p999=%llu, 最大=%llu\n",
+           (unsigned long long)histogram_percentile(&rx.latency, 50.0),
+           (unsigned long long)histogram_percentile(&rx.latency, 99.0),
+           (unsigned long long)histogram_percentile(&rx.latency, 99.9),
+           (unsigned long long)histogram_max(&rx.latency));
+    sender_print_stats();
+
+    sender_cleanup();
+    network_cleanup(network);
+    network_cleanup(rx.network);
+
+    return rx.edges == edges_sent;
+}
+
+// 打印用法
+static void usage(const char *prog) {
+    printf("用法: %s [-r 事件频率Hz] [-d 秒] [-c 每N帧点击, 0不点击] [-f 发送限速Hz] [-u] [-i]\n"
+           "       [--realtime] [--cpu 合成CPU,发送CPU] [--busy-poll 微秒]\n", prog);
+    printf("不指定-r时依次测试 125、1000、8000 Hz\n");
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config;
+    memset(&config, 0, sizeof(config));
+    config.duration_s = 2.0;
+    config.click_every = DEFAULT_CLICK_EVERY;
+    config.transport = NETWORK_TRANSPORT_TCP;
+    realtime_config_init(&config.realtime);
+    sched_getaffinity(0, sizeof(initial_cpus), &initial_cpus);
+
+    // 处理命令行参数
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            config.rate_hz = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            config.duration_s = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            config.click_every = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            config.emit_rate_hz = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-u") == 0) {
+            config.transport = NETWORK_TRANSPORT_UDP;
+        } else if (strcmp(argv[i], "-i") == 0) {
+            config.use_io_uring = true;
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            config.realtime.enabled = true;
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            if (!realtime_parse_cpus(&config.realtime, argv[++i])) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--busy-poll") == 0 && i + 1 < argc) {
+            config.busy_poll_us = (unsigned int)atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (config.realtime.enabled) {
+        realtime_lock_memory();
+    }
+
+    static const unsigned int default_rates[] = {125, 1000, 8000};
+    bool ok = true;
+
+    if (config.rate_hz > 0) {
+        ok = run_bench(&config);
+    } else {
+        for (size_t i = 0; i < sizeof(default_rates) / sizeof(default_rates[0]); i++) {
+            config.rate_hz = default_rates[i];
+            ok = run_bench(&config) && ok;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "按钮边沿丢失\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,521 @@
+#include "input_capture.h"
+#include "uring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+
+// 输入设备目录
+#define INPUT_DIR "/dev/input"
+
+// 每次read()最多读取的事件数
+#define EVENT_BATCH_SIZE 64
+
+// 触摸板整个宽度对应的相对移动单位（鼠标单位，1000为整个屏幕）
+#define TOUCHPAD_SPAN_UNITS 500.0
+
+// 能力位数组
+#define BITS_PER_LONG (sizeof(unsigned long) * 8)
+#define NBITS(x) (((x) - 1) / BITS_PER_LONG + 1)
+
+// io_uring请求的标签：设备读取用设备编号（从1开始），其余为以下常量
+#define TAG_INOTIFY 0                          // 热插拔通知的读取
+#define TAG_CANCEL UINT64_MAX                  // 取消请求本身的完成
+
+// io_uring的提交队列大小：每个设备和inotify各一个读取，移除时各一个取消
+#define URING_ENTRIES (MAX_INPUT_DEVICES * 2 + 4)
+
+// io_uring multishot读取的提供缓冲区：所有设备共用，每个缓冲区存放一次读取，分发后立即归还
+#define URING_BUFFER_COUNT 64
+
+// 被捕获的设备
+typedef struct {
+    InputDevice dev;                           // 必须是第一个成员
+    uint64_t id;                               // 编号，epoll事件和io_uring请求中用它代替地址（释放后地址可能被新设备重用）
+} CapturedDevice;
+
+struct InputCapture {
+    int epoll_fd;                              // epoll实例
+    int inotify_fd;                            // /dev/input热插拔监视
+    Uring* ring;                               // 不为NULL时用io_uring读取，不使用epoll
+    size_t reads_pending;                      // io_uring中尚未结束的multishot读取数（含已移除的设备）
+    bool inotify_pending;                      // inotify有尚未完成的读取
+    char inotify_buf[4096] __attribute__((aligned(__alignof__(struct inotify_event)))); // io_uring读取热插拔通知
+    InputDevice* devices[MAX_INPUT_DEVICES];   // 已打开的设备
+    size_t device_count;                       // 设备数
+    uint64_t next_device_id;                   // 上一个设备的编号，编号从1开始，0表示inotify
+    InputEventsCallback on_events;             // 事件回调
+    InputDeviceCallback on_device;             // 设备变化回调
+    void* user_data;                           // 用户数据（传递给回调函数）
+    char keyboard_path[64];                    // 指定的键盘设备节点，空表示不捕获键盘
+};
+
+// 测试能力位
+static bool test_bit(const unsigned long* bits, unsigned int bit) {
+    return (bits[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG)) & 1UL;
+}
+
+// 根据能力位判断设备类型，不是指针设备时返回0；keyboard为true时只检查是否有按键
+static int classify_device(int fd, bool keyboard) {
+    unsigned long ev_bits[NBITS(EV_MAX + 1)];
+    unsigned long rel_bits[NBITS(REL_MAX + 1)];
+    unsigned long abs_bits[NBITS(ABS_MAX + 1)];
+    unsigned long key_bits[NBITS(KEY_MAX + 1)];
+    unsigned long prop_bits[NBITS(INPUT_PROP_MAX + 1)];
+
+    memset(ev_bits, 0, sizeof(ev_bits));
+    memset(rel_bits, 0, sizeof(rel_bits));
+    memset(abs_bits, 0, sizeof(abs_bits));
+    memset(key_bits, 0, sizeof(key_bits));
+    memset(prop_bits, 0, sizeof(prop_bits));
+
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(ev_bits)), ev_bits) < 0) return 0;
+    if (!test_bit(ev_bits, EV_KEY)) return 0;
+    if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits) < 0) return 0;
+
+    // 指定的键盘：至少有一个普通按键
+    if (keyboard) {
+        for (unsigned int code = KEY_ESC; code < BTN_MISC; code++) {
+            if (test_bit(key_bits, code)) return INPUT_DEVICE_KEYBOARD;
+        }
+        return 0;
+    }
+
+    // 鼠标、轨迹球：有REL_X/REL_Y和左键
+    if (test_bit(ev_bits, EV_REL) &&
+        ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel_bits)), rel_bits) >= 0 &&
+        test_bit(rel_bits, REL_X) && test_bit(rel_bits, REL_Y) &&
+        test_bit(key_bits, BTN_LEFT)) {
+        return INPUT_DEVICE_MOUSE;
+    }
+
+    // 触摸板：有ABS_X/ABS_Y和手指工具位，且不是触摸屏
+    ioctl(fd, EVIOCGPROP(sizeof(prop_bits)), prop_bits);
+    if (test_bit(ev_bits, EV_ABS) &&
+        ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits) >= 0 &&
+        test_bit(abs_bits, ABS_X) && test_bit(abs_bits, ABS_Y) &&
+        test_bit(key_bits, BTN_TOOL_FINGER) &&
+        !test_bit(prop_bits, INPUT_PROP_DIRECT)) {
+        return INPUT_DEVICE_TOUCHPAD;
+    }
+
+    return 0;
+}
+
+// 根据路径查找设备
+static InputDevice* find_device(InputCapture* cap, const char* path) {
+    for (size_t i = 0; i < cap->device_count; i++) {
+        if (strcmp(cap->devices[i]->path, path) == 0) {
+            return cap->devices[i];
+        }
+    }
+    return NULL;
+}
+
+// 根据编号查找设备，已移除时返回NULL
+static CapturedDevice* find_device_by_id(InputCapture* cap, uint64_t id) {
+    for (size_t i = 0; i < cap->device_count; i++) {
+        CapturedDevice* captured = (CapturedDevice*)cap->devices[i];
+        if (captured->id == id) {
+            return captured;
+        }
+    }
+    return NULL;
+}
+
+// io_uring：排队multishot读取，设备每次有事件都产生一个完成，不需要重新排队
+static bool queue_device_read(InputCapture* cap, CapturedDevice* captured) {
+    if (!uring_queue_read_multishot(cap->ring, captured->dev.fd, captured->id)) return false;
+
+    cap->reads_pending++;
+    return true;
+}
+
+// 开始等待设备的事件：io_uring排队multishot读取，否则加入epoll
+static bool watch_device(InputCapture* cap, CapturedDevice* captured) {
+    if (cap->ring) return queue_device_read(cap, captured);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = captured->id;
+    return epoll_ctl(cap->epoll_fd, EPOLL_CTL_ADD, captured->dev.fd, &ev) == 0;
+}
+
+// 尝试打开并加入一个设备，不是指针设备时忽略
+static void add_device(InputCapture* cap, const char* path) {
+    if (find_device(cap, path) || cap->device_count >= MAX_INPUT_DEVICES) return;
+
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return;
+
+    int kind = classify_device(fd, strcmp(path, cap->keyboard_path) == 0);
+    if (kind == 0) {
+        close(fd);
+        return;
+    }
+
+    CapturedDevice* captured = (CapturedDevice*)calloc(1, sizeof(CapturedDevice));
+    if (!captured) {
+        close(fd);
+        return;
+    }
+    InputDevice* dev = &captured->dev;
+    captured->id = ++cap->next_device_id;
+
+    // 事件时间使用单调时钟，与网络层时间戳同一时基，用于计算延迟
+    int clock_id = CLOCK_MONOTONIC;
+    ioctl(fd, EVIOCSCLOCKID, &clock_id);
+
+    dev->fd = fd;
+    dev->kind = (InputDeviceKind)kind;
+    snprintf(dev->path, sizeof(dev->path), "%s", path);
+    if (ioctl(fd, EVIOCGNAME(sizeof(dev->name)), dev->name) < 0) {
+        snprintf(dev->name, sizeof(dev->name), "未知设备");
+    }
+
+    // 触摸板：按坐标范围计算比例
+    if (dev->kind == INPUT_DEVICE_TOUCHPAD) {
+        struct input_absinfo info_x, info_y;
+        if (ioctl(fd, EVIOCGABS(ABS_X), &info_x) < 0 || ioctl(fd, EVIOCGABS(ABS_Y), &info_y) < 0 ||
+            info_x.maximum <= info_x.minimum || info_y.maximum <= info_y.minimum) {
+            close(fd);
+            free(captured);
+            return;
+        }
+        dev->abs_scale_x = TOUCHPAD_SPAN_UNITS / (info_x.maximum - info_x.minimum);
+        dev->abs_scale_y = TOUCHPAD_SPAN_UNITS / (info_y.maximum - info_y.minimum);
+    }
+
+    if (!watch_device(cap, captured)) {
+        close(fd);
+        free(captured);
+        return;
+    }
+
+    cap->devices[cap->device_count++] = dev;
+    printf("捕获输入设备: %s (%s, %s)\n", dev->path, dev->name,
+           dev->kind == INPUT_DEVICE_MOUSE ? "鼠标" : dev->kind == INPUT_DEVICE_TOUCHPAD ? "触摸板" : "键盘");
+
+    if (cap->on_device) {
+        cap->on_device(dev, true, cap->user_data);
+    }
+}
+
+// 移除并关闭一个设备
+static void remove_device(InputCapture* cap, InputDevice* dev) {
+    for (size_t i = 0; i < cap->device_count; i++) {
+        if (cap->devices[i] != dev) continue;
+
+        printf("输入设备已移除: %s (%s)\n", dev->path, dev->name);
+        if (cap->on_device) {
+            cap->on_device(dev, false, cap->user_data);
+        }
+
+        // io_uring的读取按编号取消，之后到达的完成找不到设备，只归还缓冲区
+        CapturedDevice* captured = (CapturedDevice*)dev;
+        if (cap->ring) {
+            uring_queue_cancel(cap->ring, captured->id, TAG_CANCEL);
+        } else {
+            epoll_ctl(cap->epoll_fd, EPOLL_CTL_DEL, dev->fd, NULL);
+        }
+        close(dev->fd);
+        free(captured);
+
+        cap->devices[i] = cap->devices[--cap->device_count];
+        cap->devices[cap->device_count] = NULL;
+        return;
+    }
+}
+
+// 初始化捕获上下文
+InputCapture* input_capture_init(void) {
+    InputCapture* cap = (InputCapture*)malloc(sizeof(InputCapture));
+    if (!cap) return NULL;
+
+    memset(cap, 0, sizeof(InputCapture));
+    cap->inotify_fd = -1;
+    cap->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (cap->epoll_fd < 0) {
+        free(cap);
+        return NULL;
+    }
+
+    return cap;
+}
+
+static int reap_completions(InputCapture* cap, bool dispatch);
+
+// 释放捕获上下文
+void input_capture_cleanup(InputCapture* cap) {
+    if (!cap) return;
+
+    while (cap->device_count > 0) {
+        remove_device(cap, cap->devices[cap->device_count - 1]);
+    }
+
+    // io_uring：等所有读取被取消后才能释放缓冲区
+    if (cap->ring) {
+        if (cap->inotify_pending) {
+            uring_queue_cancel(cap->ring, TAG_INOTIFY, TAG_CANCEL);
+        }
+        for (int attempt = 0; attempt < 10 && (cap->reads_pending > 0 || cap->inotify_pending); attempt++) {
+            if (uring_submit_and_wait(cap->ring, 1, 100000) == -ETIME) continue;
+            reap_completions(cap, false);
+        }
+        uring_cleanup(cap->ring);
+    }
+
+    if (cap->inotify_fd >= 0) {
+        close(cap->inotify_fd);
+    }
+    close(cap->epoll_fd);
+    free(cap);
+}
+
+// 设置回调函数
+void input_capture_set_callbacks(InputCapture* cap, InputEventsCallback on_events,
+                                 InputDeviceCallback on_device, void* user_data) {
+    if (!cap) return;
+
+    cap->on_events = on_events;
+    cap->on_device = on_device;
+    cap->user_data = user_data;
+}
+
+// 使用io_uring读取设备
+bool input_capture_use_io_uring(InputCapture* cap) {
+    if (!cap || cap->inotify_fd >= 0) return false;
+    if (cap->ring) return true;
+
+    cap->ring = uring_init(URING_ENTRIES);
+    if (cap->ring && !uring_init_buffers(cap->ring, URING_BUFFER_COUNT, EVENT_BATCH_SIZE * sizeof(struct input_event))) {
+        int saved = errno;
+        uring_cleanup(cap->ring);
+        cap->ring = NULL;
+        errno = saved;
+    }
+    return cap->ring != NULL;
+}
+
+// 指定要捕获的键盘
+bool input_capture_set_keyboard(InputCapture* cap, const char* path) {
+    if (!cap || !path) return false;
+
+    // 解析/dev/input/by-id等符号链接，热插拔通知中只有eventN的名称
+    char resolved[PATH_MAX];
+    if (!realpath(path, resolved)) {
+        perror("无法解析键盘设备路径");
+        return false;
+    }
+    if (strlen(resolved) >= sizeof(cap->keyboard_path)) return false;
+
+    snprintf(cap->keyboard_path, sizeof(cap->keyboard_path), "%s", resolved);
+    return true;
+}
+
+// 开始捕获
+bool input_capture_start(InputCapture* cap) {
+    if (!cap) return false;
+
+    // 先开始监听，避免扫描期间插入的设备被遗漏
+    cap->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cap->inotify_fd < 0) {
+        perror("无法创建inotify");
+        return false;
+    }
+    if (inotify_add_watch(cap->inotify_fd, INPUT_DIR, IN_CREATE | IN_ATTRIB | IN_DELETE) < 0) {
+        perror("无法监视" INPUT_DIR);
+        return false;
+    }
+
+    if (cap->ring) {
+        if (!uring_queue_read(cap->ring, cap->inotify_fd, cap->inotify_buf, sizeof(cap->inotify_buf),
+                              TAG_INOTIFY)) {
+            fprintf(stderr, "无法监听inotify\n");
+            return false;
+        }
+        cap->inotify_pending = true;
+    } else {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0; // 0表示inotify
+        if (epoll_ctl(cap->epoll_fd, EPOLL_CTL_ADD, cap->inotify_fd, &ev) < 0) {
+            perror("无法监听inotify");
+            return false;
+        }
+    }
+
+    // 扫描已有设备
+    DIR* dir = opendir(INPUT_DIR);
+    if (!dir) {
+        perror("无法打开" INPUT_DIR "目录");
+        return false;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "event", 5) == 0) {
+            char path[64];
+            snprintf(path, sizeof(path), INPUT_DIR "/%.32s", entry->d_name);
+            add_device(cap, path);
+        }
+    }
+    closedir(dir);
+
+    // 指定的键盘打不开时提示，设备出现后由热插拔通知再打开
+    if (cap->keyboard_path[0] && !find_device(cap, cap->keyboard_path)) {
+        fprintf(stderr, "暂时无法打开键盘设备: %s\n", cap->keyboard_path);
+    }
+
+    return true;
+}
+
+// 处理读到的热插拔通知
+static void handle_inotify_events(InputCapture* cap, const char* buf, size_t len) {
+    for (const char* p = buf; p < buf + len; ) {
+        const struct inotify_event* ie = (const struct inotify_event*)p;
+        p += sizeof(struct inotify_event) + ie->len;
+
+        if (ie->len == 0 || strncmp(ie->name, "event", 5) != 0) continue;
+
+        char path[64];
+        snprintf(path, sizeof(path), INPUT_DIR "/%.32s", ie->name);
+
+        if (ie->mask & IN_DELETE) {
+            InputDevice* dev = find_device(cap, path);
+            if (dev) remove_device(cap, dev);
+        } else {
+            // IN_CREATE时udev可能尚未设置权限，IN_ATTRIB时再试一次
+            add_device(cap, path);
+        }
+    }
+}
+
+// 处理热插拔通知
+static void handle_inotify(InputCapture* cap) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t len = read(cap->inotify_fd, buf, sizeof(buf));
+        if (len <= 0) break;
+
+        handle_inotify_events(cap, buf, (size_t)len);
+    }
+}
+
+// 读取设备事件
+static void handle_device(InputCapture* cap, InputDevice* dev) {
+    struct input_event events[EVENT_BATCH_SIZE];
+
+    ssize_t n = read(dev->fd, events, sizeof(events));
+    if (n > 0) {
+        if (cap->on_events) {
+            cap->on_events(dev, events, (size_t)n / sizeof(struct input_event), cap->user_data);
+        }
+    } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        // ENODEV等：设备已拔出
+        remove_device(cap, dev);
+    }
+}
+
+// io_uring：处理所有已完成的读取，dispatch为false时（释放前）只回收缓冲区；返回处理的完成数
+static int reap_completions(InputCapture* cap, bool dispatch) {
+    int handled = 0;
+    UringCompletion completion;
+
+    while (uring_next_completion(cap->ring, &completion)) {
+        if (completion.tag == TAG_CANCEL) continue;
+        handled++;
+
+        if (completion.tag == TAG_INOTIFY) {
+            cap->inotify_pending = false;
+            if (!dispatch) continue;
+            if (completion.result > 0) {
+                handle_inotify_events(cap, cap->inotify_buf, (size_t)completion.result);
+            }
+            if (uring_queue_read(cap->ring, cap->inotify_fd, cap->inotify_buf, sizeof(cap->inotify_buf),
+                                 TAG_INOTIFY)) {
+                cap->inotify_pending = true;
+            }
+            continue;
+        }
+
+        if (!completion.more) {
+            cap->reads_pending--;
+        }
+        CapturedDevice* captured = dispatch ? find_device_by_id(cap, completion.tag) : NULL;
+        if (!captured) {
+            uring_return_buffer(cap->ring, completion.buffer);
+            continue;
+        }
+
+        InputDevice* dev = &captured->dev;
+        if (completion.result > 0 && completion.buffer >= 0 && cap->on_events) {
+            cap->on_events(dev, (struct input_event*)uring_buffer(cap->ring, completion.buffer),
+                           (size_t)completion.result / sizeof(struct input_event), cap->user_data);
+        }
+        uring_return_buffer(cap->ring, completion.buffer);
+        if (completion.more) continue;
+
+        // multishot读取结束：缓冲区暂时用完（ENOBUFS）等情况下重新排队，随下一次等待一起提交；
+        // ENODEV等错误表示设备已拔出
+        if (completion.result == 0 || (completion.result < 0 && completion.result != -ENOBUFS &&
+                                       completion.result != -EAGAIN && completion.result != -EINTR)) {
+            remove_device(cap, dev);
+        } else if (!queue_device_read(cap, captured)) {
+            remove_device(cap, dev);
+        }
+    }
+    return handled;
+}
+
+// io_uring：等待multishot读取的完成，一次io_uring_enter代替epoll_wait和每个设备的read
+static int dispatch_ring(InputCapture* cap, int timeout_ms) {
+    int rc = uring_submit_and_wait(cap->ring, 1, timeout_ms < 0 ? -1 : (int64_t)timeout_ms * 1000);
+    if (rc < 0 && rc != -EINTR && rc != -ETIME) {
+        errno = -rc;
+        return -1;
+    }
+    return reap_completions(cap, true);
+}
+
+// 等待并分发事件
+int input_capture_dispatch(InputCapture* cap, int timeout_ms) {
+    if (!cap) return -1;
+    if (cap->ring) return dispatch_ring(cap, timeout_ms);
+
+    struct epoll_event events[MAX_INPUT_DEVICES + 1];
+    int n = epoll_wait(cap->epoll_fd, events, MAX_INPUT_DEVICES + 1, timeout_ms);
+    if (n < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.u64 == 0) {
+            handle_inotify(cap);
+        } else {
+            // 热插拔可能已释放后续条目中的设备，新设备又可能重用同一地址，按编号确认设备仍存在
+            CapturedDevice* captured = find_device_by_id(cap, events[i].data.u64);
+            if (captured) {
+                handle_device(cap, &captured->dev);
+            }
+        }
+    }
+
+    return n;
+}
+
+// 当前捕获的设备数
+size_t input_capture_device_count(InputCapture* cap) {
+    return cap ? cap->device_count : 0;
+}
@@ -0,0 +1,90 @@
+#ifndef MOUSE_INPUT_CAPTURE_H
+#define MOUSE_INPUT_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/input.h>
+
+// 最多同时捕获的设备数
+#define MAX_INPUT_DEVICES 32
+
+// 设备类型（根据EVIOCGBIT能力位判断）
+typedef enum {
+    INPUT_DEVICE_MOUSE = 1,      // 相对坐标设备：鼠标、轨迹球
+    INPUT_DEVICE_TOUCHPAD = 2,   // 绝对坐标触摸板
+    INPUT_DEVICE_KEYBOARD = 3    // 键盘（只捕获指定的设备节点）
+} InputDeviceKind;
+
+// 键盘一帧内缓存的按键事件数，满时提前写出
+#define INPUT_DEVICE_MAX_KEYS 8
+
+// 被捕获的输入设备
+typedef struct {
+    int fd;                        // 设备文件描述符
+    char path[64];                 // 设备节点路径
+    char name[256];                // 设备名称
+    InputDeviceKind kind;          // 设备类型
+
+    // 以下字段由事件处理方使用
+    double dx, dy;                 // 当前帧累积移动
+    bool moved;                    // 当前帧是否有移动
+    int32_t wheel_x, wheel_y;      // 当前帧累积滚动（1/SCROLL_UNITS_PER_NOTCH格）
+    int32_t wheel_lo_x, wheel_lo_y; // 当前帧累积的普通滚轮格数
+    bool wheel_hi_res;             // 设备报告过高精度滚轮，之后忽略普通滚轮事件
+    bool frame_pushed;             // 当前帧是否写入了记录
+    bool syn_dropped;              // 是否正在丢弃直到下一个SYN_REPORT
+    uint8_t buttons;               // 该设备按下的按钮（MOUSE_BUTTON_*）
+    int abs_x, abs_y;              // 触摸板上一次的绝对位置
+    bool abs_valid;                // 触摸板上一次位置是否有效
+    bool touching;                 // 触摸板是否有手指按下
+    double abs_scale_x;            // 触摸板绝对坐标到相对移动的比例
+    double abs_scale_y;
+    struct {
+        uint16_t code;
+        uint8_t value;
+        uint32_t scancode;
+    } keys[INPUT_DEVICE_MAX_KEYS]; // 键盘当前帧的按键事件
+    size_t key_count;              // 当前帧缓存的按键事件数
+    uint32_t pending_scan;         // 下一个按键事件的扫描码（MSC_SCAN在EV_KEY之前）
+    uint8_t keys_down[KEY_MAX / 8 + 1]; // 键盘已发出按下、尚未释放的键
+} InputDevice;
+
+// 读到事件时的回调
+typedef void (*InputEventsCallback)(InputDevice* dev, struct input_event* events, size_t count, void* user_data);
+
+// 设备加入或移除时的回调
+typedef void (*InputDeviceCallback)(InputDevice* dev, bool added, void* user_data);
+
+// 设备捕获上下文
+typedef struct InputCapture InputCapture;
+
+// 初始化捕获上下文
+InputCapture* input_capture_init(void);
+
+// 释放捕获上下文并关闭所有设备
+void input_capture_cleanup(InputCapture* cap);
+
+// 设置回调函数
+void input_capture_set_callbacks(InputCapture* cap, InputEventsCallback on_events,
+                                 InputDeviceCallback on_device, void* user_data);
+
+// 指定要捕获的键盘设备节点（如/dev/input/event3或by-id下的链接），须在input_capture_start之前调用；
+// 键盘不按能力位自动发现，避免误捕获本机的其他键盘；拔出后同一节点重新出现时自动重新打开
+bool input_capture_set_keyboard(InputCapture* cap, const char* path);
+
+// 用io_uring代替epoll读取设备，须在input_capture_start之前调用：每个设备保持一个multishot读取，
+// 事件直接读入共用的提供缓冲区，每次唤醒只需一次io_uring_enter，不需要重新排队读取。
+// 内核不支持（6.7以下）或io_uring被禁用时返回false，继续使用epoll
+bool input_capture_use_io_uring(InputCapture* cap);
+
+// 开始捕获：监听/dev/input的热插拔并打开所有匹配的设备
+bool input_capture_start(InputCapture* cap);
+
+// 等待并分发事件，timeout_ms为-1时一直等待；返回处理的就绪数，出错返回-1
+int input_capture_dispatch(InputCapture* cap, int timeout_ms);
+
+// 当前捕获的设备数
+size_t input_capture_device_count(InputCapture* cap);
+
+#endif // MOUSE_INPUT_CAPTURE_H
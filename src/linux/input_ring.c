@@ -0,0 +1,195 @@
+#include "input_ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+// 缓存行大小，用于隔离生产者与消费者各自写入的字段
+#define CACHE_LINE_SIZE 64
+
+struct InputRing {
+    // 消费者写入
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t head;    // 下一个读取位置
+    atomic_uint_least64_t popped;                    // 取出计数
+    atomic_uint_least64_t coalesced;                 // 合并计数（双方写入）
+
+    // 生产者写入
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;    // 下一个写入位置
+    atomic_uint_least64_t pushed;                    // 写入计数
+    atomic_uint_least64_t overflow;                  // 溢出计数
+    InputRecord pending;                             // 因缓冲区满暂存的移动记录
+    bool has_pending;                                // 是否有暂存记录
+
+    // 只读
+    _Alignas(CACHE_LINE_SIZE) size_t mask;           // 容量-1
+    InputRecord* slots;                              // 记录数组
+};
+
+// 创建环形缓冲区
+InputRing* input_ring_init(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    InputRing* ring = (InputRing*)aligned_alloc(CACHE_LINE_SIZE, sizeof(InputRing));
+    if (!ring) return NULL;
+    memset(ring, 0, sizeof(InputRing));
+
+    ring->slots = (InputRecord*)calloc(size, sizeof(InputRecord));
+    if (!ring->slots) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->popped, 0);
+    atomic_init(&ring->coalesced, 0);
+    atomic_init(&ring->pushed, 0);
+    atomic_init(&ring->overflow, 0);
+    ring->has_pending = false;
+
+    return ring;
+}
+
+// 释放环形缓冲区
+void input_ring_cleanup(InputRing* ring) {
+    if (!ring) return;
+
+    free(ring->slots);
+    free(ring);
+}
+
+// 计数器自增（coalesced由生产者和消费者共同写入）
+static inline void counter_inc(atomic_uint_least64_t* counter) {
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+// 生产者：尝试写入一条记录
+static bool try_push(InputRing* ring, const InputRecord* record) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (tail - head > ring->mask) {
+        return false; // 已满
+    }
+
+    ring->slots[tail & ring->mask] = *record;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    counter_inc(&ring->pushed);
+    return true;
+}
+
+// 生产者：尝试写入暂存的移动记录
+bool input_ring_flush_pending(InputRing* ring) {
+    if (!ring) return false;
+
+    if (ring->has_pending && try_push(ring, &ring->pending)) {
+        ring->has_pending = false;
+    }
+    return ring->has_pending;
+}
+
+// 生产者：是否有暂存的移动记录
+bool input_ring_has_pending(InputRing* ring) {
+    return ring && ring->has_pending;
+}
+
+// 生产者：写入移动记录
+void input_ring_push_motion(InputRing* ring, const InputRecord* record) {
+    if (!ring || !record) return;
+
+    // 暂存的移动记录被新记录取代
+    if (ring->has_pending) {
+        ring->pending = *record;
+        counter_inc(&ring->coalesced);
+        input_ring_flush_pending(ring);
+        return;
+    }
+
+    if (!try_push(ring, record)) {
+        counter_inc(&ring->overflow);
+        ring->pending = *record;
+        ring->has_pending = true;
+    }
+}
+
+// 生产者：写入按钮记录
+void input_ring_push_button(InputRing* ring, const InputRecord* record) {
+    if (!ring || !record) return;
+
+    // 先写入之前的移动，保持顺序
+    bool counted = false;
+    while (input_ring_flush_pending(ring)) {
+        if (!counted) {
+            counter_inc(&ring->overflow);
+            counted = true;
+        }
+        sched_yield(); // 发送线程的实时优先级与读取线程相同，同一个CPU上也能轮到它取出记录
+    }
+
+    while (!try_push(ring, record)) {
+        if (!counted) {
+            counter_inc(&ring->overflow);
+            counted = true;
+        }
+        sched_yield();
+    }
+}
+
+// 生产者：写入滚动记录，与按钮记录一样不丢失
+void input_ring_push_scroll(InputRing* ring, const InputRecord* record) {
+    input_ring_push_button(ring, record);
+}
+
+// 生产者：写入按键记录，与按钮记录一样不丢失
+void input_ring_push_key(InputRing* ring, const InputRecord* record) {
+    input_ring_push_button(ring, record);
+}
+
+// 消费者：取出一条记录
+bool input_ring_pop(InputRing* ring, InputRecord* record) {
+    if (!ring || !record) return false;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head == tail) {
+        return false;
+    }
+
+    *record = ring->slots[head & ring->mask];
+    head++;
+
+    // 连续的移动记录只保留最新位置
+    if (record->type == INPUT_RECORD_MOTION) {
+        while (head != tail && ring->slots[head & ring->mask].type == INPUT_RECORD_MOTION) {
+            *record = ring->slots[head & ring->mask];
+            head++;
+            counter_inc(&ring->coalesced);
+        }
+    } else if (record->type == INPUT_RECORD_SCROLL) {
+        // 连续的滚动记录相加，时间取最早一条
+        while (head != tail && ring->slots[head & ring->mask].type == INPUT_RECORD_SCROLL) {
+            const InputRecord* next = &ring->slots[head & ring->mask];
+            record->wheel_x += next->wheel_x;
+            record->wheel_y += next->wheel_y;
+            head++;
+            counter_inc(&ring->coalesced);
+        }
+    }
+
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+    counter_inc(&ring->popped);
+    return true;
+}
+
+// 读取统计
+void input_ring_get_stats(InputRing* ring, InputRingStats* stats) {
+    if (!ring || !stats) return;
+
+    stats->pushed = atomic_load_explicit(&ring->pushed, memory_order_relaxed);
+    stats->popped = atomic_load_explicit(&ring->popped, memory_order_relaxed);
+    stats->coalesced = atomic_load_explicit(&ring->coalesced, memory_order_relaxed);
+    stats->overflow = atomic_load_explicit(&ring->overflow, memory_order_relaxed);
+}
@@ -0,0 +1,76 @@
+#ifndef MOUSE_INPUT_RING_H
+#define MOUSE_INPUT_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// 默认环形缓冲区容量（8kHz鼠标下约128毫秒）
+#define INPUT_RING_DEFAULT_CAPACITY 1024
+
+// 输入记录类型
+typedef enum {
+    INPUT_RECORD_MOTION = 1,   // 移动（可合并）
+    INPUT_RECORD_BUTTON = 2,   // 按钮边沿（不可合并、不可丢弃）
+    INPUT_RECORD_SCROLL = 3,   // 滚动（相加合并、不可丢弃）
+    INPUT_RECORD_KEY = 4       // 键盘按键（不可合并、不可丢弃）
+} InputRecordType;
+
+// 输入记录：读取线程产生，发送线程消费
+typedef struct {
+    uint8_t type;          // 记录类型，InputRecordType
+    uint8_t buttons;       // 该记录之后的按钮状态
+    float rel_x;           // X轴绝对位置（0.0-1.0）
+    float rel_y;           // Y轴绝对位置（0.0-1.0）
+    uint64_t capture_us;   // 内核采集事件的时间（微秒，CLOCK_MONOTONIC）
+    uint64_t read_us;      // 读取线程读到事件的时间（微秒，CLOCK_MONOTONIC）
+    int32_t wheel_x;       // 滚动记录：水平滚动量（1/SCROLL_UNITS_PER_NOTCH格）
+    int32_t wheel_y;       // 滚动记录：垂直滚动量，正值向上
+    uint16_t key_code;     // 按键记录：Linux键码
+    uint8_t key_value;     // 按键记录：0释放，1按下，2自动重复
+    bool key_frame_end;    // 按键记录：键盘一帧的最后一个按键
+    uint32_t key_scancode; // 按键记录：硬件扫描码，0表示未知
+} InputRecord;
+
+// 环形缓冲区统计
+typedef struct {
+    uint64_t pushed;       // 写入的记录数
+    uint64_t popped;       // 取出的记录数（合并后）
+    uint64_t coalesced;    // 被合并掉的移动和滚动记录数
+    uint64_t overflow;     // 写入时缓冲区已满的次数
+} InputRingStats;
+
+// 单生产者/单消费者无锁环形缓冲区
+typedef struct InputRing InputRing;
+
+// 创建环形缓冲区，容量向上取整为2的幂
+InputRing* input_ring_init(size_t capacity);
+
+// 释放环形缓冲区
+void input_ring_cleanup(InputRing* ring);
+
+// 生产者：写入移动记录，缓冲区满时暂存并与后续移动合并
+void input_ring_push_motion(InputRing* ring, const InputRecord* record);
+
+// 生产者：写入按钮记录，缓冲区满时等待消费者腾出空间，保证不丢失
+void input_ring_push_button(InputRing* ring, const InputRecord* record);
+
+// 生产者：写入滚动记录，缓冲区满时等待消费者腾出空间，保证滚动量不丢失
+void input_ring_push_scroll(InputRing* ring, const InputRecord* record);
+
+// 生产者：写入按键记录，缓冲区满时等待消费者腾出空间，保证不丢失
+void input_ring_push_key(InputRing* ring, const InputRecord* record);
+
+// 生产者：尝试写入此前因缓冲区满而暂存的移动记录，返回是否仍有暂存
+bool input_ring_flush_pending(InputRing* ring);
+
+// 生产者：是否有因缓冲区满而暂存的移动记录
+bool input_ring_has_pending(InputRing* ring);
+
+// 消费者：取出一条记录，连续的移动记录只保留最新一条，连续的滚动记录相加；没有记录时返回false
+bool input_ring_pop(InputRing* ring, InputRecord* record);
+
+// 读取统计（任意线程）
+void input_ring_get_stats(InputRing* ring, InputRingStats* stats);
+
+#endif // MOUSE_INPUT_RING_H
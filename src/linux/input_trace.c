@@ -0,0 +1,309 @@
+#include "input_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 录制文件的写缓冲区大小
+#define TRACE_WRITE_BUFFER 65536
+
+// 回放时一批最多的事件数（与读取时一次read()的上限相同）
+#define TRACE_BATCH_SIZE 64
+
+// 回放时最多的设备编号
+#define TRACE_MAX_DEVICES 256
+
+struct TraceWriter {
+    FILE* file;                                    // 录制文件
+    uint64_t last_us;                              // 上一条记录的时间
+    const InputDevice* devices[MAX_INPUT_DEVICES]; // 设备编号到设备
+};
+
+struct TraceReader {
+    int fd;                                        // 录制文件
+    const uint8_t* data;                           // 只读映射
+    size_t size;                                   // 文件大小
+    const TraceHeader* header;                     // 文件头
+    InputDevice* devices[TRACE_MAX_DEVICES];       // 回放创建的设备
+};
+
+// 单调时钟（微秒）
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// 创建录制文件
+TraceWriter* trace_writer_open(const char* path) {
+    if (!path) return NULL;
+
+    TraceWriter* writer = (TraceWriter*)calloc(1, sizeof(TraceWriter));
+    if (!writer) return NULL;
+
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        perror("无法创建录制文件");
+        free(writer);
+        return NULL;
+    }
+    setvbuf(writer->file, NULL, _IOFBF, TRACE_WRITE_BUFFER);
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.start_us = monotonic_us();
+    writer->last_us = header.start_us;
+
+    if (fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+        perror("无法写入录制文件");
+        fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+// 关闭录制文件
+void trace_writer_close(TraceWriter* writer) {
+    if (!writer) return;
+
+    fclose(writer->file);
+    free(writer);
+}
+
+// 写入一条记录，time_us早于上一条时记为同一时刻
+static void write_record(TraceWriter* writer, TraceRecord* record, uint64_t time_us) {
+    uint64_t delta = time_us > writer->last_us ? time_us - writer->last_us : 0;
+    record->delta_us = delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta;
+    writer->last_us += record->delta_us;
+
+    fwrite(record, sizeof(TraceRecord), 1, writer->file);
+}
+
+// 查找设备编号，没有时返回-1
+static int find_device(TraceWriter* writer, const InputDevice* dev) {
+    for (int i = 0; i < MAX_INPUT_DEVICES; i++) {
+        if (writer->devices[i] == dev) return i;
+    }
+    return -1;
+}
+
+// 记录设备加入或移除
+void trace_writer_device(TraceWriter* writer, const InputDevice* dev, bool added) {
+    if (!writer || !dev) return;
+
+    int id = find_device(writer, dev);
+    if (added) {
+        if (id >= 0) return;
+        id = find_device(writer, NULL);
+        if (id < 0) return;
+        writer->devices[id] = dev;
+    } else {
+        if (id < 0) return;
+        writer->devices[id] = NULL;
+    }
+
+    TraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.kind = added ? TRACE_RECORD_DEVICE_ADD : TRACE_RECORD_DEVICE_REMOVE;
+    record.device = (uint8_t)id;
+    write_record(writer, &record, monotonic_us());
+
+    if (added) {
+        TraceDevice desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.kind = (uint32_t)dev->kind;
+        desc.abs_scale_x = dev->abs_scale_x;
+        desc.abs_scale_y = dev->abs_scale_y;
+        snprintf(desc.name, sizeof(desc.name), "%.63s", dev->name);
+        fwrite(&desc, sizeof(desc), 1, writer->file);
+    }
+}
+
+// 记录一批事件
+void trace_writer_events(TraceWriter* writer, const InputDevice* dev,
+                         const struct input_event* events, size_t count) {
+    if (!writer || !dev || !events) return;
+
+    int id = find_device(writer, dev);
+    if (id < 0) {
+        trace_writer_device(writer, dev, true);
+        id = find_device(writer, dev);
+        if (id < 0) return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const struct input_event* ev = &events[i];
+
+        TraceRecord record;
+        memset(&record, 0, sizeof(record));
+        record.kind = TRACE_RECORD_EVENT;
+        record.device = (uint8_t)id;
+        record.flags = i == 0 ? TRACE_FLAG_BATCH : 0;
+        record.type = ev->type;
+        record.code = ev->code;
+        record.value = ev->value;
+        write_record(writer, &record,
+                     (uint64_t)ev->input_event_sec * 1000000 + (uint64_t)ev->input_event_usec);
+    }
+}
+
+// 打开录制文件
+TraceReader* trace_reader_open(const char* path) {
+    if (!path) return NULL;
+
+    TraceReader* reader = (TraceReader*)calloc(1, sizeof(TraceReader));
+    if (!reader) return NULL;
+
+    reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (reader->fd < 0) {
+        perror("无法打开录制文件");
+        free(reader);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(reader->fd, &st) < 0 || (size_t)st.st_size < sizeof(TraceHeader)) {
+        fprintf(stderr, "录制文件无效: %s\n", path);
+        close(reader->fd);
+        free(reader);
+        return NULL;
+    }
+    reader->size = (size_t)st.st_size;
+
+    void* data = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+    if (data == MAP_FAILED) {
+        perror("无法映射录制文件");
+        close(reader->fd);
+        free(reader);
+        return NULL;
+    }
+    madvise(data, reader->size, MADV_SEQUENTIAL);
+    reader->data = (const uint8_t*)data;
+    reader->header = (const TraceHeader*)data;
+
+    if (reader->header->magic != TRACE_MAGIC || reader->header->version != TRACE_VERSION ||
+        reader->header->record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "录制文件格式不支持: %s\n", path);
+        trace_reader_close(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+// 关闭录制文件
+void trace_reader_close(TraceReader* reader) {
+    if (!reader) return;
+
+    for (int i = 0; i < TRACE_MAX_DEVICES; i++) {
+        free(reader->devices[i]);
+    }
+    munmap((void*)reader->data, reader->size);
+    close(reader->fd);
+    free(reader);
+}
+
+// 等到回放时刻
+static void wait_until(uint64_t target_us) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(target_us / 1000000);
+    ts.tv_nsec = (long)(target_us % 1000000) * 1000;
+    // 被信号打断时直接返回，由调用者检查running
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+// 把积累的一批事件交给回调，时间戳改为当前时间
+static void flush_batch(InputDevice* dev, struct input_event* batch, size_t count,
+                        InputEventsCallback on_events, void* user_data) {
+    if (count == 0 || !dev || !on_events) return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for (size_t i = 0; i < count; i++) {
+        batch[i].input_event_sec = ts.tv_sec;
+        batch[i].input_event_usec = ts.tv_nsec / 1000;
+    }
+    on_events(dev, batch, count, user_data);
+}
+
+// 回放
+uint64_t trace_replay(TraceReader* reader, double speed, InputEventsCallback on_events,
+                      InputDeviceCallback on_device, void* user_data, volatile sig_atomic_t* running) {
+    if (!reader) return 0;
+
+    struct input_event batch[TRACE_BATCH_SIZE];
+    size_t batch_count = 0;
+    InputDevice* batch_dev = NULL;
+    uint64_t replayed = 0;
+
+    uint64_t trace_us = reader->header->start_us;
+    uint64_t replay_start_us = monotonic_us();
+    size_t pos = sizeof(TraceHeader);
+
+    // 末尾不完整的记录（录制时中途退出）直接忽略
+    while (pos + sizeof(TraceRecord) <= reader->size && (!running || *running)) {
+        TraceRecord record;
+        memcpy(&record, reader->data + pos, sizeof(record));
+        pos += sizeof(record);
+        trace_us += record.delta_us;
+
+        InputDevice* dev = reader->devices[record.device];
+        bool batch_end = record.kind != TRACE_RECORD_EVENT || (record.flags & TRACE_FLAG_BATCH) ||
+                         dev != batch_dev || batch_count == TRACE_BATCH_SIZE;
+        if (batch_end) {
+            flush_batch(batch_dev, batch, batch_count, on_events, user_data);
+            batch_count = 0;
+            batch_dev = dev;
+
+            // 按原来的时间间隔等待
+            if (speed > 0.0) {
+                wait_until(replay_start_us + (uint64_t)((double)(trace_us - reader->header->start_us) / speed));
+            }
+        }
+
+        if (record.kind == TRACE_RECORD_EVENT) {
+            if (!dev) continue; // 设备记录缺失
+            memset(&batch[batch_count], 0, sizeof(batch[batch_count]));
+            batch[batch_count].type = record.type;
+            batch[batch_count].code = record.code;
+            batch[batch_count].value = record.value;
+            batch_count++;
+            replayed++;
+        } else if (record.kind == TRACE_RECORD_DEVICE_ADD) {
+            if (pos + sizeof(TraceDevice) > reader->size) break;
+            TraceDevice desc;
+            memcpy(&desc, reader->data + pos, sizeof(desc));
+            pos += sizeof(desc);
+
+            if (dev) continue; // 重复加入
+            dev = (InputDevice*)calloc(1, sizeof(InputDevice));
+            if (!dev) break;
+            dev->fd = -1;
+            dev->kind = (InputDeviceKind)desc.kind;
+            dev->abs_scale_x = desc.abs_scale_x;
+            dev->abs_scale_y = desc.abs_scale_y;
+            snprintf(dev->path, sizeof(dev->path), "trace:%u", record.device);
+            snprintf(dev->name, sizeof(dev->name), "%.63s", desc.name);
+            reader->devices[record.device] = dev;
+            if (on_device) on_device(dev, true, user_data);
+        } else if (record.kind == TRACE_RECORD_DEVICE_REMOVE) {
+            if (!dev) continue;
+            if (on_device) on_device(dev, false, user_data);
+            free(dev);
+            reader->devices[record.device] = NULL;
+            batch_dev = NULL;
+        }
+    }
+
+    flush_batch(batch_dev, batch, batch_count, on_events, user_data);
+    return replayed;
+}
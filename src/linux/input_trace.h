@@ -0,0 +1,91 @@
+#ifndef MOUSE_INPUT_TRACE_H
+#define MOUSE_INPUT_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <signal.h>
+#include <linux/input.h>
+#include "input_capture.h"
+
+/*
+ * 输入事件录制文件（只追加写入，进程中途退出时已写入的部分仍可回放）
+ *
+ *   文件头  TraceHeader
+ *   记录    TraceRecord，每条16字节；TRACE_RECORD_DEVICE_ADD后紧跟一个TraceDevice
+ *
+ * 时间为内核事件时间戳（CLOCK_MONOTONIC），每条记录保存与上一条记录的差值。
+ * 一次read()读到的一批事件中，第一条事件带TRACE_FLAG_BATCH，回放时按原来的批次交给回调。
+ */
+
+#define TRACE_MAGIC 0x4352544DU    // "MTRC"
+#define TRACE_VERSION 1
+
+// 记录类型
+#define TRACE_RECORD_EVENT 1          // 一个input_event
+#define TRACE_RECORD_DEVICE_ADD 2     // 设备加入，后接TraceDevice
+#define TRACE_RECORD_DEVICE_REMOVE 3  // 设备移除
+
+// 记录标志
+#define TRACE_FLAG_BATCH 0x01         // 新一批事件的第一条
+
+// 文件头
+typedef struct {
+    uint32_t magic;        // TRACE_MAGIC
+    uint16_t version;      // TRACE_VERSION
+    uint16_t record_size;  // sizeof(TraceRecord)
+    uint64_t start_us;     // 第一条记录的时间差以此为基准
+} TraceHeader;
+
+// 一条记录
+typedef struct {
+    uint32_t delta_us;     // 与上一条记录的时间差（微秒）
+    uint8_t kind;          // 记录类型
+    uint8_t device;        // 设备编号
+    uint8_t flags;         // 记录标志
+    uint8_t reserved;
+    uint16_t type;         // 事件类型
+    uint16_t code;         // 事件代码
+    int32_t value;         // 事件值
+} TraceRecord;
+
+// 设备描述
+typedef struct {
+    uint32_t kind;         // InputDeviceKind
+    uint32_t reserved;
+    double abs_scale_x;    // 触摸板绝对坐标到相对移动的比例
+    double abs_scale_y;
+    char name[64];         // 设备名称
+} TraceDevice;
+
+// 录制
+typedef struct TraceWriter TraceWriter;
+
+// 回放
+typedef struct TraceReader TraceReader;
+
+// 创建录制文件（已存在时清空）
+TraceWriter* trace_writer_open(const char* path);
+
+// 关闭录制文件
+void trace_writer_close(TraceWriter* writer);
+
+// 记录一批事件（InputEventsCallback之前调用）
+void trace_writer_events(TraceWriter* writer, const InputDevice* dev,
+                         const struct input_event* events, size_t count);
+
+// 记录设备加入或移除
+void trace_writer_device(TraceWriter* writer, const InputDevice* dev, bool added);
+
+// 打开录制文件（mmap只读映射）
+TraceReader* trace_reader_open(const char* path);
+
+// 关闭录制文件，释放回放创建的设备
+void trace_reader_close(TraceReader* reader);
+
+// 回放：speed为1.0时按原来的时间间隔，为0时尽快回放；
+// 事件时间戳改为回放时的时间，*running变为0时提前结束。返回回放的事件数
+uint64_t trace_replay(TraceReader* reader, double speed, InputEventsCallback on_events,
+                      InputDeviceCallback on_device, void* user_data, volatile sig_atomic_t* running);
+
+#endif // MOUSE_INPUT_TRACE_H
@@ -0,0 +1,746 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/timerfd.h>
+#include <linux/input.h>
+#include "../common/network.h"
+#include "../common/predictor.h"
+#include "../common/jitter_buffer.h"
+#include "../common/log.h"
+#include "uinput_output.h"
+
+// 双击的最大间隔（秒）
+#define DOUBLE_CLICK_INTERVAL 0.3
+
+// 长按的时间（秒），之后进入拖动模式
+#define LONG_PRESS_TIME 0.5
+
+// 长按时为触发拖动而产生的微小移动（相对位置）
+#define DRAG_NUDGE (1.0f / 1000.0f)
+
+// 开启移动预测时更新光标位置的间隔（秒）
+#define PREDICT_TICK 0.004
+
+// 直接注入的按钮（左、中、右键另有点击和拖动处理）
+static const struct {
+    uint8_t mask;
+    uint16_t code;
+} extra_buttons[] = {
+    {MOUSE_BUTTON_SIDE, BTN_SIDE}, {MOUSE_BUTTON_EXTRA, BTN_EXTRA}, {MOUSE_BUTTON_FORWARD, BTN_FORWARD},
+    {MOUSE_BUTTON_BACK, BTN_BACK}, {MOUSE_BUTTON_TASK, BTN_TASK},
+};
+
+// 延迟统计的阶段
+enum {
+    LATENCY_CAPTURE = 0,   // 内核采集到发送端读取
+    LATENCY_QUEUE,         // 发送端读取到发出
+    LATENCY_NETWORK,       // 发出到接收端收到（需要时钟同步）
+    LATENCY_DISPATCH,      // 收到到注入uinput完成
+    LATENCY_TOTAL,         // 端到端
+    LATENCY_STAGE_COUNT
+};
+
+// 每秒的延迟统计（微秒）
+typedef struct {
+    uint64_t count[LATENCY_STAGE_COUNT];
+    uint64_t sum[LATENCY_STAGE_COUNT];
+    uint64_t max[LATENCY_STAGE_COUNT];
+} LatencyStats;
+
+// 应用程序状态
+typedef struct {
+    NetworkContext *network;      // 网络上下文
+    UinputOutput *output;         // uinput虚拟设备
+    UinputOutput *keyboard;       // uinput虚拟键盘，创建失败时不转发按键
+    uint8_t keys_down[KEY_MAX / 8 + 1]; // 已注入按下、尚未释放的键
+    uint32_t keys_owner;          // 按下这些键的发送端
+    uint16_t port;                // 监听端口
+    NetworkTransport transport;   // 传输方式
+    NetworkArbitration arbitration; // 多个发送端时的控制权仲裁策略
+    unsigned int hold_ms;         // 控制权保持时间
+    const char *priorities[NETWORK_MAX_PEERS]; // -P参数：<地址>:<优先级>
+    int priority_count;           // -P参数个数
+    uint8_t last_buttons;         // 上次按钮状态
+    float last_x, last_y;         // 上次鼠标位置
+    double last_click_time;       // 上次点击时间
+    bool double_click_pending;    // 双击挂起状态
+    int click_count;              // 当前点击次数
+    double button_down_time;      // 按钮按下时间
+    bool long_press_sent;         // 是否已发送长按事件
+    uint64_t last_message_id;     // 最后处理的消息ID
+    bool mousedown_sent;          // 是否已发送按下事件
+    bool mouseup_sent;            // 是否已发送释放事件
+    bool in_drag_mode;            // 是否处于拖动模式
+    int long_press_fd;            // 长按检测定时器（timerfd）
+    int stats_fd;                 // 每秒心跳和统计定时器（timerfd）
+    uint32_t move_owner;          // 最近一条移动消息的发送端
+    bool owner_changed;           // 换了发送端，预测需要重新开始
+    MotionPredictor predictor;    // 移动预测，-x参数开启
+    int predict_fd;               // 预测位置的更新定时器（timerfd）
+    bool predict_armed;           // 更新定时器是否在运行
+    JitterBuffer jitter;          // 移动消息的播放缓冲，-j参数开启
+    int playout_fd;               // 缓冲中最早一条消息的播放定时器（timerfd）
+    LatencyStats latency;         // 本秒的延迟统计
+} AppState;
+
+static volatile sig_atomic_t running = 1;
+
+// 信号处理
+static void handle_signal(int sig) {
+    (void)sig; // 避免未使用警告
+    running = 0;
+}
+
+// 当前时间（秒，单调时钟）
+static double current_time_s(void) {
+    return (double)network_time_us() / 1e6;
+}
+
+// 设置定时器，seconds为0时停止
+static void arm_timer(int fd, double seconds, bool repeat) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t)seconds;
+    spec.it_value.tv_nsec = (long)((seconds - (double)(time_t)seconds) * 1e9);
+    if (repeat) {
+        spec.it_interval = spec.it_value;
+    }
+    timerfd_settime(fd, 0, &spec, NULL);
+}
+
+// 长按后发送一个微小的拖动并移回，触发桌面的拖动操作
+static void send_drag_nudge(AppState *state) {
+    uinput_output_move(state->output, state->last_x + DRAG_NUDGE, state->last_y);
+    uinput_output_sync(state->output);
+    uinput_output_move(state->output, state->last_x, state->last_y);
+    uinput_output_sync(state->output);
+}
+
+// 进入长按拖动模式
+static void enter_drag_mode(AppState *state, double press_duration) {
+    state->long_press_sent = true;
+    state->in_drag_mode = true;
+    arm_timer(state->long_press_fd, 0, false);
+    LOG_INFO("检测到长按: %.2f秒，启用拖动模式", press_duration);
+    send_drag_nudge(state);
+}
+
+// 长按检测定时器到期
+static void long_press_timer_callback(AppState *state) {
+    if (!state->mousedown_sent || state->mouseup_sent || state->long_press_sent) {
+        return; // 不符合长按条件
+    }
+    enter_drag_mode(state, current_time_s() - state->button_down_time);
+}
+
+// 处理鼠标按钮事件
+static void handle_mouse_buttons(AppState *state, uint8_t current_buttons, uint8_t last_buttons,
+                                 uint64_t message_id) {
+    uint8_t changed_buttons = current_buttons ^ last_buttons;
+    double current_time = current_time_s();
+    bool button_state_changed = false;
+
+    // 防止重复处理同一个消息
+    if (message_id > 0 && message_id == state->last_message_id) {
+        LOG_DEBUG("忽略重复消息 ID: %llu", (unsigned long long)message_id);
+        return;
+    }
+
+    if (message_id > 0) {
+        state->last_message_id = message_id;
+    }
+
+    // 左键处理
+    if (changed_buttons & 0x01) {
+        button_state_changed = true;
+
+        if (current_buttons & 0x01) {
+            // 如果此时已经处理过点击，忽略重复的按下事件
+            if (state->mousedown_sent && !state->mouseup_sent) {
+                LOG_DEBUG("忽略重复的mousedown事件");
+                return;
+            }
+
+            // 记录按下时间，用于检测长按
+            state->button_down_time = current_time;
+            state->long_press_sent = false;
+            state->mousedown_sent = true;
+            state->mouseup_sent = false;
+            state->in_drag_mode = false;
+
+            // 计算与上次点击的时间间隔；双击由桌面按时间判断，这里只记录点击次数
+            double click_interval = current_time - state->last_click_time;
+            if (click_interval < DOUBLE_CLICK_INTERVAL && click_interval > 0.001 &&
+                state->double_click_pending) {
+                state->click_count = 2;
+                state->double_click_pending = false;
+                LOG_INFO("触发双击事件 (间隔: %.3f秒)", click_interval);
+            } else {
+                state->click_count = 1;
+            }
+
+            uinput_output_button(state->output, BTN_LEFT, true);
+            state->last_click_time = current_time;
+
+            // 启动长按检测定时器
+            arm_timer(state->long_press_fd, LONG_PRESS_TIME, false);
+        } else {
+            // 如果没有对应的按下事件，忽略此释放事件
+            if (!state->mousedown_sent || state->mouseup_sent) {
+                LOG_DEBUG("忽略孤立的mouseup事件");
+                return;
+            }
+
+            // 立即停止长按检测定时器
+            arm_timer(state->long_press_fd, 0, false);
+
+            state->mousedown_sent = false;
+            state->mouseup_sent = true;
+
+            uinput_output_button(state->output, BTN_LEFT, false);
+
+            // 长按或拖动后释放不算作双击的第一次点击
+            if (state->long_press_sent || state->in_drag_mode) {
+                state->double_click_pending = false;
+                LOG_DEBUG("长按或拖动释放: 重置双击状态");
+            } else if (state->click_count == 1) {
+                state->double_click_pending = true;
+            }
+
+            state->in_drag_mode = false;
+            state->long_press_sent = false;
+        }
+    } else if ((current_buttons & 0x01) && !state->long_press_sent &&
+               state->mousedown_sent && !state->mouseup_sent) {
+        // 左键保持按下，检查是否应该触发长按
+        double press_duration = current_time - state->button_down_time;
+        if (press_duration > LONG_PRESS_TIME) {
+            enter_drag_mode(state, press_duration);
+        }
+    }
+
+    // 右键和中键直接注入（不处理双击）
+    if (changed_buttons & 0x04) {
+        uinput_output_button(state->output, BTN_RIGHT, (current_buttons & 0x04) != 0);
+    }
+    if (changed_buttons & 0x02) {
+        uinput_output_button(state->output, BTN_MIDDLE, (current_buttons & 0x02) != 0);
+    }
+
+    // 侧键等其他按钮同样直接注入
+    for (int i = 0; i < (int)(sizeof(extra_buttons) / sizeof(extra_buttons[0])); i++) {
+        if (changed_buttons & extra_buttons[i].mask) {
+            uinput_output_button(state->output, extra_buttons[i].code,
+                                 (current_buttons & extra_buttons[i].mask) != 0);
+        }
+    }
+
+    // 若超过双击时间窗，重置双击状态
+    if (!button_state_changed && current_time - state->last_click_time > LONG_PRESS_TIME &&
+        state->double_click_pending && !(current_buttons & 0x01)) {
+        state->double_click_pending = false;
+    }
+}
+
+// 处理鼠标移动：按钮按下时的移动即为拖动
+static void handle_mouse_move(AppState *state, uint8_t current_buttons) {
+    if ((current_buttons & 0x01) && !state->in_drag_mode && state->mousedown_sent &&
+        !state->mouseup_sent && !state->long_press_sent) {
+        // 左键按下但尚未触发长按，检查是否现在应该触发
+        double press_duration = current_time_s() - state->button_down_time;
+        if (press_duration > LONG_PRESS_TIME) {
+            enter_drag_mode(state, press_duration);
+        }
+    }
+}
+
+// 记录一个阶段的延迟
+static void record_latency(LatencyStats *stats, int stage, int64_t us) {
+    if (us < 0) us = 0; // 时钟偏差估计的误差可能使结果略小于0
+    stats->count[stage]++;
+    stats->sum[stage] += (uint64_t)us;
+    if ((uint64_t)us > stats->max[stage]) {
+        stats->max[stage] = (uint64_t)us;
+    }
+}
+
+// 计算一条移动消息各阶段的延迟
+static void measure_latency(AppState *state, const MouseMoveMessage *mouse_msg) {
+    if (mouse_msg->timestamp == 0 || mouse_msg->receive_us == 0) return;
+
+    uint64_t done_us = network_time_us();
+    record_latency(&state->latency, LATENCY_CAPTURE, mouse_msg->read_delay_us);
+    record_latency(&state->latency, LATENCY_QUEUE, mouse_msg->queue_delay_us);
+    record_latency(&state->latency, LATENCY_DISPATCH, (int64_t)(done_us - mouse_msg->receive_us));
+
+    // 发送端时间换算到本地时钟后才能计算网络和端到端延迟
+    int64_t offset;
+    if (network_get_clock_offset(state->network, &offset, NULL)) {
+        int64_t capture_local = (int64_t)mouse_msg->timestamp - offset;
+        int64_t sent_local = capture_local + mouse_msg->read_delay_us + mouse_msg->queue_delay_us;
+        record_latency(&state->latency, LATENCY_NETWORK, (int64_t)mouse_msg->receive_us - sent_local);
+        record_latency(&state->latency, LATENCY_TOTAL, (int64_t)done_us - capture_local);
+    }
+}
+
+// 打印并清空本秒的延迟统计
+static void report_latency(AppState *state) {
+    static const char *names[LATENCY_STAGE_COUNT] = {"采集", "排队", "网络", "注入", "总计"};
+    LatencyStats *stats = &state->latency;
+
+    if (stats->count[LATENCY_DISPATCH] == 0) return;
+
+    printf("延迟(微秒, 平均/最大):");
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        if (stats->count[i] == 0) {
+            printf(" %s=-", names[i]);
+        } else {
+            printf(" %s=%llu/%llu", names[i], (unsigned long long)(stats->sum[i] / stats->count[i]),
+                   (unsigned long long)stats->max[i]);
+        }
+    }
+
+    uint64_t rtt;
+    if (network_get_clock_offset(state->network, NULL, &rtt)) {
+        printf(" 往返=%llu", (unsigned long long)rtt);
+    }
+    if (jitter_buffer_enabled(&state->jitter)) {
+        printf(" 缓冲=%u 抖动=%.0f", state->jitter.delay_us, state->jitter.jitter_us);
+    }
+    printf(" (%llu条)\n", (unsigned long long)stats->count[LATENCY_DISPATCH]);
+    fflush(stdout);
+
+    memset(stats, 0, sizeof(LatencyStats));
+}
+
+// 释放所有已注入按下的键
+static void release_keys(AppState *state) {
+    bool released = false;
+    for (unsigned int code = 0; code <= KEY_MAX; code++) {
+        if (state->keys_down[code / 8] & (1 << (code % 8))) {
+            uinput_output_key(state->keyboard, (uint16_t)code, 0, 0);
+            released = true;
+        }
+    }
+    memset(state->keys_down, 0, sizeof(state->keys_down));
+    if (released) {
+        uinput_output_sync(state->keyboard);
+    }
+}
+
+// 注入一帧按键；换了发送端时先释放之前发送端按下的键
+static void handle_keys(AppState *state, const KeyMessage *key_msg) {
+    if (!state->keyboard) return;
+
+    NetworkPeerInfo peer;
+    if (network_get_current_peer(state->network, &peer) && peer.id != state->keys_owner) {
+        release_keys(state);
+        state->keys_owner = peer.id;
+    }
+
+    for (uint8_t i = 0; i < key_msg->count; i++) {
+        const KeyEvent *key = &key_msg->keys[i];
+        if (key->code > KEY_MAX) continue;
+
+        uinput_output_key(state->keyboard, key->code, key->value, key->scancode);
+        if (key->value == KEY_VALUE_UP) {
+            state->keys_down[key->code / 8] &= (uint8_t)~(1 << (key->code % 8));
+        } else {
+            state->keys_down[key->code / 8] |= (uint8_t)(1 << (key->code % 8));
+        }
+    }
+    uinput_output_sync(state->keyboard);
+}
+
+// 预测位置需要继续更新时启动定时器，否则停止
+static void schedule_prediction(AppState *state, bool active) {
+    if (active != state->predict_armed) {
+        arm_timer(state->predict_fd, active ? PREDICT_TICK : 0, true);
+        state->predict_armed = active;
+    }
+}
+
+// 一条移动消息加入预测，得到这次应注入的位置；按钮变化时注入真实位置并暂停外推
+static void predict_move(AppState *state, const MouseMoveMessage *mouse_msg, bool button_changed,
+                         float *x, float *y) {
+    uint64_t now_us = network_time_us();
+
+    // 换了发送端时之前的样本不能用来估计速度
+    bool new_owner = state->owner_changed;
+    state->owner_changed = false;
+
+    if (button_changed || new_owner) {
+        predictor_reset(&state->predictor, mouse_msg->rel_x, mouse_msg->rel_y, now_us, button_changed);
+        schedule_prediction(state, false);
+        return;
+    }
+
+    // 速度按发送端的采集时间估计，外推从采集时刻（换算到本地时钟）算起，这样网络延迟也被抵消；
+    // 还没有时钟偏差估计时从收到的时刻算起
+    uint64_t receive_us = mouse_msg->receive_us ? mouse_msg->receive_us : now_us;
+    uint64_t sample_us = mouse_msg->timestamp ? mouse_msg->timestamp : receive_us;
+    uint64_t local_us = receive_us;
+    int64_t offset;
+    if (mouse_msg->timestamp && network_get_clock_offset(state->network, &offset, NULL)) {
+        local_us = (uint64_t)((int64_t)mouse_msg->timestamp - offset);
+    }
+
+    predictor_add_sample(&state->predictor, mouse_msg->rel_x, mouse_msg->rel_y, sample_us, local_us, now_us);
+    schedule_prediction(state, predictor_update(&state->predictor, now_us, x, y));
+}
+
+static void apply_move(AppState *state, const MouseMoveMessage *mouse_msg);
+
+// 按缓冲中最早一条消息的播放时间设置定时器，缓冲为空时停止
+static void schedule_playout(AppState *state) {
+    uint64_t due_us;
+    if (!jitter_buffer_next_due(&state->jitter, &due_us)) {
+        arm_timer(state->playout_fd, 0, false);
+        return;
+    }
+
+    // 已到时间的也至少等1微秒，定时器的值为0表示停止
+    uint64_t now_us = network_time_us();
+    uint64_t wait_us = due_us > now_us ? due_us - now_us : 1;
+    arm_timer(state->playout_fd, (double)wait_us / 1e6, false);
+}
+
+// 移动消息放入播放缓冲，返回true表示已放入或丢弃；按钮变化和没有采集时间的消息立即注入，
+// 缓冲中更早的移动不再播放，按钮变化那一帧的位置就是发送端的真实位置
+static bool buffer_move(AppState *state, const MouseMoveMessage *mouse_msg) {
+    if (mouse_msg->buttons != state->last_buttons || mouse_msg->timestamp == 0) {
+        jitter_buffer_clear(&state->jitter, false);
+        schedule_playout(state);
+        return false;
+    }
+
+    jitter_buffer_push(&state->jitter, mouse_msg, network_time_us());
+    schedule_playout(state);
+    return true;
+}
+
+// 处理消息回调
+static void message_callback(const Message *msg, size_t msg_size, void *user_data) {
+    (void)msg_size; // 避免未使用警告
+    AppState *state = (AppState *)user_data;
+
+    // 回复连接请求；没有显示器信息，刷新率为0表示不限制发送端
+    if (msg->type == MSG_CONNECT) {
+        ConnectMessage reply;
+        reply.type = MSG_CONNECT;
+        reply.version = msg->connect.version;
+        reply.refresh_hz = 0;
+        network_send_message(state->network, (const Message *)&reply, sizeof(reply));
+        return;
+    }
+
+    if (msg->type == MSG_KEY) {
+        handle_keys(state, &msg->key);
+        return;
+    }
+
+    // 滚动直接注入，不影响点击和拖动状态
+    if (msg->type == MSG_SCROLL) {
+        uinput_output_scroll(state->output, msg->scroll.delta_x, msg->scroll.delta_y);
+        uinput_output_sync(state->output);
+        return;
+    }
+
+    if (msg->type != MSG_MOUSE_MOVE) return;
+
+    const MouseMoveMessage *mouse_msg = &msg->mouse_move;
+
+    // 检查消息ID，避免重复处理
+    if (mouse_msg->sequence == state->last_message_id) {
+        return;
+    }
+
+    // 换了发送端时之前的样本不能用于预测和排期
+    NetworkPeerInfo peer;
+    if (network_get_current_peer(state->network, &peer) && peer.id != state->move_owner) {
+        state->move_owner = peer.id;
+        state->owner_changed = true;
+        jitter_buffer_clear(&state->jitter, true);
+    }
+
+    if (jitter_buffer_enabled(&state->jitter) && buffer_move(state, mouse_msg)) {
+        return;
+    }
+    apply_move(state, mouse_msg);
+}
+
+// 注入一条移动消息
+static void apply_move(AppState *state, const MouseMoveMessage *mouse_msg) {
+    // 位置总是先更新，按钮事件与移动在同一帧发出；开启预测时注入预测的位置
+    uint8_t current_buttons = mouse_msg->buttons;
+    float x = mouse_msg->rel_x;
+    float y = mouse_msg->rel_y;
+    if (predictor_enabled(&state->predictor)) {
+        predict_move(state, mouse_msg, current_buttons != state->last_buttons, &x, &y);
+    }
+    state->last_x = mouse_msg->rel_x;
+    state->last_y = mouse_msg->rel_y;
+    uinput_output_move(state->output, x, y);
+
+    if (current_buttons != state->last_buttons) {
+        uint8_t old_buttons = state->last_buttons;
+        state->last_buttons = current_buttons;
+        handle_mouse_buttons(state, current_buttons, old_buttons, mouse_msg->sequence);
+    } else {
+        state->last_message_id = mouse_msg->sequence;
+        handle_mouse_move(state, current_buttons);
+    }
+
+    uinput_output_sync(state->output);
+    measure_latency(state, mouse_msg);
+}
+
+// 解析并设置一个发送端优先级：<地址>:<优先级>
+static bool apply_priority(NetworkContext *network, const char *arg) {
+    const char *colon = strchr(arg, ':');
+    if (!colon || colon == arg || (size_t)(colon - arg) >= 16) return false;
+
+    char address[16];
+    memcpy(address, arg, (size_t)(colon - arg));
+    address[colon - arg] = '\0';
+    return network_set_peer_priority(network, address, atoi(colon + 1));
+}
+
+// 初始化应用程序
+static bool init_app(AppState *state, int argc, char **argv) {
+    memset(state, 0, sizeof(AppState));
+    state->long_press_fd = -1;
+    state->stats_fd = -1;
+    state->predict_fd = -1;
+    state->playout_fd = -1;
+
+    // 解析命令行参数：[端口] [-u] [-P 地址:优先级]... [-H 毫秒] [-x 毫秒] [-j 毫秒] [-l 级别]
+    state->port = DEFAULT_PORT;
+    state->transport = NETWORK_TRANSPORT_TCP;
+    state->arbitration = NETWORK_ARBITRATION_LAST_ACTIVE;
+    state->hold_ms = NETWORK_DEFAULT_HOLD_MS;
+    state->priority_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-u") == 0) {
+            state->transport = NETWORK_TRANSPORT_UDP;
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            // 按地址设置优先级，同时启用优先级仲裁
+            state->arbitration = NETWORK_ARBITRATION_PRIORITY;
+            if (state->priority_count < NETWORK_MAX_PEERS) {
+                state->priorities[state->priority_count++] = argv[++i];
+            } else {
+                i++;
+            }
+        } else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc) {
+            state->hold_ms = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            // 移动预测最多外推的时间
+            predictor_init(&state->predictor, (uint32_t)atoi(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            // 播放缓冲的最大延迟
+            jitter_buffer_init(&state->jitter, (uint32_t)atoi(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            LogLevel level;
+            if (!log_parse_level(argv[++i], &level)) {
+                fprintf(stderr, "无效的日志级别: %s（error、warn、info或debug）\n", argv[i]);
+                return false;
+            }
+            log_set_level(level);
+        } else {
+            state->port = (uint16_t)atoi(argv[i]);
+        }
+    }
+
+    state->output = uinput_output_init("mouse-receiver");
+    if (!state->output) {
+        return false;
+    }
+    state->keyboard = uinput_output_init_keyboard("mouse-receiver-keyboard");
+    if (!state->keyboard) {
+        fprintf(stderr, "无法创建虚拟键盘，不转发按键\n");
+    }
+
+    state->long_press_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    state->stats_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    state->predict_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    state->playout_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (state->long_press_fd < 0 || state->stats_fd < 0 || state->predict_fd < 0 || state->playout_fd < 0) {
+        perror("无法创建定时器");
+        return false;
+    }
+
+    // 初始化网络
+    state->network = network_init();
+    if (!state->network) {
+        fprintf(stderr, "无法初始化网络\n");
+        return false;
+    }
+
+    // 设置消息回调
+    network_set_callback(state->network, message_callback, state);
+
+    // 多个发送端同时连接时的控制权仲裁
+    network_set_arbitration(state->network, state->arbitration, state->hold_ms);
+    for (int i = 0; i < state->priority_count; i++) {
+        if (!apply_priority(state->network, state->priorities[i])) {
+            fprintf(stderr, "无效的优先级设置: %s（格式为 <地址>:<优先级>）\n", state->priorities[i]);
+        }
+    }
+
+    // 开始监听
+    if (!network_start_server_transport(state->network, state->port, state->transport)) {
+        fprintf(stderr, "无法监听端口 %d\n", state->port);
+        return false;
+    }
+
+    printf("开始监听端口 %d (%s)\n", state->port,
+           state->transport == NETWORK_TRANSPORT_UDP ? "UDP" : "TCP");
+    if (predictor_enabled(&state->predictor)) {
+        printf("移动预测已开启，最多外推 %u 毫秒\n", state->predictor.horizon_us / 1000);
+    }
+    if (jitter_buffer_enabled(&state->jitter)) {
+        printf("播放缓冲已开启，最多延迟 %u 毫秒\n", state->jitter.max_delay_us / 1000);
+    }
+    return true;
+}
+
+// 清理应用程序
+static void cleanup_app(AppState *state) {
+    if (state->network) {
+        network_cleanup(state->network);
+        state->network = NULL;
+    }
+    if (state->output) {
+        uinput_output_cleanup(state->output);
+        state->output = NULL;
+    }
+    if (state->keyboard) {
+        release_keys(state);
+        uinput_output_cleanup(state->keyboard);
+        state->keyboard = NULL;
+    }
+    if (state->long_press_fd >= 0) {
+        close(state->long_press_fd);
+        state->long_press_fd = -1;
+    }
+    if (state->stats_fd >= 0) {
+        close(state->stats_fd);
+        state->stats_fd = -1;
+    }
+    if (state->predict_fd >= 0) {
+        close(state->predict_fd);
+        state->predict_fd = -1;
+    }
+    if (state->playout_fd >= 0) {
+        close(state->playout_fd);
+        state->playout_fd = -1;
+    }
+}
+
+// 读取定时器到期次数，没有到期返回false
+static bool timer_expired(int fd) {
+    uint64_t expirations;
+    return read(fd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations);
+}
+
+// 长按检测定时器可读
+static void on_long_press_timer(int fd, void *user_data) {
+    if (timer_expired(fd)) {
+        long_press_timer_callback((AppState *)user_data);
+    }
+}
+
+// 每秒发送心跳估计与发送端的时钟偏差，并打印延迟统计
+static void on_stats_timer(int fd, void *user_data) {
+    AppState *state = (AppState *)user_data;
+    if (timer_expired(fd)) {
+        network_send_heartbeat(state->network);
+        report_latency(state);
+    }
+}
+
+// 预测定时器到期：注入推进后的预测位置，位置不再变化时停止定时器
+static void on_predict_timer(int fd, void *user_data) {
+    AppState *state = (AppState *)user_data;
+    if (!timer_expired(fd) || !state->predict_armed) return;
+
+    float x, y;
+    bool active = predictor_update(&state->predictor, network_time_us(), &x, &y);
+    uinput_output_move(state->output, x, y);
+    uinput_output_sync(state->output);
+    schedule_prediction(state, active);
+}
+
+// 播放定时器到期：注入所有已到播放时间的移动消息
+static void on_playout_timer(int fd, void *user_data) {
+    AppState *state = (AppState *)user_data;
+    if (!timer_expired(fd)) return;
+
+    MouseMoveMessage mouse_msg;
+    while (jitter_buffer_pop(&state->jitter, network_time_us(), &mouse_msg)) {
+        apply_move(state, &mouse_msg);
+    }
+    schedule_playout(state);
+}
+
+// 连接事件
+static void on_network_event(NetworkContext *ctx, NetworkEvent event, void *user_data) {
+    AppState *state = (AppState *)user_data;
+    NetworkPeerInfo peer;
+    if (!network_get_current_peer(ctx, &peer)) return;
+
+    if (event == NETWORK_EVENT_ACCEPT) {
+        LOG_INFO("发送端 #%u (%s:%u) 已连接，共%zu个", peer.id, peer.address, peer.port,
+                 network_get_peer_count(ctx));
+    } else if (event == NETWORK_EVENT_DISCONNECT) {
+        LOG_INFO("发送端 #%u (%s:%u) 已断开", peer.id, peer.address, peer.port);
+        // 断开的发送端按着的键不会再有释放事件
+        if (peer.id == state->keys_owner && state->keyboard) {
+            release_keys(state);
+        }
+    }
+}
+
+// 运行应用程序：消息到达、连接和定时器都在同一个事件循环中处理，空闲时阻塞
+static void run_app(AppState *state) {
+    network_set_event_callback(state->network, on_network_event, state);
+    if (!network_watch_fd(state->network, state->long_press_fd, on_long_press_timer, state) ||
+        !network_watch_fd(state->network, state->stats_fd, on_stats_timer, state) ||
+        !network_watch_fd(state->network, state->predict_fd, on_predict_timer, state) ||
+        !network_watch_fd(state->network, state->playout_fd, on_playout_timer, state)) {
+        fprintf(stderr, "无法关注定时器\n");
+        return;
+    }
+    arm_timer(state->stats_fd, 1.0, true);
+
+    if (!network_run(state->network, -1, &running)) {
+        perror("事件循环出错");
+    }
+}
+
+// 主函数
+int main(int argc, char **argv) {
+    AppState state;
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    // 初始化应用程序
+    if (!init_app(&state, argc, argv)) {
+        cleanup_app(&state);
+        return 1;
+    }
+
+    // 运行应用程序，事件循环中的日志由后台线程写出
+    log_start();
+    run_app(&state);
+
+    // 清理资源
+    cleanup_app(&state);
+    log_stop();
+    printf("程序正常退出\n");
+    return 0;
+}
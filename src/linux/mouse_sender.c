@@ -1,29 +1,24 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 #include <signal.h>
-#include <fcntl.h>
-#include <linux/input.h>
 #include <string.h>
-#include <dirent.h>
-#include <pthread.h>
-#include <math.h>
+#include <unistd.h>
 #include <errno.h>
 #include "../common/network.h"
+#include "input_capture.h"
+#include "input_trace.h"
+#include "sender.h"
+#include "realtime.h"
+#include "../common/log.h"
 
 // 全局状态
 static volatile sig_atomic_t running = 1;
-static NetworkContext *network = NULL;
-static pthread_t send_thread;
-static double last_rel_x = 0.0;
-static double last_rel_y = 0.0;
-static uint8_t button_state = 0; // 全局按钮状态
-static uint8_t last_sent_button_state = 0; // 上次发送的按钮状态
-static double move_threshold = 0.001; // 移动阈值
+static NetworkContext *networks[SENDER_MAX_TARGETS]; // 每个接收端一个连接
+static char network_names[SENDER_MAX_TARGETS][64];   // 打印用的接收端名称
+static size_t network_count = 0;
 static int screen_width = 1920;    // 默认屏幕宽度
 static int screen_height = 1080;   // 默认屏幕高度
-static uint64_t message_counter = 1; // 消息计数器，从1开始
-static bool force_send = false;    // 强制发送标志
+static TraceWriter *trace_writer = NULL; // 录制文件（-w）
 
 // 信号处理
 void handle_signal(int sig) {
@@ -31,167 +26,102 @@ void handle_signal(int sig) {
     running = 0;
 }
 
-// 查找鼠标设备
-char *find_mouse_device() {
-    DIR *dir;
-    struct dirent *entry;
-    static char device_path[256];
-    int fd;
-    char name[256];
-    
-    // 打开/dev/input目录
-    dir = opendir("/dev/input");
-    if (!dir) {
-        perror("无法打开/dev/input目录");
-        return NULL;
-    }
-    
-    // 遍历所有event设备
-    while ((entry = readdir(dir)) != NULL) {
-        if (strncmp(entry->d_name, "event", 5) == 0) {
-            snprintf(device_path, sizeof(device_path), "/dev/input/%s", entry->d_name);
-            
-            fd = open(device_path, O_RDONLY);
-            if (fd < 0) continue;
-            
-            // 获取设备名称
-            if (ioctl(fd, EVIOCGNAME(sizeof(name)), name) >= 0) {
-                if (strstr(name, "Mouse") || strstr(name, "mouse")) {
-                    printf("找到鼠标设备: %s (%s)\n", device_path, name);
-                    close(fd);
-                    closedir(dir);
-                    return device_path;
-                }
-            }
-            close(fd);
-        }
+// SIGUSR1：请求打印统计
+static void handle_stats_signal(int sig) {
+    (void)sig; // 避免未使用警告
+    sender_request_stats();
+}
+
+// 录制：先写入录制文件，再交给发送端处理
+static void record_events(InputDevice *dev, struct input_event *events, size_t count, void *user_data) {
+    trace_writer_events(trace_writer, dev, events, count);
+    sender_process_events(dev, events, count, user_data);
+}
+
+// 录制：设备加入或移除
+static void record_device_change(InputDevice *dev, bool added, void *user_data) {
+    trace_writer_device(trace_writer, dev, added);
+    sender_device_changed(dev, added, user_data);
+}
+
+// 关闭所有接收端的连接
+static void cleanup_networks(void) {
+    for (size_t i = 0; i < network_count; i++) {
+        network_cleanup(networks[i]);
     }
-    
-    closedir(dir);
-    return NULL;
+    network_count = 0;
 }
 
-// 发送线程函数
-void *send_thread_func(void *arg) {
-    (void)arg; // 避免未使用警告
+// 连接一个接收端，target为"地址"或"地址:端口"；TCP下暂时连不上的接收端同样加入，在后台重试，
+// 之后启动的接收端也能收到输入；UDP连接失败只打印警告，不影响其他接收端
+static void connect_target(const char *target, uint16_t default_port, NetworkTransport transport) {
+    char address[256];
+    uint16_t port = default_port;
+    snprintf(address, sizeof(address), "%s", target);
+    char *colon = strchr(address, ':');
+    if (colon) {
+        *colon = '\0';
+        port = (uint16_t)atoi(colon + 1);
+    }
     
-    while (running) {
-        // 准备消息
-        MouseMoveMessage msg;
-        msg.type = MSG_MOUSE_MOVE; // 修正：直接设置type字段，而不是header.type
-        msg.rel_x = last_rel_x;
-        msg.rel_y = last_rel_y;
-        msg.buttons = button_state;
-        msg.timestamp = message_counter;
-        
-        // 决定是否发送消息
-        // 1. 位置发生变化且超过阈值
-        // 2. 按钮状态发生变化
-        // 3. 强制发送标志为真
-        if (force_send || button_state != last_sent_button_state) {
-            // 发送消息
-            if (network_send_message(network, (Message*)&msg, sizeof(msg)) == 0) { // 修正：添加消息大小参数
-                printf("发送鼠标移动消息: x=%.2f, y=%.2f, 按钮=%u, ID=%lu\n", 
-                       msg.rel_x, msg.rel_y, msg.buttons, (unsigned long)msg.timestamp); // 修正：使用正确的格式说明符
-                
-                // 更新上次发送的按钮状态
-                last_sent_button_state = button_state;
-                message_counter++; // 修改：直接更新计数器，不需要中间变量
-                force_send = false;
-            } else {
-                fprintf(stderr, "发送消息失败\n");
-            }
-        }
-        
-        // 休眠一段时间
-        usleep(10000); // 10毫秒
+    NetworkContext *net = network_init();
+    if (!net) {
+        fprintf(stderr, "无法初始化网络\n");
+        return;
+    }
+    
+    bool ok = transport == NETWORK_TRANSPORT_TCP ? network_connect_or_retry(net, address, port)
+                                                 : network_connect_transport(net, address, port, transport);
+    if (!ok) {
+        fprintf(stderr, "无法连接到服务器 %s:%d，跳过\n", address, port);
+        network_cleanup(net);
+        return;
     }
     
-    return NULL;
+    char *name = network_names[network_count];
+    snprintf(name, sizeof(network_names[0]), "%.56s:%d", address, port);
+    if (!sender_add_target(net, name)) {
+        network_cleanup(net);
+        return;
+    }
+    networks[network_count++] = net;
+    if (network_get_fd(net) >= 0) {
+        printf("已连接到服务器 %s\n", name);
+    } else {
+        printf("暂时无法连接到服务器 %s，将在后台重试\n", name);
+    }
 }
 
-// 处理鼠标事件
-void process_mouse_event(struct input_event *ev, double screen_width, double screen_height) {
-    (void)screen_width;  // 避免未使用警告
-    (void)screen_height; // 避免未使用警告
+// 回放录制文件代替设备捕获
+static void replay_trace(const char *path, bool fast) {
+    TraceReader *reader = trace_reader_open(path);
+    if (!reader) return;
     
-    static int dx = 0, dy = 0;
-    static bool moved = false;
+    printf("回放录制文件: %s (%s)\n", path, fast ? "尽快" : "实时");
+    uint64_t replayed = trace_replay(reader, fast ? 0.0 : 1.0, sender_process_events,
+                                     sender_device_changed, NULL, &running);
+    printf("回放完成，共 %llu 个事件\n", (unsigned long long)replayed);
     
-    if (ev->type == EV_REL) {
-        // 鼠标相对移动
-        if (ev->code == REL_X) {
-            dx += ev->value;
-            moved = true;
-        } else if (ev->code == REL_Y) {
-            dy += ev->value;
-            moved = true;
-        }
-    } else if (ev->type == EV_KEY) {
-        // 按键事件
-        if (ev->code == BTN_LEFT) {
-            // 左键
-            if (ev->value) {
-                button_state |= 0x01; // 按下
-                printf("左键按下, 按钮状态: %d\n", button_state);
-            } else {
-                button_state &= ~0x01; // 释放
-                printf("左键释放, 按钮状态: %d\n", button_state);
-            }
-            force_send = true; // 强制发送按键事件
-        } else if (ev->code == BTN_MIDDLE) {
-            // 中键
-            if (ev->value) {
-                button_state |= 0x02; // 按下
-                printf("中键按下, 按钮状态: %d\n", button_state);
-            } else {
-                button_state &= ~0x02; // 释放
-                printf("中键释放, 按钮状态: %d\n", button_state);
-            }
-            force_send = true; // 强制发送按键事件
-        } else if (ev->code == BTN_RIGHT) {
-            // 右键
-            if (ev->value) {
-                button_state |= 0x04; // 按下
-                printf("右键按下, 按钮状态: %d\n", button_state);
-            } else {
-                button_state &= ~0x04; // 释放
-                printf("右键释放, 按钮状态: %d\n", button_state);
-            }
-            force_send = true; // 强制发送按键事件
-        }
-    } else if (ev->type == EV_SYN && moved) {
-        // 同步事件，处理累积的移动
-        double rel_x = (double)dx / 1000.0;
-        double rel_y = (double)dy / 1000.0;
-        
-        // 计算相对屏幕位置
-        last_rel_x += rel_x;
-        last_rel_y += rel_y;
-        
-        // 确保值在0.0-1.0范围内
-        if (last_rel_x < 0.0) last_rel_x = 0.0;
-        if (last_rel_x > 1.0) last_rel_x = 1.0;
-        if (last_rel_y < 0.0) last_rel_y = 0.0;
-        if (last_rel_y > 1.0) last_rel_y = 1.0;
-        
-        // 如果移动足够大，设置force_send为true
-        if (fabs(rel_x) > move_threshold || fabs(rel_y) > move_threshold) { // 修正：使用fabs替代abs
-            force_send = true;
-        }
-        
-        // 重置累积值
-        dx = 0;
-        dy = 0;
-        moved = false;
-    }
+    // 剩余的记录由sender_stop发出，发送队列写出后才返回
+    trace_reader_close(reader);
 }
 
 int main(int argc, char **argv) {
-    char *device_path;
-    int fd;
+    InputCapture *capture;
     uint16_t port = DEFAULT_PORT;
-    char server_address[256] = "127.0.0.1"; // 默认为本地回环地址
+    const char *server_addresses[SENDER_MAX_TARGETS]; // -s 可重复，同一份输入发给所有接收端
+    size_t server_count = 0;
+    NetworkTransport transport = NETWORK_TRANSPORT_TCP;
+    SenderConfig config = {0, false, NULL, false};
+    const char *record_path = NULL;    // -w 录制文件
+    const char *replay_path = NULL;    // -R 回放文件
+    bool replay_fast = false;          // -n 尽快回放，不按原来的时间间隔
+    const char *keyboard_path = NULL;  // -k 转发的键盘设备节点
+    bool use_io_uring = false;         // -i 用io_uring读取输入设备和发送
+    RealtimeConfig realtime;           // --realtime 实时优先级、--cpu 绑定CPU
+    unsigned int busy_poll_us = 0;     // --busy-poll 套接字忙等待时间
+    realtime_config_init(&realtime);
+    config.realtime = &realtime;
     
     // 处理命令行参数
     for (int i = 1; i < argc; i++) {
@@ -199,76 +129,176 @@ int main(int argc, char **argv) {
             port = atoi(argv[i + 1]);
             i++;
         } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
-            strncpy(server_address, argv[i + 1], sizeof(server_address) - 1);
+            if (server_count < SENDER_MAX_TARGETS) {
+                server_addresses[server_count++] = argv[i + 1];
+            } else {
+                fprintf(stderr, "接收端过多，最多%d个，忽略 %s\n", SENDER_MAX_TARGETS, argv[i + 1]);
+            }
             i++;
         } else if (strcmp(argv[i], "-r") == 0 && i + 2 < argc) {
             screen_width = atoi(argv[i + 1]);
             screen_height = atoi(argv[i + 2]);
             i += 2;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            transport = NETWORK_TRANSPORT_UDP;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            config.emit_rate_hz = (unsigned int)atoi(argv[i + 1]);
+            config.rate_fixed = true;
+            i++;
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            record_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+            replay_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-n") == 0) {
+            replay_fast = true;
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            keyboard_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-i") == 0) {
+            use_io_uring = true;
+            config.use_io_uring = true;
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            realtime.enabled = true;
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            if (!realtime_parse_cpus(&realtime, argv[i + 1])) {
+                fprintf(stderr, "无效的CPU: %s\n", argv[i + 1]);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--busy-poll") == 0 && i + 1 < argc) {
+            busy_poll_us = (unsigned int)atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            LogLevel level;
+            if (!log_parse_level(argv[i + 1], &level)) {
+                fprintf(stderr, "无效的日志级别: %s（error、warn、info或debug）\n", argv[i + 1]);
+                return 1;
+            }
+            log_set_level(level);
+            i++;
         }
     }
     
-    printf("服务器: %s, 端口: %d\n", server_address, port);
+    if (server_count == 0) {
+        server_addresses[server_count++] = "127.0.0.1"; // 默认为本地回环地址
+    }
+    
+    printf("接收端: %zu 个, 默认端口: %d, 传输: %s\n", server_count, port,
+           transport == NETWORK_TRANSPORT_UDP ? "UDP" : "TCP");
     printf("目标屏幕分辨率: %d x %d\n", screen_width, screen_height);
     
     // 设置信号处理
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGUSR1, handle_stats_signal);
     
-    // 查找鼠标设备
-    device_path = find_mouse_device();
-    if (!device_path) {
-        fprintf(stderr, "未找到鼠标设备\n");
-        return 1;
+    // 实时模式：先锁定内存，之后分配的缓冲区（环形缓冲区、网络上下文）也常驻内存
+    if (realtime.enabled) {
+        printf("实时模式: 读取线程SCHED_FIFO %d, 发送线程SCHED_FIFO %d\n",
+               realtime.reader_priority, realtime.sender_priority);
+        realtime_lock_memory();
     }
     
-    // 打开鼠标设备
-    fd = open(device_path, O_RDONLY);
-    if (fd < 0) {
-        perror("无法打开鼠标设备");
+    // 初始化设备捕获，回调在input_capture_start之后才会用到环形缓冲区
+    capture = input_capture_init();
+    if (!capture) {
+        fprintf(stderr, "无法初始化设备捕获\n");
+        return 1;
+    }
+    if (keyboard_path && !input_capture_set_keyboard(capture, keyboard_path)) {
+        fprintf(stderr, "无效的键盘设备: %s\n", keyboard_path);
+        input_capture_cleanup(capture);
         return 1;
     }
+    if (use_io_uring && !replay_path) {
+        if (input_capture_use_io_uring(capture)) {
+            printf("输入设备读取: io_uring\n");
+        } else {
+            perror("无法使用io_uring，改用epoll");
+        }
+    }
+    if (record_path) {
+        trace_writer = trace_writer_open(record_path);
+        if (!trace_writer) {
+            input_capture_cleanup(capture);
+            return 1;
+        }
+        printf("录制输入事件到: %s\n", record_path);
+        input_capture_set_callbacks(capture, record_events, record_device_change, NULL);
+    } else {
+        input_capture_set_callbacks(capture, sender_process_events, sender_device_changed, NULL);
+    }
     
-    // 初始化网络
-    network = network_init();
-    if (!network) {
-        fprintf(stderr, "无法初始化网络\n");
-        close(fd);
+    // 连接所有接收端，每个接收端一个独立的网络上下文
+    for (size_t i = 0; i < server_count; i++) {
+        connect_target(server_addresses[i], port, transport);
+    }
+    // 每个接收端分别设置，某个套接字失败不影响其他接收端，失败的逐个打印
+    for (size_t i = 0; busy_poll_us > 0 && i < network_count; i++) {
+        if (!network_set_busy_poll(networks[i], busy_poll_us)) {
+            fprintf(stderr, "接收端 %s 无法设置SO_BUSY_POLL（超过net.core.busy_read时需要CAP_NET_ADMIN）: %s\n",
+                    network_names[i], strerror(errno));
+        }
+    }
+    if (network_count == 0) {
+        fprintf(stderr, "没有可用的接收端\n");
+        sender_cleanup();
+        input_capture_cleanup(capture);
+        trace_writer_close(trace_writer);
         return 1;
     }
     
-    // 连接到服务器
-    if (!network_connect(network, server_address, port)) {
-        fprintf(stderr, "无法连接到服务器 %s:%d\n", server_address, port);
-        network_cleanup(network);
-        close(fd);
+    // 日志线程在发送线程之前创建，发送线程的日志从一开始就异步写出；
+    // 它在读取线程设置之前创建，使用普通调度，不和实时线程争抢CPU
+    log_start();
+    
+    // 创建事件环形缓冲区并启动发送线程
+    if (!sender_start(&config)) {
+        log_stop();
+        sender_cleanup();
+        cleanup_networks();
+        input_capture_cleanup(capture);
+        trace_writer_close(trace_writer);
         return 1;
     }
     
-    printf("已连接到服务器 %s:%d\n", server_address, port);
+    // 读取线程（主线程）在发送线程创建之后才设置，发送线程不继承它的优先级和CPU
+    realtime_setup_thread("读取线程", realtime.enabled ? realtime.reader_priority : 0, realtime.reader_cpu);
     
-    // 创建发送线程
-    pthread_create(&send_thread, NULL, send_thread_func, NULL);
+    if (replay_path) {
+        // 回放模式：不捕获设备，回放结束后退出
+        replay_trace(replay_path, replay_fast);
+        running = 0;
+    } else if (!input_capture_start(capture)) {
+        // 打开所有指针设备并监听热插拔
+        fprintf(stderr, "无法开始捕获输入设备\n");
+        running = 0;
+    } else if (input_capture_device_count(capture) == 0) {
+        printf("暂未找到鼠标设备，等待设备插入...\n");
+    }
     
-    // 主事件循环
+    // 主事件循环：所有设备和热插拔通知共用一个epoll（或io_uring）
+    // 环形缓冲区满时暂存了移动则短暂等待，没有新事件也能重试写入
     while (running) {
-        struct input_event ev;
-        ssize_t n = read(fd, &ev, sizeof(ev));
-        
-        if (n == sizeof(ev)) {
-            process_mouse_event(&ev, screen_width, screen_height);
-        } else if (n < 0 && errno != EINTR) {
-            perror("读取鼠标事件失败");
+        int timeout_ms = sender_flush_pending() ? SENDER_RETRY_MS : -1;
+        if (input_capture_dispatch(capture, timeout_ms) < 0) {
+            perror("等待输入事件失败");
             break;
         }
     }
     
-    // 等待发送线程结束
-    pthread_join(send_thread, NULL);
+    // 唤醒并等待发送线程结束
+    sender_stop();
+    log_stop();
+    sender_print_stats();
     
     // 清理
-    network_cleanup(network);
-    close(fd);
+    input_capture_cleanup(capture);
+    trace_writer_close(trace_writer);
+    sender_cleanup();
+    cleanup_networks();
     
     printf("程序正常退出\n");
     return 0;
@@ -0,0 +1,107 @@
+#define _GNU_SOURCE // pthread_setaffinity_np
+#include "realtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+// 线程开始时预先触碰的栈大小
+#define PREFAULT_STACK_SIZE (256 * 1024)
+
+// 默认设置
+void realtime_config_init(RealtimeConfig* config) {
+    if (!config) return;
+
+    config->enabled = false;
+    config->reader_priority = REALTIME_DEFAULT_PRIORITY;
+    config->sender_priority = REALTIME_DEFAULT_PRIORITY;
+    config->reader_cpu = -1;
+    config->sender_cpu = -1;
+}
+
+// 解析一个CPU编号，空字符串表示不绑定
+static bool parse_cpu(const char* text, size_t len, int* cpu) {
+    if (len == 0) {
+        *cpu = -1;
+        return true;
+    }
+
+    char buf[16];
+    if (len >= sizeof(buf)) return false;
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+
+    char* end;
+    long value = strtol(buf, &end, 10);
+    if (*end != '\0' || value < -1 || value >= CPU_SETSIZE) return false;
+    *cpu = (int)value;
+    return true;
+}
+
+// 解析"读取CPU,发送CPU"
+bool realtime_parse_cpus(RealtimeConfig* config, const char* text) {
+    if (!config || !text) return false;
+
+    const char* comma = strchr(text, ',');
+    if (!comma) {
+        return parse_cpu(text, strlen(text), &config->reader_cpu);
+    }
+    return parse_cpu(text, (size_t)(comma - text), &config->reader_cpu) &&
+           parse_cpu(comma + 1, strlen(comma + 1), &config->sender_cpu);
+}
+
+// 锁定内存
+bool realtime_lock_memory(void) {
+    // 释放的内存留在进程中，之后的分配不再缺页；大块分配也从堆中分配，同样保持锁定
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        fprintf(stderr, "无法锁定内存（需要CAP_IPC_LOCK或足够的RLIMIT_MEMLOCK）: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// 预先触碰栈，之后的函数调用不会在栈上缺页
+static void __attribute__((noinline)) prefault_stack(void) {
+    volatile char stack[PREFAULT_STACK_SIZE];
+    for (size_t i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+// 设置当前线程
+bool realtime_setup_thread(const char* name, int priority, int cpu) {
+    bool ok = true;
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) {
+            fprintf(stderr, "%s无法绑定到CPU %d: %s\n", name, cpu, strerror(rc));
+            ok = false;
+        }
+    }
+
+    if (priority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (rc != 0) {
+            fprintf(stderr, "%s无法使用SCHED_FIFO优先级%d（需要CAP_SYS_NICE或足够的RLIMIT_RTPRIO）: %s\n",
+                    name, priority, strerror(rc));
+            ok = false;
+        }
+        prefault_stack();
+    }
+
+    return ok;
+}
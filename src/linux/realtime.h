@@ -0,0 +1,41 @@
+#ifndef MOUSE_REALTIME_H
+#define MOUSE_REALTIME_H
+
+#include <stdbool.h>
+
+/*
+ * 发送端的实时模式
+ *
+ * 桌面繁忙时读取线程和发送线程被其他进程抢占，输入延迟出现尖峰。实时模式下：
+ * 两个线程使用SCHED_FIFO优先级，可以各自绑定到一个CPU；
+ * 进程内存全部锁定（之后分配的内存也常驻），线程开始时预先触碰栈，运行中不发生缺页。
+ * 需要的权限（CAP_SYS_NICE/RLIMIT_RTPRIO、CAP_IPC_LOCK/RLIMIT_MEMLOCK）不足时打印原因，其余设置照常生效。
+ */
+
+// 读取线程和发送线程的默认SCHED_FIFO优先级。两者相同：缓冲区满时读取线程sched_yield，
+// 只有同优先级的发送线程才能在同一个CPU上运行并取出记录，发送线程优先级更低时会一直等下去
+#define REALTIME_DEFAULT_PRIORITY 50
+
+// 实时模式设置
+typedef struct {
+    bool enabled;                  // 是否使用SCHED_FIFO并锁定内存
+    int reader_priority;           // 读取线程的SCHED_FIFO优先级
+    int sender_priority;           // 发送线程的SCHED_FIFO优先级
+    int reader_cpu;                // 读取线程绑定的CPU，-1表示不绑定
+    int sender_cpu;                // 发送线程绑定的CPU，-1表示不绑定
+} RealtimeConfig;
+
+// 默认设置：不开启，优先级为默认值，不绑定CPU
+void realtime_config_init(RealtimeConfig* config);
+
+// 解析"读取CPU,发送CPU"，任一项可以省略或为-1（不绑定）
+bool realtime_parse_cpus(RealtimeConfig* config, const char* text);
+
+// 锁定进程的全部内存，并禁止malloc把内存还给系统；失败时打印原因
+bool realtime_lock_memory(void);
+
+// 设置当前线程：priority大于0时使用SCHED_FIFO，cpu不小于0时绑定到该CPU，并预先触碰栈；
+// name用于打印，失败时打印原因，返回是否全部成功
+bool realtime_setup_thread(const char* name, int priority, int cpu);
+
+#endif // MOUSE_REALTIME_H
@@ -0,0 +1,1143 @@
+#define _GNU_SOURCE // ppoll
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <math.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <time.h>
+#include "sender.h"
+#include "input_ring.h"
+#include "uring.h"
+#include "../common/log.h"
+
+// 停止时等待各接收端的发送队列写出的最长时间
+#define DRAIN_TIMEOUT_MS 2000
+
+// 发送线程io_uring请求的标签：高32位为类型，其次16位为接收端序号，低16位为发送在链中的序号
+#define RING_TAG_WAKE 1            // 读取eventfd
+#define RING_TAG_POLL 2            // 接收端套接字的poll
+#define RING_TAG_SEND 3            // 链接的发送
+#define RING_TAG_CANCEL 4          // 取消请求本身的完成
+#define RING_TAG(kind, target, index) (((uint64_t)(kind) << 32) | ((uint64_t)(target) << 16) | (uint64_t)(index))
+
+// 每个接收端一次最多提交多少个链接的发送：每帧一个，跨越发送缓冲区末尾的帧两个
+#define RING_CHAIN_MAX 32
+
+// 发送线程io_uring的提交队列大小：每个接收端一条发送链或它的取消、一个poll和它的取消，加上eventfd的读取
+#define RING_ENTRIES (SENDER_MAX_TARGETS * (RING_CHAIN_MAX + 2) + 1)
+
+// 提交了发送链时最多等待这么久：发送通常在提交时就已写出，与读取线程的通知一起等待；
+// 套接字已满时发送被挂起，不能因此耽误处理新的输入
+#define RING_SEND_WAIT_US 1000
+
+// 一个接收端
+typedef struct {
+    NetworkContext *network;       // 到该接收端的连接
+    char name[64];                 // 打印用的名称
+    unsigned int refresh_hz;       // 接收端在连接回复中告知的刷新率
+    uint64_t fail_reported_us;     // 上次打印发送失败的时间
+    uint32_t ring_poll_conn;       // io_uring：已排队的poll所在的连接编号，0表示没有
+    bool ring_poll_cancelled;      // io_uring：连接已变化，已排队取消poll
+    uint32_t ring_send_conn;       // io_uring：正在写出的发送链所在的连接编号
+    unsigned int ring_send_count;  // io_uring：发送链中的发送数，0表示没有
+    size_t ring_send_lens[RING_CHAIN_MAX]; // io_uring：发送链中每个发送的长度
+    bool ring_send_cancelled;      // io_uring：连接已变化，已排队取消发送链
+    bool ring_send_fresh;          // io_uring：发送链在这一次等待时才提交
+} SenderTarget;
+
+// 全局状态
+static volatile sig_atomic_t running = 0; // 发送线程是否运行
+static volatile sig_atomic_t stats_requested = 0; // 收到统计请求，由发送线程打印
+static SenderTarget targets[SENDER_MAX_TARGETS]; // 接收端，每个有独立的非阻塞发送队列（仅发送线程访问）
+static size_t target_count = 0;
+static pthread_t send_thread;
+static InputRing *input_ring = NULL; // 读取线程到发送线程的事件环形缓冲区
+static double last_rel_x = 0.0;    // 当前位置（仅读取线程访问）
+static double last_rel_y = 0.0;
+static uint8_t button_state = 0;   // 当前按钮状态，所有设备的合集（仅读取线程访问）
+static int button_holders[MOUSE_BUTTON_COUNT] = {0}; // 每个按钮被多少个设备按下
+static double move_threshold = 0.001; // 移动阈值
+static uint64_t message_counter = 1; // 消息计数器，从1开始（仅发送线程访问）
+static int send_event_fd = -1;     // 读取线程通知发送线程的eventfd
+static uint64_t emit_interval_us = 0; // 移动消息的最小发送间隔，0表示不限速（仅发送线程访问）
+static bool rate_fixed = false;    // 发送频率由配置指定，不采用接收端协商的值
+static uint64_t rate_coalesced = 0;  // 因限速被合并的移动和滚动记录数（仅发送线程访问）
+static uint64_t batch_read_us = 0;   // 当前这批事件被读到的时间（仅读取线程访问）
+static RealtimeConfig realtime;      // 发送线程的实时模式设置
+static Uring *send_ring = NULL;      // 发送线程的io_uring，NULL时使用ppoll和sendmsg
+static uint64_t ring_wakeups;        // io_uring读取eventfd的缓冲区（仅发送线程访问）
+static bool ring_wake_queued = false; // eventfd的读取已排队（仅发送线程访问）
+static struct rusage thread_usage;   // 发送线程的CPU时间和上下文切换，打印统计前和退出时由发送线程更新
+static bool thread_usage_valid = false;
+
+// evdev按键与按钮位的对应，按钮位i对应第i项
+static const struct {
+    uint16_t code;
+    const char *name;
+} button_codes[MOUSE_BUTTON_COUNT] = {
+    {BTN_LEFT, "左键"}, {BTN_MIDDLE, "中键"}, {BTN_RIGHT, "右键"}, {BTN_SIDE, "侧键"},
+    {BTN_EXTRA, "额外键"}, {BTN_FORWARD, "前进键"}, {BTN_BACK, "后退键"}, {BTN_TASK, "任务键"},
+};
+
+// 获取单调时钟（微秒）
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// 设置移动消息的发送频率，0表示不限速
+static void set_emit_rate(unsigned int hz) {
+    emit_interval_us = hz > 0 ? 1000000 / hz : 0;
+}
+
+// 唤醒发送线程（仅使用write，可在信号处理函数中调用）
+static void wake_send_thread(void) {
+    uint64_t one = 1;
+    if (send_event_fd >= 0) {
+        ssize_t n = write(send_event_fd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+// 请求发送线程打印统计（仅使用write，可在信号处理函数中调用）
+void sender_request_stats(void) {
+    stats_requested = 1;
+    wake_send_thread();
+}
+
+// 发送给一个接收端；失败只影响该接收端，每个接收端每秒最多打印一次
+static bool send_to_target(SenderTarget *target, const Message *msg, size_t msg_size) {
+    if (network_send_message(target->network, msg, msg_size)) return true;
+    
+    uint64_t now = monotonic_us();
+    if (target->fail_reported_us == 0 || now - target->fail_reported_us >= 1000000) {
+        target->fail_reported_us = now;
+        LOG_WARN("发送到接收端 %s 失败%s", target->name,
+                 network_get_fd(target->network) < 0 ? "，连接已断开，正在重连" : "，消息已丢弃");
+    }
+    return false;
+}
+
+// 发送一条输入记录
+static void send_input_record(const InputRecord *record) {
+    MouseMoveMessage msg;
+    msg.type = MSG_MOUSE_MOVE;
+    msg.rel_x = record->rel_x;
+    msg.rel_y = record->rel_y;
+    msg.buttons = record->buttons;
+    msg.sequence = (uint32_t)message_counter;
+    
+    // 携带采集时间和发送端各阶段耗时，接收端据此计算端到端延迟
+    uint64_t now = monotonic_us();
+    msg.timestamp = record->capture_us;
+    msg.read_delay_us = record->read_us > record->capture_us ? (uint32_t)(record->read_us - record->capture_us) : 0;
+    msg.queue_delay_us = now > record->read_us ? (uint32_t)(now - record->read_us) : 0;
+    msg.receive_us = 0;
+    
+    // 同一条记录发给所有接收端，某个接收端慢或已断开不影响其他接收端
+    size_t sent = 0;
+    for (size_t i = 0; i < target_count; i++) {
+        if (send_to_target(&targets[i], (Message*)&msg, sizeof(msg))) {
+            sent++;
+        }
+    }
+    
+    if (sent > 0) {
+        LOG_DEBUG("发送鼠标移动消息: x=%.2f, y=%.2f, 按钮=%u, ID=%lu, 接收端=%zu/%zu",
+                  msg.rel_x, msg.rel_y, msg.buttons, (unsigned long)msg.sequence, sent, target_count);
+    }
+    message_counter++;
+}
+
+// 发送一条滚动记录
+static void send_scroll_record(const InputRecord *record) {
+    ScrollMessage msg;
+    msg.type = MSG_SCROLL;
+    msg.delta_x = record->wheel_x;
+    msg.delta_y = record->wheel_y;
+    
+    size_t sent = 0;
+    for (size_t i = 0; i < target_count; i++) {
+        if (send_to_target(&targets[i], (Message*)&msg, sizeof(msg))) {
+            sent++;
+        }
+    }
+    
+    if (sent > 0) {
+        LOG_DEBUG("发送滚轮消息: x=%d, y=%d, 接收端=%zu/%zu", msg.delta_x, msg.delta_y, sent, target_count);
+    }
+}
+
+// 发送一条按键消息
+static void send_key_message(const KeyMessage *msg) {
+    size_t sent = 0;
+    for (size_t i = 0; i < target_count; i++) {
+        if (send_to_target(&targets[i], (const Message*)msg, sizeof(*msg))) {
+            sent++;
+        }
+    }
+    
+    if (sent > 0) {
+        LOG_DEBUG("发送按键消息: %u个按键, 第一个=%u/%u, 接收端=%zu/%zu", msg->count,
+                  msg->keys[0].code, msg->keys[0].value, sent, target_count);
+    }
+}
+
+// 处理接收端发来的消息（在发送线程中调用，user_data为SenderTarget）
+static void handle_server_message(const Message *msg, size_t msg_size, void *user_data) {
+    (void)msg_size;  // 避免未使用警告
+    SenderTarget *target = (SenderTarget*)user_data;
+    
+    // 重连后的连接回复带回接收端在这个会话中最后收到的移动序号
+    if (msg->type == MSG_CONNECT && msg->connect.session_id != 0 && msg->connect.last_sequence != 0) {
+        LOG_INFO("接收端 %s 已重新连接，会话已恢复（最后收到的移动 #%u）", target->name,
+                 msg->connect.last_sequence);
+    }
+    
+    // 接收端在连接回复中告知显示刷新率，按所有接收端中最高的频率发送移动
+    if (msg->type == MSG_CONNECT && msg->connect.refresh_hz > 0 && !rate_fixed) {
+        target->refresh_hz = msg->connect.refresh_hz;
+        unsigned int max_hz = 0;
+        for (size_t i = 0; i < target_count; i++) {
+            if (targets[i].refresh_hz > max_hz) max_hz = targets[i].refresh_hz;
+        }
+        set_emit_rate(max_hz);
+        LOG_INFO("接收端 %s 刷新率: %u Hz，移动消息按 %u Hz 合并发送", target->name,
+                 msg->connect.refresh_hz, max_hz);
+    }
+}
+
+// 打印一个延迟分布
+static void print_latency(const char *name, const NetworkLatencyStats *latency) {
+    printf("%s: 样本=%llu, p50=%llu, p99=%llu, p999=%llu, 最大=%llu 微秒\n", name,
+           (unsigned long long)latency->count, (unsigned long long)latency->p50_us,
+           (unsigned long long)latency->p99_us, (unsigned long long)latency->p999_us,
+           (unsigned long long)latency->max_us);
+}
+
+// 打印一个接收端的网络统计
+static void print_network_stats(const SenderTarget *target) {
+    NetworkStats net;
+    if (network_get_stats(target->network, &net)) {
+        printf("网络(%s): 发出=%llu条/%llu字节, 收到=%llu条/%llu字节, EAGAIN=%llu, 部分写出=%llu, "
+               "队列合并=%llu, 丢弃=%llu, 重连=%llu, 解码错误=%llu\n",
+               target->name, (unsigned long long)net.messages_out, (unsigned long long)net.bytes_out,
+               (unsigned long long)net.messages_in, (unsigned long long)net.bytes_in,
+               (unsigned long long)net.would_block, (unsigned long long)net.partial_sends,
+               (unsigned long long)net.coalesced, (unsigned long long)net.dropped,
+               (unsigned long long)net.reconnects, (unsigned long long)net.decode_errors);
+        print_latency("发送延迟", &net.send_latency);
+        if (net.dispatch_latency.count > 0) {
+            print_latency("分发延迟", &net.dispatch_latency);
+        }
+    }
+}
+
+// 打印环形缓冲区和网络统计
+void sender_print_stats(void) {
+    InputRingStats stats;
+    input_ring_get_stats(input_ring, &stats);
+    printf("事件缓冲区: 写入=%llu, 取出=%llu, 合并=%llu, 溢出=%llu, 限速合并=%llu\n",
+           (unsigned long long)stats.pushed, (unsigned long long)stats.popped,
+           (unsigned long long)stats.coalesced, (unsigned long long)stats.overflow,
+           (unsigned long long)rate_coalesced);
+    
+    // 发送线程每条记录的CPU时间，比较ppoll和io_uring等设置的开销
+    if (thread_usage_valid && stats.popped > 0) {
+        double cpu_us = (double)thread_usage.ru_utime.tv_sec * 1e6 + (double)thread_usage.ru_utime.tv_usec +
+                        (double)thread_usage.ru_stime.tv_sec * 1e6 + (double)thread_usage.ru_stime.tv_usec;
+        printf("发送线程: CPU=%.1f毫秒 (每条记录%.2f微秒), 主动切换=%ld, 被动切换=%ld\n",
+               cpu_us / 1000.0, cpu_us / (double)stats.popped, thread_usage.ru_nvcsw, thread_usage.ru_nivcsw);
+    }
+    
+    for (size_t i = 0; i < target_count; i++) {
+        print_network_stats(&targets[i]);
+    }
+    fflush(stdout);
+}
+
+// 等待读取线程的通知和接收端的事件（ppoll），处理接收端的消息，套接字可写时写出积压；
+// 返回1表示收到通知，0表示超时，-1表示出错
+static int wait_poll(int64_t wait_us) {
+    struct timespec timeout;
+    struct timespec *timeout_ptr = NULL;
+    if (wait_us >= 0) {
+        timeout.tv_sec = (time_t)(wait_us / 1000000);
+        timeout.tv_nsec = (long)(wait_us % 1000000) * 1000;
+        timeout_ptr = &timeout;
+    }
+    
+    // fds[0]为eventfd，之后每个接收端一项；已断开的接收端不参与等待，正在重连的等待连接完成（可写）
+    struct pollfd fds[1 + SENDER_MAX_TARGETS];
+    SenderTarget *polled[SENDER_MAX_TARGETS];
+    int nfds = 1;
+    fds[0].fd = send_event_fd;
+    fds[0].events = POLLIN;
+    for (size_t i = 0; i < target_count; i++) {
+        int fd = network_get_fd(targets[i].network);
+        if (fd < 0) continue;
+    
+        fds[nfds].fd = fd;
+        fds[nfds].events = POLLIN;
+        if (network_has_pending_output(targets[i].network)) {
+            fds[nfds].events |= POLLOUT;
+        }
+        polled[nfds - 1] = &targets[i];
+        nfds++;
+    }
+    
+    if (ppoll(fds, (nfds_t)nfds, timeout_ptr, NULL) < 0) {
+        if (errno == EINTR) return 0;
+        perror("等待发送通知失败");
+        return -1;
+    }
+    
+    // 每个接收端只在自己的套接字可写时写出积压，慢的接收端不会阻塞其他接收端
+    for (int i = 1; i < nfds; i++) {
+        NetworkContext *net = polled[i - 1]->network;
+        if (fds[i].revents & POLLIN) {
+            network_process_messages(net);
+        }
+        if (fds[i].revents & (POLLOUT | POLLERR | POLLHUP)) {
+            network_flush(net);
+        }
+    }
+    
+    if (!(fds[0].revents & POLLIN)) return 0;
+    
+    uint64_t wakeups;
+    ssize_t n = read(send_event_fd, &wakeups, sizeof(wakeups));
+    (void)n;
+    return 1;
+}
+
+// io_uring：把接收端待写出的帧作为一条链接的发送排队，前一个发送全部写出后才开始下一个；
+// 只有最后一个发送成功或某个发送失败时才产生一个完成。返回是否排队了发送
+static bool queue_ring_sends(size_t index) {
+    SenderTarget *target = &targets[index];
+    NetworkSegment segments[RING_CHAIN_MAX];
+    int count = network_take_output(target->network, segments, RING_CHAIN_MAX);
+    if (count == 0) return false;
+    
+    // 提交队列按每个接收端一条最长的链留有空间，排队不会失败
+    int fd = network_get_fd(target->network);
+    for (int i = 0; i < count; i++) {
+        unsigned int flags = i + 1 < count ? URING_SEND_LINK | URING_SEND_SKIP_SUCCESS : 0;
+        uring_queue_send(send_ring, fd, segments[i].data, segments[i].len, flags, RING_TAG(RING_TAG_SEND, index, i));
+        target->ring_send_lens[i] = segments[i].len;
+    }
+    target->ring_send_conn = network_get_connection_id(target->network);
+    target->ring_send_count = (unsigned int)count;
+    target->ring_send_cancelled = false;
+    target->ring_send_fresh = true;
+    return true;
+}
+
+// io_uring：处理一个完成，submit_us为这一次等待提交请求的时间；返回是否为读取线程的通知
+static bool handle_ring_completion(const UringCompletion *completion, uint64_t submit_us) {
+    unsigned int kind = (unsigned int)(completion->tag >> 32);
+    size_t index = (size_t)((completion->tag >> 16) & 0xffff);
+    unsigned int seq = (unsigned int)(completion->tag & 0xffff);
+    
+    if (kind == RING_TAG_WAKE) {
+        ring_wake_queued = false;
+        return completion->result > 0;
+    }
+    if (kind == RING_TAG_CANCEL || index >= target_count) return false;
+    
+    SenderTarget *target = &targets[index];
+    NetworkContext *net = target->network;
+    if (kind == RING_TAG_POLL) {
+        // 连接已变化时poll针对的是旧的套接字，结果不再有意义
+        bool current = target->ring_poll_conn == network_get_connection_id(net);
+        target->ring_poll_conn = 0;
+        target->ring_poll_cancelled = false;
+        if (!current || completion->result < 0) return false;
+    
+        if (completion->result & (POLLIN | POLLERR | POLLHUP)) {
+            network_process_messages(net);
+        }
+        if (completion->result & POLLOUT) {
+            network_flush(net);
+        }
+        return false;
+    }
+    
+    // 发送链结束：失败的发送之前的都已全部写出，之后的被取消且没有完成
+    if (kind == RING_TAG_SEND && target->ring_send_count > 0) {
+        size_t written = 0;
+        for (unsigned int i = 0; i < seq && i < target->ring_send_count; i++) {
+            written += target->ring_send_lens[i];
+        }
+        if (completion->result > 0) {
+            written += (size_t)completion->result;
+        }
+    
+        // 套接字可写时发送在提交时就已写出，完成要等到这一次等待结束才取出，发送延迟按提交时间统计；
+        // 之前提交、被挂起的发送按取出完成的时间统计
+        uint64_t written_us = target->ring_send_fresh ? submit_us : monotonic_us();
+        network_complete_output(net, written, completion->result < 0 ? completion->result : 0, written_us);
+        target->ring_send_count = 0;
+    }
+    return false;
+}
+
+// 与wait_poll相同，使用io_uring：各接收端待写出的帧作为链接的发送、重新排队的poll和eventfd的读取，
+// 与等待合为一次io_uring_enter，每次唤醒通常只需一次系统调用
+static int wait_ring(int64_t wait_us) {
+    unsigned int wait_nr = 1;
+    for (size_t i = 0; i < target_count; i++) {
+        SenderTarget *target = &targets[i];
+        uint32_t conn = network_get_connection_id(target->network);
+    
+        // 发送链所在的连接已断开或被新的连接取代：取消还在等待写出的发送，完成后才取出新连接的数据
+        if (target->ring_send_count > 0) {
+            if (conn != target->ring_send_conn && !target->ring_send_cancelled) {
+                for (unsigned int j = 0; j < target->ring_send_count; j++) {
+                    uring_queue_cancel(send_ring, RING_TAG(RING_TAG_SEND, i, j), RING_TAG(RING_TAG_CANCEL, i, 0));
+                }
+                target->ring_send_cancelled = true;
+            }
+        } else if (conn != 0 && queue_ring_sends(i)) {
+            wait_nr++;
+        }
+    
+        if (target->ring_poll_conn != 0) {
+            if (conn != target->ring_poll_conn && !target->ring_poll_cancelled) {
+                uring_queue_cancel(send_ring, RING_TAG(RING_TAG_POLL, i, 0), RING_TAG(RING_TAG_CANCEL, i, 0));
+                target->ring_poll_cancelled = true;
+            }
+        } else if (conn != 0) {
+            // 正在重连时等待可写（连接完成），连接后只等待接收端的消息
+            unsigned int events = POLLIN;
+            if (target->ring_send_count == 0 && network_has_pending_output(target->network)) {
+                events |= POLLOUT;
+            }
+            uring_queue_poll(send_ring, network_get_fd(target->network), events, RING_TAG(RING_TAG_POLL, i, 0));
+            target->ring_poll_conn = conn;
+        }
+    }
+    
+    if (!ring_wake_queued) {
+        uring_queue_read(send_ring, send_event_fd, &ring_wakeups, sizeof(ring_wakeups), RING_TAG(RING_TAG_WAKE, 0, 0));
+        ring_wake_queued = true;
+    }
+    
+    // 同时等待发送链的完成和读取线程的通知
+    if (wait_nr > 1 && (wait_us < 0 || wait_us > RING_SEND_WAIT_US)) {
+        wait_us = RING_SEND_WAIT_US;
+    }
+    uint64_t submit_us = monotonic_us();
+    int rc = uring_submit_and_wait(send_ring, wait_nr, wait_us);
+    if (rc < 0 && rc != -ETIME && rc != -EINTR) {
+        errno = -rc;
+        perror("等待发送通知失败");
+        return -1;
+    }
+    
+    bool woken = false;
+    UringCompletion completion;
+    while (uring_next_completion(send_ring, &completion)) {
+        if (handle_ring_completion(&completion, submit_us)) {
+            woken = true;
+        }
+    }
+    for (size_t i = 0; i < target_count; i++) {
+        targets[i].ring_send_fresh = false;
+    }
+    return woken ? 1 : 0;
+}
+
+// 等待读取线程的通知和接收端的事件
+static int wait_for_work(int64_t wait_us) {
+    return send_ring ? wait_ring(wait_us) : wait_poll(wait_us);
+}
+
+// 停止时写出各接收端发送队列中的积压，最多等待DRAIN_TIMEOUT_MS；已断开的接收端不等待
+static void drain_targets(void) {
+    uint64_t deadline = monotonic_us() + (uint64_t)DRAIN_TIMEOUT_MS * 1000;
+    
+    for (;;) {
+        unsigned int pending = 0;
+        for (size_t i = 0; i < target_count; i++) {
+            if (network_get_fd(targets[i].network) >= 0 &&
+                (network_has_pending_output(targets[i].network) || targets[i].ring_send_count > 0)) {
+                pending++;
+            }
+        }
+    
+        uint64_t now = monotonic_us();
+        if (pending == 0) return;
+        if (now >= deadline) {
+            LOG_WARN("%u个接收端的发送队列在%d毫秒内没有写完，剩余的消息被丢弃", pending, DRAIN_TIMEOUT_MS);
+            return;
+        }
+    
+        if (wait_for_work((int64_t)(deadline - now)) < 0) return;
+    }
+}
+
+// 发送线程函数
+// 阻塞在eventfd上，直到读取线程在EV_SYN帧结束时发出通知，空闲时不产生任何唤醒；
+// 同时等待接收端的消息，发送队列有积压时等待套接字可写；使用io_uring时，这一轮的发送在下一次等待时一起提交。
+// 移动按emit_interval_us限速：距上次发送已满一个间隔时立即发送，否则合并到下个间隔，
+// 因此延迟最多增加一个间隔；按钮记录总是立即发送。
+// 停止时再处理一轮：取出环形缓冲区中剩余的记录立即发出，并等待发送队列写出，之后才退出
+static void *send_thread_func(void *arg) {
+    (void)arg; // 避免未使用警告
+    
+    realtime_setup_thread("发送线程", realtime.enabled ? realtime.sender_priority : 0, realtime.sender_cpu);
+    
+    InputRecord pending_motion;        // 等待下个间隔发送的移动
+    bool has_pending_motion = false;
+    InputRecord pending_scroll = {0};  // 等待下个间隔发送的滚动，滚动量累加
+    bool has_pending_scroll = false;
+    KeyMessage key_msg;                // 正在组装的按键帧
+    memset(&key_msg, 0, sizeof(key_msg));
+    key_msg.type = MSG_KEY;
+    uint64_t last_emit_us = 0;         // 上次发送位置的时间
+    
+    for (;;) {
+        bool stopping = !running;
+    
+        // 有待发送的移动时，等到下个间隔
+        int64_t wait_us = -1;
+        if (has_pending_motion || has_pending_scroll) {
+            uint64_t now = monotonic_us();
+            uint64_t deadline = last_emit_us + emit_interval_us;
+            wait_us = deadline > now ? (int64_t)(deadline - now) : 0;
+        }
+    
+        // 已断开的接收端按退避时间重连，到时间时唤醒
+        for (size_t i = 0; i < target_count; i++) {
+            int reconnect_ms = network_maintain_connection(targets[i].network);
+            if (reconnect_ms >= 0 && (wait_us < 0 || (int64_t)reconnect_ms * 1000 < wait_us)) {
+                wait_us = (int64_t)reconnect_ms * 1000;
+            }
+        }
+    
+        if (stopping) {
+            wait_us = 0;
+        }
+    
+        int woken = wait_for_work(wait_us);
+        if (woken < 0) break;
+    
+        if (woken || stopping) {
+            if (stats_requested) {
+                stats_requested = 0;
+                thread_usage_valid = getrusage(RUSAGE_THREAD, &thread_usage) == 0;
+                sender_print_stats();
+            }
+    
+            // 按顺序取出所有记录，连续的移动已在环形缓冲区中合并
+            InputRecord record;
+            while (input_ring_pop(input_ring, &record)) {
+                if (record.type == INPUT_RECORD_MOTION) {
+                    if (has_pending_motion) {
+                        rate_coalesced++;
+                    }
+                    pending_motion = record;
+                    has_pending_motion = true;
+                } else if (record.type == INPUT_RECORD_SCROLL) {
+                    if (has_pending_scroll) {
+                        pending_scroll.wheel_x += record.wheel_x;
+                        pending_scroll.wheel_y += record.wheel_y;
+                        rate_coalesced++;
+                    } else {
+                        pending_scroll = record;
+                        has_pending_scroll = true;
+                    }
+                } else if (record.type == INPUT_RECORD_KEY) {
+                    // 按键不限速：之前尚未发送的移动和滚动先发出，保持与指针事件的顺序，
+                    // 按键帧不会等到下个间隔
+                    if (has_pending_motion) {
+                        send_input_record(&pending_motion);
+                        has_pending_motion = false;
+                        last_emit_us = monotonic_us();
+                    }
+                    if (has_pending_scroll) {
+                        send_scroll_record(&pending_scroll);
+                        has_pending_scroll = false;
+                    }
+    
+                    KeyEvent *key = &key_msg.keys[key_msg.count++];
+                    key->code = record.key_code;
+                    key->value = record.key_value;
+                    key->scancode = record.key_scancode;
+                    if (record.key_frame_end || key_msg.count == KEY_MESSAGE_MAX_KEYS) {
+                        send_key_message(&key_msg);
+                        key_msg.count = 0;
+                    }
+                } else {
+                    // 按钮记录带有最新位置，取代尚未发送的移动；之前的滚动先发出，保持顺序
+                    if (has_pending_motion) {
+                        rate_coalesced++;
+                        has_pending_motion = false;
+                    }
+                    if (has_pending_scroll) {
+                        send_scroll_record(&pending_scroll);
+                        has_pending_scroll = false;
+                    }
+                    send_input_record(&record);
+                    last_emit_us = monotonic_us();
+                }
+            }
+        }
+    
+        // 满一个间隔（或正在停止）时发送合并后的移动和滚动
+        if (has_pending_motion || has_pending_scroll) {
+            uint64_t now = monotonic_us();
+            if (stopping || now - last_emit_us >= emit_interval_us) {
+                if (has_pending_motion) {
+                    send_input_record(&pending_motion);
+                    has_pending_motion = false;
+                }
+                if (has_pending_scroll) {
+                    send_scroll_record(&pending_scroll);
+                    has_pending_scroll = false;
+                }
+                last_emit_us = now;
+            }
+        }
+    
+        if (stopping) {
+            if (key_msg.count > 0) {
+                send_key_message(&key_msg);
+            }
+            drain_targets();
+            break;
+        }
+    }
+    
+    thread_usage_valid = getrusage(RUSAGE_THREAD, &thread_usage) == 0;
+    return NULL;
+}
+
+// 内核事件时间（设备已设置为CLOCK_MONOTONIC）
+static uint64_t event_time_us(const struct input_event *ev) {
+    return (uint64_t)ev->input_event_sec * 1000000 + (uint64_t)ev->input_event_usec;
+}
+
+// 写入一条按钮记录
+static void push_button_record(uint64_t capture_us) {
+    InputRecord record;
+    record.type = INPUT_RECORD_BUTTON;
+    record.buttons = button_state;
+    record.rel_x = (float)last_rel_x;
+    record.rel_y = (float)last_rel_y;
+    record.capture_us = capture_us;
+    record.read_us = batch_read_us;
+    input_ring_push_button(input_ring, &record);
+}
+
+// 更新某个设备的按钮状态，全局状态变化时写入按钮记录，返回是否写入
+static bool set_device_buttons(InputDevice *dev, uint8_t buttons, uint64_t capture_us) {
+    uint8_t changed = dev->buttons ^ buttons;
+    uint8_t state = button_state;
+    
+    for (int i = 0; i < MOUSE_BUTTON_COUNT; i++) {
+        uint8_t mask = (uint8_t)(1 << i);
+        if (!(changed & mask)) continue;
+    
+        button_holders[i] += (buttons & mask) ? 1 : -1;
+        if (button_holders[i] > 0) {
+            state |= mask;
+        } else {
+            state &= ~mask;
+        }
+    }
+    dev->buttons = buttons;
+    
+    if (state == button_state) {
+        return false;
+    }
+    button_state = state;
+    push_button_record(capture_us);
+    return true;
+}
+
+// 键码是否为键盘按键（排除鼠标、手柄等按钮区间）
+static bool is_keyboard_code(uint16_t code) {
+    return (code > KEY_RESERVED && code < BTN_MISC) || (code >= KEY_OK && code < BTN_TRIGGER_HAPPY);
+}
+
+// 把键盘当前帧缓存的按键写入环形缓冲区，frame_end表示帧已结束
+static void push_key_frame(InputDevice *dev, bool frame_end, uint64_t capture_us) {
+    for (size_t i = 0; i < dev->key_count; i++) {
+        InputRecord record;
+        memset(&record, 0, sizeof(record));
+        record.type = INPUT_RECORD_KEY;
+        record.buttons = button_state;
+        record.rel_x = (float)last_rel_x;
+        record.rel_y = (float)last_rel_y;
+        record.capture_us = capture_us;
+        record.read_us = batch_read_us;
+        record.key_code = dev->keys[i].code;
+        record.key_value = dev->keys[i].value;
+        record.key_scancode = dev->keys[i].scancode;
+        record.key_frame_end = frame_end && i + 1 == dev->key_count;
+        input_ring_push_key(input_ring, &record);
+    
+        // 记录已发出的按键状态，SYN_DROPPED后和拔出时据此重新同步
+        uint16_t code = record.key_code;
+        if (record.key_value == KEY_VALUE_UP) {
+            dev->keys_down[code / 8] &= (uint8_t)~(1 << (code % 8));
+        } else {
+            dev->keys_down[code / 8] |= (uint8_t)(1 << (code % 8));
+        }
+    }
+    if (dev->key_count > 0) {
+        dev->frame_pushed = true;
+    }
+    dev->key_count = 0;
+}
+
+// 按键在接收端是否为按下状态（包括当前帧尚未写出的按键）
+static bool key_is_down(const InputDevice *dev, uint16_t code) {
+    for (size_t i = dev->key_count; i > 0; i--) {
+        if (dev->keys[i - 1].code == code) return dev->keys[i - 1].value != KEY_VALUE_UP;
+    }
+    return (dev->keys_down[code / 8] & (1 << (code % 8))) != 0;
+}
+
+// 缓存一个按键事件，缓存满时先写出
+static void queue_key(InputDevice *dev, uint16_t code, uint8_t value, uint32_t scancode, uint64_t capture_us) {
+    if (dev->key_count == INPUT_DEVICE_MAX_KEYS) {
+        push_key_frame(dev, false, capture_us);
+    }
+    dev->keys[dev->key_count].code = code;
+    dev->keys[dev->key_count].value = value;
+    dev->keys[dev->key_count].scancode = scancode;
+    dev->key_count++;
+}
+
+// 处理键盘事件，一个EV_SYN帧内的按键合为一条按键消息
+static void process_key_event(InputDevice *dev, struct input_event *ev) {
+    if (ev->type == EV_MSC && ev->code == MSC_SCAN) {
+        dev->pending_scan = (uint32_t)ev->value;
+    } else if (ev->type == EV_KEY && is_keyboard_code(ev->code) && ev->value >= 0 && ev->value <= 2) {
+        // 没有发出过按下的键（捕获开始前已按下），其释放和重复不发出
+        if (ev->value != KEY_VALUE_DOWN && !key_is_down(dev, ev->code)) {
+            dev->pending_scan = 0;
+            return;
+        }
+        queue_key(dev, ev->code, (uint8_t)ev->value, dev->pending_scan, event_time_us(ev));
+        dev->pending_scan = 0;
+        LOG_DEBUG("按键 %u %s", ev->code, ev->value == 0 ? "释放" : ev->value == 1 ? "按下" : "重复");
+    } else if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+        // 丢弃未完成的帧，按键状态由调用者重新同步
+        dev->key_count = 0;
+        dev->pending_scan = 0;
+    } else if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+        push_key_frame(dev, true, event_time_us(ev));
+        if (dev->frame_pushed) {
+            wake_send_thread();
+            dev->frame_pushed = false;
+        }
+    }
+}
+
+// 处理鼠标事件
+static void process_mouse_event(InputDevice *dev, struct input_event *ev) {
+    if (ev->type == EV_REL) {
+        // 鼠标相对移动
+        if (ev->code == REL_X) {
+            dev->dx += ev->value;
+            dev->moved = true;
+        } else if (ev->code == REL_Y) {
+            dev->dy += ev->value;
+            dev->moved = true;
+        } else if (ev->code == REL_WHEEL_HI_RES) {
+            // 高精度滚轮同时报告普通滚轮事件，之后只使用高精度的值
+            dev->wheel_y += ev->value;
+            dev->wheel_hi_res = true;
+        } else if (ev->code == REL_HWHEEL_HI_RES) {
+            dev->wheel_x += ev->value;
+            dev->wheel_hi_res = true;
+        } else if (ev->code == REL_WHEEL) {
+            dev->wheel_lo_y += ev->value;
+        } else if (ev->code == REL_HWHEEL) {
+            dev->wheel_lo_x += ev->value;
+        }
+    } else if (ev->type == EV_ABS && dev->kind == INPUT_DEVICE_TOUCHPAD) {
+        // 触摸板绝对坐标，手指按下期间换算为相对移动
+        if (ev->code == ABS_X) {
+            if (dev->abs_valid) {
+                dev->dx += (ev->value - dev->abs_x) * dev->abs_scale_x;
+                dev->moved = true;
+            }
+            dev->abs_x = ev->value;
+        } else if (ev->code == ABS_Y) {
+            if (dev->abs_valid) {
+                dev->dy += (ev->value - dev->abs_y) * dev->abs_scale_y;
+                dev->moved = true;
+            }
+            dev->abs_y = ev->value;
+        }
+    } else if (ev->type == EV_KEY) {
+        // 按键事件，每个边沿单独写入环形缓冲区，保证快速点击不会丢失
+        uint8_t mask = 0;
+        const char *name = NULL;
+        for (int i = 0; i < MOUSE_BUTTON_COUNT; i++) {
+            if (ev->code == button_codes[i].code) {
+                mask = (uint8_t)(1 << i);
+                name = button_codes[i].name;
+            }
+        }
+        if (ev->code == BTN_TOUCH) {
+            // 触摸板手指按下或抬起，重新开始计算位移
+            dev->touching = ev->value != 0;
+            dev->abs_valid = false;
+        }
+    
+        if (mask && ev->value != 2) { // 忽略自动重复
+            uint8_t buttons = ev->value ? (dev->buttons | mask) : (dev->buttons & ~mask);
+            if (set_device_buttons(dev, buttons, event_time_us(ev))) {
+                LOG_DEBUG("%s%s, 按钮状态: %d", name, ev->value ? "按下" : "释放", button_state);
+                dev->frame_pushed = true;
+            }
+        }
+    } else if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+        // 内核缓冲区溢出，丢弃未完成的帧，按钮状态由调用者重新同步
+        dev->dx = 0;
+        dev->dy = 0;
+        dev->moved = false;
+        dev->abs_valid = false;
+        dev->wheel_x = dev->wheel_y = 0;
+        dev->wheel_lo_x = dev->wheel_lo_y = 0;
+    } else if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+        if (dev->moved) {
+            // 同步事件，处理累积的移动
+            double rel_x = dev->dx / 1000.0;
+            double rel_y = dev->dy / 1000.0;
+    
+            // 计算相对屏幕位置
+            last_rel_x += rel_x;
+            last_rel_y += rel_y;
+    
+            // 确保值在0.0-1.0范围内
+            if (last_rel_x < 0.0) last_rel_x = 0.0;
+            if (last_rel_x > 1.0) last_rel_x = 1.0;
+            if (last_rel_y < 0.0) last_rel_y = 0.0;
+            if (last_rel_y > 1.0) last_rel_y = 1.0;
+    
+            // 移动足够大时写入移动记录
+            if (fabs(rel_x) > move_threshold || fabs(rel_y) > move_threshold) {
+                InputRecord record;
+                record.type = INPUT_RECORD_MOTION;
+                record.buttons = button_state;
+                record.rel_x = (float)last_rel_x;
+                record.rel_y = (float)last_rel_y;
+                record.capture_us = event_time_us(ev);
+                record.read_us = batch_read_us;
+                input_ring_push_motion(input_ring, &record);
+                dev->frame_pushed = true;
+            }
+    
+            // 重置累积值
+            dev->dx = 0;
+            dev->dy = 0;
+            dev->moved = false;
+        }
+    
+        // 本帧的滚动合为一条滚动记录；没有高精度滚轮时一格按SCROLL_UNITS_PER_NOTCH换算
+        if (!dev->wheel_hi_res) {
+            dev->wheel_x += dev->wheel_lo_x * SCROLL_UNITS_PER_NOTCH;
+            dev->wheel_y += dev->wheel_lo_y * SCROLL_UNITS_PER_NOTCH;
+        }
+        if (dev->wheel_x != 0 || dev->wheel_y != 0) {
+            InputRecord record;
+            memset(&record, 0, sizeof(record));
+            record.type = INPUT_RECORD_SCROLL;
+            record.buttons = button_state;
+            record.rel_x = (float)last_rel_x;
+            record.rel_y = (float)last_rel_y;
+            record.wheel_x = dev->wheel_x;
+            record.wheel_y = dev->wheel_y;
+            record.capture_us = event_time_us(ev);
+            record.read_us = batch_read_us;
+            input_ring_push_scroll(input_ring, &record);
+            dev->frame_pushed = true;
+        }
+        dev->wheel_x = dev->wheel_y = 0;
+        dev->wheel_lo_x = dev->wheel_lo_y = 0;
+    
+        // 触摸板本帧的坐标已知，之后的帧可以计算位移
+        if (dev->touching) {
+            dev->abs_valid = true;
+        }
+    
+        // 整帧处理完毕，立即通知发送线程
+        if (input_ring_flush_pending(input_ring)) {
+            dev->frame_pushed = true;
+        }
+        if (dev->frame_pushed) {
+            wake_send_thread();
+            dev->frame_pushed = false;
+        }
+    }
+}
+
+// SYN_DROPPED之后通过EVIOCGKEY重新同步按钮状态
+static void resync_button_state(InputDevice *dev) {
+    uint8_t keys[KEY_MAX / 8 + 1];
+    memset(keys, 0, sizeof(keys));
+    
+    // 回放和基准测试的合成设备没有设备节点
+    if (dev->fd < 0) return;
+    
+    if (ioctl(dev->fd, EVIOCGKEY(sizeof(keys)), keys) < 0) {
+        perror("无法读取按键状态");
+        return;
+    }
+    
+    uint8_t buttons = 0;
+    for (int i = 0; i < MOUSE_BUTTON_COUNT; i++) {
+        uint16_t code = button_codes[i].code;
+        if (keys[code / 8] & (1 << (code % 8))) buttons |= (uint8_t)(1 << i);
+    }
+    dev->touching = (keys[BTN_TOUCH / 8] & (1 << (BTN_TOUCH % 8))) != 0;
+    
+    if (buttons != dev->buttons) {
+        LOG_INFO("SYN_DROPPED后重新同步按钮状态: %d -> %d (%s)", dev->buttons, buttons, dev->path);
+        if (set_device_buttons(dev, buttons, monotonic_us())) {
+            wake_send_thread();
+        }
+    }
+}
+
+// 按keys发出与已发出状态不同的按键，使接收端的按键状态与之一致；keys为NULL时释放所有按键
+static void sync_keys(InputDevice *dev, const uint8_t *keys) {
+    uint64_t now = monotonic_us();
+    for (unsigned int code = 0; code <= KEY_MAX; code++) {
+        if (!is_keyboard_code((uint16_t)code)) continue;
+    
+        bool down = keys && (keys[code / 8] & (1 << (code % 8)));
+        bool sent = key_is_down(dev, (uint16_t)code);
+        if (down != sent) {
+            queue_key(dev, (uint16_t)code, down ? KEY_VALUE_DOWN : KEY_VALUE_UP, 0, now);
+        }
+    }
+    push_key_frame(dev, true, now);
+    if (dev->frame_pushed) {
+        wake_send_thread();
+        dev->frame_pushed = false;
+    }
+}
+
+// 键盘：SYN_DROPPED之后和加入时通过EVIOCGKEY重新同步按键状态
+static void resync_key_state(InputDevice *dev) {
+    uint8_t keys[KEY_MAX / 8 + 1];
+    memset(keys, 0, sizeof(keys));
+    
+    // 回放的合成设备没有设备节点
+    if (dev->fd < 0) return;
+    
+    if (ioctl(dev->fd, EVIOCGKEY(sizeof(keys)), keys) < 0) {
+        perror("无法读取按键状态");
+        return;
+    }
+    sync_keys(dev, keys);
+}
+
+// 重新同步设备状态
+static void resync_device(InputDevice *dev) {
+    if (dev->kind == INPUT_DEVICE_KEYBOARD) {
+        resync_key_state(dev);
+    } else {
+        resync_button_state(dev);
+    }
+}
+
+// 处理一次read()读到的所有事件
+void sender_process_events(InputDevice *dev, struct input_event *events, size_t count, void *user_data) {
+    (void)user_data; // 避免未使用警告
+    
+    batch_read_us = monotonic_us();
+    for (size_t i = 0; i < count; i++) {
+        struct input_event *ev = &events[i];
+    
+        if (dev->syn_dropped) {
+            // 丢弃到下一个SYN_REPORT为止的所有事件，然后重新同步
+            if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+                dev->syn_dropped = false;
+                resync_device(dev);
+            }
+            continue;
+        }
+    
+        if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+            dev->syn_dropped = true;
+        }
+        if (dev->kind == INPUT_DEVICE_KEYBOARD) {
+            process_key_event(dev, ev);
+        } else {
+            process_mouse_event(dev, ev);
+        }
+    }
+}
+
+// 设备加入或移除
+void sender_device_changed(InputDevice *dev, bool added, void *user_data) {
+    (void)user_data; // 避免未使用警告
+    
+    // 发送线程已停止时不再写入（环形缓冲区满时写入按钮记录会一直等待）
+    if (!running) return;
+    
+    batch_read_us = monotonic_us();
+    if (dev->kind == INPUT_DEVICE_KEYBOARD) {
+        // 键盘加入时已按下的键（如启动命令的回车）不发出，拔出时释放已发出的按键
+        if (!added) {
+            sync_keys(dev, NULL);
+        }
+    } else if (added) {
+        // 读取设备当前按下的按钮，避免之后的释放事件无对应按下
+        resync_button_state(dev);
+    } else if (set_device_buttons(dev, 0, batch_read_us)) {
+        // 拔出时释放该设备按下的按钮
+        wake_send_thread();
+    }
+}
+
+// 重试写入暂存的移动
+bool sender_flush_pending(void) {
+    if (!running || !input_ring_has_pending(input_ring)) return false;
+    
+    if (input_ring_flush_pending(input_ring)) return true;
+    wake_send_thread();
+    return false;
+}
+
+// 添加一个接收端，须在sender_start之前调用
+bool sender_add_target(NetworkContext *net, const char *name) {
+    if (!net || running) return false;
+    if (target_count == SENDER_MAX_TARGETS) {
+        fprintf(stderr, "接收端过多，最多%d个\n", SENDER_MAX_TARGETS);
+        return false;
+    }
+    
+    SenderTarget *target = &targets[target_count++];
+    memset(target, 0, sizeof(*target));
+    target->network = net;
+    snprintf(target->name, sizeof(target->name), "%s", name ? name : "?");
+    
+    // 接收端的回复在发送线程中处理
+    network_set_callback(net, handle_server_message, target);
+    return true;
+}
+
+// 关闭发送线程的io_uring，之后的发送恢复由网络层直接写出
+static void release_send_ring(void) {
+    if (!send_ring) return;
+    
+    uring_cleanup(send_ring);
+    send_ring = NULL;
+    for (size_t i = 0; i < target_count; i++) {
+        network_set_external_output(targets[i].network, false);
+    }
+}
+
+// 创建环形缓冲区和eventfd，启动发送线程
+bool sender_start(const SenderConfig *config) {
+    if (!config || target_count == 0 || running) return false;
+    
+    rate_fixed = config->rate_fixed;
+    set_emit_rate(config->emit_rate_hz);
+    ring_wake_queued = false;
+    thread_usage_valid = false;
+    if (config->realtime) {
+        realtime = *config->realtime;
+    } else {
+        realtime_config_init(&realtime);
+    }
+    
+    // 创建事件环形缓冲区
+    input_ring = input_ring_init(INPUT_RING_DEFAULT_CAPACITY);
+    if (!input_ring) {
+        fprintf(stderr, "无法创建事件缓冲区\n");
+        return false;
+    }
+    
+    // 创建发送通知用的eventfd
+    send_event_fd = eventfd(0, EFD_CLOEXEC);
+    if (send_event_fd < 0) {
+        perror("无法创建eventfd");
+        input_ring_cleanup(input_ring);
+        input_ring = NULL;
+        return false;
+    }
+    
+    // io_uring：TCP接收端的发送改由发送线程提交，与等待合为一次io_uring_enter
+    if (config->use_io_uring) {
+        send_ring = uring_init(RING_ENTRIES);
+        if (send_ring) {
+            for (size_t i = 0; i < target_count; i++) {
+                network_set_external_output(targets[i].network, true);
+            }
+        } else {
+            perror("无法使用io_uring发送，改用ppoll");
+        }
+    }
+    
+    // 发送线程屏蔽信号，信号总是由主线程处理，主线程的等待才能被打断
+    sigset_t block, old;
+    sigfillset(&block);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    running = 1;
+    int rc = pthread_create(&send_thread, NULL, send_thread_func, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    
+    if (rc != 0) {
+        fprintf(stderr, "无法创建发送线程\n");
+        running = 0;
+        release_send_ring();
+        close(send_event_fd);
+        send_event_fd = -1;
+        input_ring_cleanup(input_ring);
+        input_ring = NULL;
+        return false;
+    }
+    
+    return true;
+}
+
+// 唤醒并等待发送线程结束
+void sender_stop(void) {
+    if (!running) return;
+    
+    // 缓冲区满时暂存的最后一次移动不能丢，等发送线程腾出空间后写入
+    while (input_ring_flush_pending(input_ring)) {
+        wake_send_thread();
+        sched_yield();
+    }
+    
+    running = 0;
+    wake_send_thread();
+    pthread_join(send_thread, NULL);
+}
+
+// 释放环形缓冲区和eventfd
+void sender_cleanup(void) {
+    sender_stop();
+    
+    release_send_ring();
+    input_ring_cleanup(input_ring);
+    input_ring = NULL;
+    if (send_event_fd >= 0) {
+        close(send_event_fd);
+        send_event_fd = -1;
+    }
+    target_count = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef MOUSE_SENDER_H
+#define MOUSE_SENDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../common/network.h"
+#include "input_capture.h"
+#include "realtime.h"
+
+// 发送端配置
+typedef struct {
+    unsigned int emit_rate_hz;     // 移动消息的最大发送频率，0表示不限速
+    bool rate_fixed;               // 为true时不采用接收端在连接回复中告知的刷新率
+    const RealtimeConfig *realtime; // 发送线程的实时模式设置（优先级、CPU），NULL表示默认调度
+    bool use_io_uring;             // 发送线程用io_uring等待并提交TCP发送，内核不支持时打印原因并使用ppoll
+} SenderConfig;
+
+// 最多同时发送给多少个接收端
+#define SENDER_MAX_TARGETS 16
+
+// 添加一个已连接的接收端，须在sender_start之前调用；每个接收端有独立的发送队列，
+// 同一份输入发给所有接收端，name仅用于打印
+bool sender_add_target(NetworkContext *network, const char *name);
+
+// 创建事件环形缓冲区并启动发送线程，接收端的消息也在发送线程中处理
+bool sender_start(const SenderConfig *config);
+
+// 唤醒并等待发送线程结束，须在读取线程调用；暂存的移动先写入环形缓冲区，
+// 发送线程发出环形缓冲区中剩余的记录，并等待发送队列写出（有超时）
+void sender_stop(void);
+
+// 停止发送线程并释放资源
+void sender_cleanup(void);
+
+// 读取线程：处理一次read()读到的所有事件（InputEventsCallback）
+void sender_process_events(InputDevice *dev, struct input_event *events, size_t count, void *user_data);
+
+// 读取线程：设备加入或移除（InputDeviceCallback）
+void sender_device_changed(InputDevice *dev, bool added, void *user_data);
+
+// 读取线程：重试写入因环形缓冲区满而暂存的移动，写入后唤醒发送线程；返回是否仍有暂存。
+// 暂存期间读取线程应以SENDER_RETRY_MS为超时等待输入，没有新事件时也能及时重试
+bool sender_flush_pending(void);
+
+// 有暂存的移动时，读取线程等待输入的超时（毫秒）
+#define SENDER_RETRY_MS 1
+
+// 请求发送线程打印统计（可在信号处理函数中调用）
+void sender_request_stats(void);
+
+// 打印事件缓冲区和网络统计
+void sender_print_stats(void);
+
+#endif // MOUSE_SENDER_H
@@ -0,0 +1,220 @@
+#include "uinput_output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+// uinput设备节点
+#define UINPUT_PATH "/dev/uinput"
+
+// 一帧最多缓存的事件数
+#define UINPUT_FRAME_SIZE 32
+
+struct UinputOutput {
+    int fd;                                     // /dev/uinput
+    struct input_event frame[UINPUT_FRAME_SIZE]; // 等待EV_SYN的事件
+    size_t frame_count;                         // 缓存的事件数
+    int32_t wheel_rem_x, wheel_rem_y;           // 不足一格的滚动量
+};
+
+// 设备支持的按钮
+static const uint16_t button_codes[] = {
+    BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, BTN_SIDE, BTN_EXTRA, BTN_FORWARD, BTN_BACK, BTN_TASK,
+};
+
+// 设备支持的滚轮
+static const uint16_t wheel_codes[] = {
+    REL_WHEEL, REL_HWHEEL, REL_WHEEL_HI_RES, REL_HWHEEL_HI_RES,
+};
+
+// 缓存一个事件，满时先写出
+static void queue_event(UinputOutput* out, uint16_t type, uint16_t code, int32_t value) {
+    if (out->frame_count == UINPUT_FRAME_SIZE - 1) {
+        uinput_output_sync(out);
+    }
+
+    struct input_event* ev = &out->frame[out->frame_count++];
+    memset(ev, 0, sizeof(*ev));
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+}
+
+// 设置一个绝对坐标轴
+static bool setup_abs(int fd, uint16_t code) {
+    struct uinput_abs_setup abs;
+    memset(&abs, 0, sizeof(abs));
+    abs.code = code;
+    abs.absinfo.minimum = 0;
+    abs.absinfo.maximum = UINPUT_POS_MAX;
+    return ioctl(fd, UI_ABS_SETUP, &abs) == 0;
+}
+
+// 打开/dev/uinput
+static int open_uinput(void) {
+    int fd = open(UINPUT_PATH, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        perror("无法打开" UINPUT_PATH);
+    }
+    return fd;
+}
+
+// 设置能力位之后创建设备，ok为false或创建失败时关闭fd并返回NULL
+static UinputOutput* create_device(int fd, bool ok, const char* name, uint16_t product) {
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor = 0x1d6b;  // Linux Foundation
+    setup.id.product = product;
+    setup.id.version = 1;
+    snprintf(setup.name, sizeof(setup.name), "%s", name);
+
+    ok = ok && ioctl(fd, UI_DEV_SETUP, &setup) == 0 && ioctl(fd, UI_DEV_CREATE) == 0;
+    if (!ok) {
+        perror("无法创建uinput设备");
+        close(fd);
+        return NULL;
+    }
+
+    UinputOutput* out = (UinputOutput*)calloc(1, sizeof(UinputOutput));
+    if (!out) {
+        ioctl(fd, UI_DEV_DESTROY);
+        close(fd);
+        return NULL;
+    }
+    out->fd = fd;
+    return out;
+}
+
+// 创建虚拟指针设备
+UinputOutput* uinput_output_init(const char* name) {
+    int fd = open_uinput();
+    if (fd < 0) return NULL;
+
+    // 绝对坐标指针：ABS_X/ABS_Y、按钮和滚轮
+    bool ok = ioctl(fd, UI_SET_EVBIT, EV_KEY) == 0 && ioctl(fd, UI_SET_EVBIT, EV_REL) == 0;
+    for (size_t i = 0; ok && i < sizeof(button_codes) / sizeof(button_codes[0]); i++) {
+        ok = ioctl(fd, UI_SET_KEYBIT, button_codes[i]) == 0;
+    }
+    for (size_t i = 0; ok && i < sizeof(wheel_codes) / sizeof(wheel_codes[0]); i++) {
+        ok = ioctl(fd, UI_SET_RELBIT, wheel_codes[i]) == 0;
+    }
+    ok = ok && ioctl(fd, UI_SET_EVBIT, EV_ABS) == 0 &&
+              ioctl(fd, UI_SET_ABSBIT, ABS_X) == 0 &&
+              ioctl(fd, UI_SET_ABSBIT, ABS_Y) == 0 &&
+              ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_POINTER) == 0 &&
+              setup_abs(fd, ABS_X) && setup_abs(fd, ABS_Y);
+
+    return create_device(fd, ok, name ? name : "mouse-receiver", 0x0104); // 复合设备
+}
+
+// 创建虚拟键盘设备
+UinputOutput* uinput_output_init_keyboard(const char* name) {
+    int fd = open_uinput();
+    if (fd < 0) return NULL;
+
+    // 所有键盘按键（不含鼠标、手柄等按钮区间）和扫描码
+    bool ok = ioctl(fd, UI_SET_EVBIT, EV_KEY) == 0 &&
+              ioctl(fd, UI_SET_EVBIT, EV_MSC) == 0 &&
+              ioctl(fd, UI_SET_MSCBIT, MSC_SCAN) == 0;
+    for (int code = KEY_ESC; ok && code < KEY_MAX; code++) {
+        if (code >= BTN_MISC && code < KEY_OK) continue;
+        if (code >= BTN_TRIGGER_HAPPY) break;
+        ok = ioctl(fd, UI_SET_KEYBIT, code) == 0;
+    }
+
+    return create_device(fd, ok, name ? name : "mouse-receiver-keyboard", 0x0105);
+}
+
+// 销毁虚拟设备
+void uinput_output_cleanup(UinputOutput* out) {
+    if (!out) return;
+
+    ioctl(out->fd, UI_DEV_DESTROY);
+    close(out->fd);
+    free(out);
+}
+
+// 相对位置转设备坐标
+static int32_t to_abs(float rel) {
+    if (!(rel > 0.0f)) return 0; // 同时处理NaN
+    if (rel >= 1.0f) return UINPUT_POS_MAX;
+    return (int32_t)lroundf(rel * UINPUT_POS_MAX);
+}
+
+// 移动到绝对位置
+void uinput_output_move(UinputOutput* out, float rel_x, float rel_y) {
+    if (!out) return;
+
+    queue_event(out, EV_ABS, ABS_X, to_abs(rel_x));
+    queue_event(out, EV_ABS, ABS_Y, to_abs(rel_y));
+}
+
+// 按下或释放按钮
+void uinput_output_button(UinputOutput* out, uint16_t button, bool pressed) {
+    if (!out) return;
+
+    queue_event(out, EV_KEY, button, pressed ? 1 : 0);
+}
+
+// 累计滚动量，返回满一格的格数；方向改变时丢弃之前不足一格的部分
+static int32_t wheel_notches(int32_t* remainder, int32_t delta) {
+    if ((delta > 0 && *remainder < 0) || (delta < 0 && *remainder > 0)) {
+        *remainder = 0;
+    }
+    *remainder += delta;
+    int32_t notches = *remainder / UINPUT_WHEEL_UNITS;
+    *remainder -= notches * UINPUT_WHEEL_UNITS;
+    return notches;
+}
+
+// 滚动
+void uinput_output_scroll(UinputOutput* out, int32_t delta_x, int32_t delta_y) {
+    if (!out) return;
+
+    if (delta_y != 0) {
+        queue_event(out, EV_REL, REL_WHEEL_HI_RES, delta_y);
+        int32_t notches = wheel_notches(&out->wheel_rem_y, delta_y);
+        if (notches != 0) queue_event(out, EV_REL, REL_WHEEL, notches);
+    }
+    if (delta_x != 0) {
+        queue_event(out, EV_REL, REL_HWHEEL_HI_RES, delta_x);
+        int32_t notches = wheel_notches(&out->wheel_rem_x, delta_x);
+        if (notches != 0) queue_event(out, EV_REL, REL_HWHEEL, notches);
+    }
+}
+
+// 键盘按键
+void uinput_output_key(UinputOutput* out, uint16_t code, int32_t value, uint32_t scancode) {
+    if (!out) return;
+
+    if (scancode != 0) {
+        queue_event(out, EV_MSC, MSC_SCAN, (int32_t)scancode);
+    }
+    queue_event(out, EV_KEY, code, value);
+}
+
+// 一次write()写出整帧
+bool uinput_output_sync(UinputOutput* out) {
+    if (!out || out->frame_count == 0) return true;
+
+    // queue_event保证总留有EV_SYN的位置
+    struct input_event* syn = &out->frame[out->frame_count++];
+    memset(syn, 0, sizeof(*syn));
+    syn->type = EV_SYN;
+    syn->code = SYN_REPORT;
+
+    size_t size = out->frame_count * sizeof(struct input_event);
+    ssize_t written = write(out->fd, out->frame, size);
+    out->frame_count = 0;
+
+    if (written != (ssize_t)size) {
+        perror("写入uinput事件失败");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef MOUSE_UINPUT_OUTPUT_H
+#define MOUSE_UINPUT_OUTPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// 虚拟指针设备的坐标范围（与线路编码的定点数位置一致，0..UINPUT_POS_MAX）
+#define UINPUT_POS_MAX 16384
+
+// 高精度滚轮一格的刻度数（REL_WHEEL_HI_RES）
+#define UINPUT_WHEEL_UNITS 120
+
+// 通过/dev/uinput创建的虚拟设备：绝对坐标指针或键盘
+typedef struct UinputOutput UinputOutput;
+
+// 创建虚拟指针设备，失败返回NULL（需要/dev/uinput的写权限）
+UinputOutput* uinput_output_init(const char* name);
+
+// 创建虚拟键盘设备，失败返回NULL；不声明EV_REP，自动重复由发送端的重复事件决定
+UinputOutput* uinput_output_init_keyboard(const char* name);
+
+// 销毁虚拟设备
+void uinput_output_cleanup(UinputOutput* out);
+
+// 移动到绝对位置（0.0-1.0），在下次uinput_output_sync时生效
+void uinput_output_move(UinputOutput* out, float rel_x, float rel_y);
+
+// 按下或释放按钮（BTN_LEFT等），在下次uinput_output_sync时生效
+void uinput_output_button(UinputOutput* out, uint16_t button, bool pressed);
+
+// 滚动（1/UINPUT_WHEEL_UNITS格，正值向上/向右），在下次uinput_output_sync时生效
+// 同时发出高精度滚轮事件和累计满一格时的普通滚轮事件
+void uinput_output_scroll(UinputOutput* out, int32_t delta_x, int32_t delta_y);
+
+// 键盘按下、释放（value为0/1/2，2为自动重复），scancode非0时先发出MSC_SCAN，在下次uinput_output_sync时生效
+void uinput_output_key(UinputOutput* out, uint16_t code, int32_t value, uint32_t scancode);
+
+// 发出EV_SYN，把之前的事件作为一帧交给内核，返回是否成功
+bool uinput_output_sync(UinputOutput* out);
+
+#endif // MOUSE_UINPUT_OUTPUT_H
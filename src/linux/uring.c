@@ -0,0 +1,411 @@
+#include "uring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// 内核头文件5.19以上才有提供缓冲区环（IORING_REGISTER_PBUF_RING）
+#if defined(__NR_io_uring_setup) && defined(IORING_RECVSEND_POLL_FIRST)
+
+// IORING_OP_READ_MULTISHOT（6.7）在较旧的内核头文件中没有，操作码是固定的
+#define OP_READ_MULTISHOT 49
+
+// 提供缓冲区的组号，只有一组
+#define BUFFER_GROUP 0
+
+struct Uring {
+    int fd;                        // io_uring描述符
+    void* ring_mem;                // 提交和完成队列共用的映射
+    size_t ring_size;
+    struct io_uring_sqe* sqes;     // 提交队列项
+    size_t sqes_size;
+    unsigned int* sq_head;         // 提交队列（内核推进head）
+    unsigned int* sq_tail;
+    unsigned int* sq_array;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int sq_local_tail;    // 已排队、尚未提交的请求写到这里
+    unsigned int* cq_head;         // 完成队列（内核推进tail）
+    unsigned int* cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe* cqes;
+    struct io_uring_buf_ring* buf_ring; // 提供缓冲区环，未注册时为NULL
+    size_t buf_ring_size;
+    unsigned int buf_mask;
+    uint16_t buf_tail;             // 归还的缓冲区写到这里
+    uint8_t* buf_mem;              // 所有提供缓冲区
+    size_t buf_size;               // 每个缓冲区的大小
+};
+
+// 创建io_uring
+Uring* uring_init(unsigned int entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) return NULL;
+
+    // 需要一次映射同时包含两个队列、带超时的等待，以及成功时不产生完成
+    unsigned int required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG |
+                            IORING_FEAT_CQE_SKIP;
+    if ((params.features & required) != required) {
+        close(fd);
+        errno = ENOSYS;
+        return NULL;
+    }
+
+    Uring* ring = (Uring*)calloc(1, sizeof(Uring));
+    if (!ring) {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring_mem = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd, IORING_OFF_SQ_RING);
+    if (ring->ring_mem == MAP_FAILED) {
+        close(fd);
+        free(ring);
+        return NULL;
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        munmap(ring->ring_mem, ring->ring_size);
+        close(fd);
+        free(ring);
+        return NULL;
+    }
+
+    char* base = (char*)ring->ring_mem;
+    ring->sq_head = (unsigned int*)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned int*)(base + params.sq_off.tail);
+    ring->sq_array = (unsigned int*)(base + params.sq_off.array);
+    ring->sq_mask = *(unsigned int*)(base + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned int*)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned int*)(base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned int*)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+    return ring;
+}
+
+// 释放io_uring
+void uring_cleanup(Uring* ring) {
+    if (!ring) return;
+
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->ring_mem, ring->ring_size);
+    close(ring->fd);
+
+    // 关闭io_uring之后才释放提供缓冲区
+    if (ring->buf_ring) {
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    }
+    free(ring->buf_mem);
+    free(ring);
+}
+
+// 内核是否支持某个操作
+static bool supports_op(Uring* ring, unsigned int op) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+    if (!probe) return false;
+
+    bool supported = false;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+        op <= probe->last_op && op < probe->ops_len) {
+        supported = (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+    free(probe);
+    return supported;
+}
+
+// 把缓冲区放回提供缓冲区环的尾部
+static void add_buffer(Uring* ring, int buffer) {
+    struct io_uring_buf* buf = &ring->buf_ring->bufs[ring->buf_tail & ring->buf_mask];
+    buf->addr = (uint64_t)(uintptr_t)(ring->buf_mem + (size_t)buffer * ring->buf_size);
+    buf->len = (uint32_t)ring->buf_size;
+    buf->bid = (uint16_t)buffer;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+// 注册提供缓冲区
+bool uring_init_buffers(Uring* ring, unsigned int count, size_t size) {
+    if (!ring || ring->buf_ring || count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+        errno = EINVAL;
+        return false;
+    }
+    if (!supports_op(ring, OP_READ_MULTISHOT)) {
+        errno = ENOSYS;
+        return false;
+    }
+
+    // 缓冲区环须按页对齐
+    ring->buf_ring_size = count * sizeof(struct io_uring_buf);
+    ring->buf_ring = (struct io_uring_buf_ring*)mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE,
+                                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    ring->buf_mem = (uint8_t*)calloc(count, size);
+    if (ring->buf_ring == MAP_FAILED || !ring->buf_mem) {
+        int saved = ring->buf_ring == MAP_FAILED ? errno : ENOMEM;
+        if (ring->buf_ring != MAP_FAILED) {
+            munmap(ring->buf_ring, ring->buf_ring_size);
+        }
+        ring->buf_ring = NULL;
+        free(ring->buf_mem);
+        ring->buf_mem = NULL;
+        errno = saved;
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries = count;
+    reg.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int saved = errno;
+        munmap(ring->buf_ring, ring->buf_ring_size);
+        ring->buf_ring = NULL;
+        free(ring->buf_mem);
+        ring->buf_mem = NULL;
+        errno = saved;
+        return false;
+    }
+
+    ring->buf_mask = count - 1;
+    ring->buf_size = size;
+    ring->buf_tail = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        add_buffer(ring, (int)i);
+    }
+    return true;
+}
+
+// 提供缓冲区的地址
+void* uring_buffer(Uring* ring, int buffer) {
+    return ring->buf_mem + (size_t)buffer * ring->buf_size;
+}
+
+// 归还提供缓冲区
+void uring_return_buffer(Uring* ring, int buffer) {
+    if (buffer >= 0 && ring->buf_ring) {
+        add_buffer(ring, buffer);
+    }
+}
+
+// 取一个空闲的提交队列项，已满时返回NULL
+static struct io_uring_sqe* next_sqe(Uring* ring) {
+    unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->sq_entries) return NULL;
+
+    unsigned int index = ring->sq_local_tail & ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    return sqe;
+}
+
+// 排队一次读取
+bool uring_queue_read(Uring* ring, int fd, void* buf, size_t len, uint64_t tag) {
+    struct io_uring_sqe* sqe = next_sqe(ring);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->off = (uint64_t)-1; // 从当前位置读取，设备节点没有偏移
+    sqe->user_data = tag;
+    return true;
+}
+
+// 排队multishot读取，从提供缓冲区中选取缓冲区
+bool uring_queue_read_multishot(Uring* ring, int fd, uint64_t tag) {
+    if (!ring->buf_ring) return false;
+
+    struct io_uring_sqe* sqe = next_sqe(ring);
+    if (!sqe) return false;
+
+    sqe->opcode = OP_READ_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->fd = fd;
+    sqe->off = (uint64_t)-1;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = tag;
+    return true;
+}
+
+// 排队一次发送
+bool uring_queue_send(Uring* ring, int fd, const void* buf, size_t len, unsigned int flags, uint64_t tag) {
+    struct io_uring_sqe* sqe = next_sqe(ring);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    if (flags & URING_SEND_LINK) {
+        sqe->flags |= IOSQE_IO_LINK;
+    }
+    if (flags & URING_SEND_SKIP_SUCCESS) {
+        sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    }
+    sqe->user_data = tag;
+    return true;
+}
+
+// 排队一次poll
+bool uring_queue_poll(Uring* ring, int fd, unsigned int events, uint64_t tag) {
+    struct io_uring_sqe* sqe = next_sqe(ring);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = tag;
+    return true;
+}
+
+// 排队取消请求
+bool uring_queue_cancel(Uring* ring, uint64_t target, uint64_t tag) {
+    struct io_uring_sqe* sqe = next_sqe(ring);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = tag;
+    return true;
+}
+
+// 完成队列中是否有完成
+static bool has_completion(Uring* ring) {
+    return __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) != *ring->cq_head;
+}
+
+// 提交并等待：排队的请求和等待合为一次io_uring_enter
+int uring_submit_and_wait(Uring* ring, unsigned int wait_nr, int64_t timeout_us) {
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned int to_submit = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    // 已有完成时不等待，只提交
+    if (has_completion(ring)) {
+        wait_nr = 0;
+    }
+    if (to_submit == 0 && wait_nr == 0) return 0;
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_us >= 0) {
+        ts.tv_sec = timeout_us / 1000000;
+        ts.tv_nsec = (long long)(timeout_us % 1000000) * 1000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    unsigned int flags = IORING_ENTER_EXT_ARG | (wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    long rc = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr, flags, &arg, sizeof(arg));
+    if (rc < 0) {
+        // 完成队列溢出（EBUSY）时先取走已有的完成
+        return errno == EBUSY ? 0 : -errno;
+    }
+
+    // 提交了请求时io_uring_enter返回提交数，等待超时或被打断不反映在返回值中，按完成队列是否为空判断
+    if (wait_nr > 0 && !has_completion(ring)) {
+        return timeout_us >= 0 ? -ETIME : -EINTR;
+    }
+    return 0;
+}
+
+// 取出一个完成
+bool uring_next_completion(Uring* ring, UringCompletion* completion) {
+    unsigned int head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return false;
+
+    const struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+    completion->tag = cqe->user_data;
+    completion->result = cqe->res;
+    completion->more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    completion->buffer = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else // 内核头文件不支持io_uring：总是退回其他方式
+
+Uring* uring_init(unsigned int entries) {
+    (void)entries;
+    errno = ENOSYS;
+    return NULL;
+}
+
+void uring_cleanup(Uring* ring) {
+    (void)ring;
+}
+
+bool uring_init_buffers(Uring* ring, unsigned int count, size_t size) {
+    (void)ring; (void)count; (void)size;
+    errno = ENOSYS;
+    return false;
+}
+
+void* uring_buffer(Uring* ring, int buffer) {
+    (void)ring; (void)buffer;
+    return NULL;
+}
+
+void uring_return_buffer(Uring* ring, int buffer) {
+    (void)ring; (void)buffer;
+}
+
+bool uring_queue_read(Uring* ring, int fd, void* buf, size_t len, uint64_t tag) {
+    (void)ring; (void)fd; (void)buf; (void)len; (void)tag;
+    return false;
+}
+
+bool uring_queue_read_multishot(Uring* ring, int fd, uint64_t tag) {
+    (void)ring; (void)fd; (void)tag;
+    return false;
+}
+
+bool uring_queue_send(Uring* ring, int fd, const void* buf, size_t len, unsigned int flags, uint64_t tag) {
+    (void)ring; (void)fd; (void)buf; (void)len; (void)flags; (void)tag;
+    return false;
+}
+
+bool uring_queue_poll(Uring* ring, int fd, unsigned int events, uint64_t tag) {
+    (void)ring; (void)fd; (void)events; (void)tag;
+    return false;
+}
+
+bool uring_queue_cancel(Uring* ring, uint64_t target, uint64_t tag) {
+    (void)ring; (void)target; (void)tag;
+    return false;
+}
+
+int uring_submit_and_wait(Uring* ring, unsigned int wait_nr, int64_t timeout_us) {
+    (void)ring; (void)wait_nr; (void)timeout_us;
+    return -ENOSYS;
+}
+
+bool uring_next_completion(Uring* ring, UringCompletion* completion) {
+    (void)ring; (void)completion;
+    return false;
+}
+
+#endif
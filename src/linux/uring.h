@@ -0,0 +1,70 @@
+#ifndef MOUSE_URING_H
+#define MOUSE_URING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * 最小的io_uring封装，直接使用系统调用，不依赖liburing
+ *
+ * 只提供输入捕获和发送线程需要的操作：读取（单次或multishot）、发送、poll和取消。
+ * 排队的请求在下一次uring_submit_and_wait时与等待完成合为一次io_uring_enter。
+ * 需要内核5.17以上（IORING_FEAT_EXT_ARG等待可以带超时，IORING_FEAT_CQE_SKIP成功时可以不产生完成），
+ * 不满足时uring_init返回NULL。
+ */
+
+// io_uring实例
+typedef struct Uring Uring;
+
+// 一个完成
+typedef struct {
+    uint64_t tag;                  // 请求的标签
+    int32_t result;                // 请求的返回值（负数为-errno）
+    bool more;                     // multishot请求之后还有完成；为false时请求已结束，需要时重新排队
+    int buffer;                    // 读取使用的提供缓冲区编号，没有时为-1，处理完后用uring_return_buffer归还
+} UringCompletion;
+
+// 发送请求的选项
+#define URING_SEND_LINK 1          // 与下一个请求链接：本请求完成（全部写出）后才开始下一个，失败时后面的请求被取消
+#define URING_SEND_SKIP_SUCCESS 2  // 成功时不产生完成，只有失败和被取消时才有
+
+// 创建io_uring，entries为提交队列的大小；内核不支持或被禁用时返回NULL并设置errno
+Uring* uring_init(unsigned int entries);
+
+// 释放io_uring，内核取消所有尚未完成的请求
+void uring_cleanup(Uring* ring);
+
+// 注册count个size字节的提供缓冲区，供multishot读取选用；count须为2的幂。
+// 内核不支持multishot读取（6.7以下）时返回false并设置errno
+bool uring_init_buffers(Uring* ring, unsigned int count, size_t size);
+
+// 提供缓冲区的地址
+void* uring_buffer(Uring* ring, int buffer);
+
+// 处理完读到的数据后归还提供缓冲区
+void uring_return_buffer(Uring* ring, int buffer);
+
+// 排队一次读取（从当前位置），完成时返回tag；提交队列已满时返回false
+bool uring_queue_read(Uring* ring, int fd, void* buf, size_t len, uint64_t tag);
+
+// 排队multishot读取：每次有数据时读入一个提供缓冲区产生一个完成，直到出错、被取消或缓冲区用完
+bool uring_queue_read_multishot(Uring* ring, int fd, uint64_t tag);
+
+// 排队一次发送（MSG_WAITALL，部分写出视为失败，链接的后续请求被取消）；flags为URING_SEND_*
+bool uring_queue_send(Uring* ring, int fd, const void* buf, size_t len, unsigned int flags, uint64_t tag);
+
+// 排队一次poll，events为POLLIN等，完成的结果为就绪的事件
+bool uring_queue_poll(Uring* ring, int fd, unsigned int events, uint64_t tag);
+
+// 排队取消带有target标签的请求，被取消的请求以-ECANCELED完成；取消本身的完成返回tag
+bool uring_queue_cancel(Uring* ring, uint64_t target, uint64_t tag);
+
+// 提交排队的请求并等待至少wait_nr个完成（已有完成时不等待），timeout_us为-1时一直等待；
+// 返回0，超时返回-ETIME，被信号打断返回-EINTR，其他错误返回负的errno
+int uring_submit_and_wait(Uring* ring, unsigned int wait_nr, int64_t timeout_us);
+
+// 取出一个完成，没有时返回false
+bool uring_next_completion(Uring* ring, UringCompletion* completion);
+
+#endif // MOUSE_URING_H
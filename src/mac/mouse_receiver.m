@@ -1,13 +1,88 @@
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
 #include "../common/network.h"
+#include "../common/predictor.h"
+#include "../common/jitter_buffer.h"
+#include "../common/log.h"
+
+// Linux键码到Mac虚拟键码（kVK_*）的对应，没有对应的键不注入
+static const struct {
+    uint16_t linux_code;
+    CGKeyCode mac_code;
+} key_map[] = {
+    {1, 0x35},   {2, 0x12},   {3, 0x13},   {4, 0x14},   {5, 0x15},   {6, 0x17},   {7, 0x16},   // Esc 1-6
+    {8, 0x1A},   {9, 0x1C},   {10, 0x19},  {11, 0x1D},  {12, 0x1B},  {13, 0x18},  {14, 0x33},  // 7-0 - = 退格
+    {15, 0x30},  {16, 0x0C},  {17, 0x0D},  {18, 0x0E},  {19, 0x0F},  {20, 0x11},  {21, 0x10},  // Tab Q-Y
+    {22, 0x20},  {23, 0x22},  {24, 0x1F},  {25, 0x23},  {26, 0x21},  {27, 0x1E},  {28, 0x24},  // U-P [ ] 回车
+    {29, 0x3B},  {30, 0x00},  {31, 0x01},  {32, 0x02},  {33, 0x03},  {34, 0x05},  {35, 0x04},  // 左Ctrl A-H
+    {36, 0x26},  {37, 0x28},  {38, 0x25},  {39, 0x29},  {40, 0x27},  {41, 0x32},  {42, 0x38},  // J-L ; ' ` 左Shift
+    {43, 0x2A},  {44, 0x06},  {45, 0x07},  {46, 0x08},  {47, 0x09},  {48, 0x0B},  {49, 0x2D},  // \ Z-N
+    {50, 0x2E},  {51, 0x2B},  {52, 0x2F},  {53, 0x2C},  {54, 0x3C},  {55, 0x43},  {56, 0x3A},  // M , . / 右Shift 小键盘* 左Alt
+    {57, 0x31},  {58, 0x39},  {59, 0x7A},  {60, 0x78},  {61, 0x63},  {62, 0x76},  {63, 0x60},  // 空格 大写锁定 F1-F5
+    {64, 0x61},  {65, 0x62},  {66, 0x64},  {67, 0x65},  {68, 0x6D},  {69, 0x47},  {71, 0x59},  // F6-F10 NumLock 小键盘7
+    {72, 0x5B},  {73, 0x5C},  {74, 0x4E},  {75, 0x56},  {76, 0x57},  {77, 0x58},  {78, 0x45},  // 小键盘8 9 - 4 5 6 +
+    {79, 0x53},  {80, 0x54},  {81, 0x55},  {82, 0x52},  {83, 0x41},  {86, 0x0A},  {87, 0x67},  // 小键盘1 2 3 0 . 102ND F11
+    {88, 0x6F},  {96, 0x4C},  {97, 0x3E},  {98, 0x4B},  {100, 0x3D}, {102, 0x73}, {103, 0x7E}, // F12 小键盘回车 右Ctrl / 右Alt Home 上
+    {104, 0x74}, {105, 0x7B}, {106, 0x7C}, {107, 0x77}, {108, 0x7D}, {109, 0x79}, {110, 0x72}, // PgUp 左 右 End 下 PgDn Insert
+    {111, 0x75}, {113, 0x4A}, {114, 0x49}, {115, 0x48}, {117, 0x51}, {125, 0x37}, {126, 0x36}, // Delete 静音 音量- 音量+ 小键盘= 左右Command
+    {183, 0x69}, {184, 0x6B}, {185, 0x71}, {186, 0x6A}, {187, 0x40}, {188, 0x4F}, {189, 0x50}, // F13-F19
+    {190, 0x5A},                                                                                 // F20
+};
+
+// 修饰键对应的事件标志
+static CGEventFlags modifier_flag(uint16_t linux_code) {
+    switch (linux_code) {
+        case 42: case 54:  return kCGEventFlagMaskShift;     // Shift
+        case 29: case 97:  return kCGEventFlagMaskControl;   // Ctrl
+        case 56: case 100: return kCGEventFlagMaskAlternate; // Alt/Option
+        case 125: case 126: return kCGEventFlagMaskCommand;  // Meta/Command
+        default: return 0;
+    }
+}
+
+// 查找Linux键码对应的Mac虚拟键码
+static bool map_key(uint16_t linux_code, CGKeyCode *mac_code) {
+    for (size_t i = 0; i < sizeof(key_map) / sizeof(key_map[0]); i++) {
+        if (key_map[i].linux_code == linux_code) {
+            *mac_code = key_map[i].mac_code;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 滚轮一格对应的像素数，滚动按像素注入，高精度滚轮不足一格的刻度也能平滑滚动
+#define SCROLL_PIXELS_PER_NOTCH 40.0
+
+// 延迟统计的阶段
+enum {
+    LATENCY_CAPTURE = 0,   // 内核采集到发送端读取
+    LATENCY_QUEUE,         // 发送端读取到发出
+    LATENCY_NETWORK,       // 发出到接收端收到（需要时钟同步）
+    LATENCY_DISPATCH,      // 收到到注入系统事件完成
+    LATENCY_TOTAL,         // 端到端
+    LATENCY_STAGE_COUNT
+};
+
+// 每秒的延迟统计（微秒）
+typedef struct {
+    uint64_t count[LATENCY_STAGE_COUNT];
+    uint64_t sum[LATENCY_STAGE_COUNT];
+    uint64_t max[LATENCY_STAGE_COUNT];
+} LatencyStats;
 
 // 应用程序状态
 typedef struct {
     NetworkContext *network;      // 网络上下文
     uint16_t port;                // 监听端口
+    NetworkTransport transport;   // 传输方式
+    NetworkArbitration arbitration; // 多个发送端时的控制权仲裁策略
+    unsigned int hold_ms;         // 控制权保持时间
+    const char *priorities[NETWORK_MAX_PEERS]; // -P参数：<地址>:<优先级>
+    int priority_count;           // -P参数个数
     int screen_width;             // 屏幕宽度
     int screen_height;            // 屏幕高度
+    uint16_t refresh_hz;          // 显示刷新率
     bool running;                 // 运行标志
     uint8_t last_buttons;         // 上次按钮状态
     CGPoint last_position;        // 上次鼠标位置
@@ -25,6 +100,19 @@ typedef struct {
     bool click_processed;         // 当前点击是否已处理
     bool in_drag_mode;            // 是否处于拖动模式
     NSTimer *long_press_timer;    // 长按检测定时器
+    double scroll_rem_x;          // 不足一像素的水平滚动量
+    double scroll_rem_y;          // 不足一像素的垂直滚动量
+    uint8_t keys_down[96];        // 已注入按下、尚未释放的键（Linux键码，KEY_MAX为0x2ff）
+    uint32_t keys_owner;          // 按下这些键的发送端
+    CGEventFlags key_flags;       // 当前按下的修饰键
+    uint32_t move_owner;          // 最近一条移动消息的发送端
+    bool owner_changed;           // 换了发送端，预测需要重新开始
+    MotionPredictor predictor;    // 移动预测，-x参数开启
+    dispatch_source_t predict_timer; // 预测位置的更新定时器，按显示刷新率触发
+    bool predict_armed;           // 更新定时器是否在运行
+    JitterBuffer jitter;          // 移动消息的播放缓冲，-j参数开启
+    dispatch_source_t playout_timer; // 缓冲中最早一条消息的播放定时器
+    LatencyStats latency;         // 本秒的延迟统计
 } AppState;
 
 // 全局状态用于定时器回调
@@ -39,7 +127,7 @@ void long_press_timer_callback(NSTimer *timer) {
     
     state->long_press_sent = true;
     state->in_drag_mode = true;
-    printf("定时器触发长按，启用拖动模式\n");
+    LOG_INFO("定时器触发长按，启用拖动模式");
     
     // 产生一个小的鼠标移动，触发拖动
     CGPoint point = state->last_position;
@@ -70,7 +158,7 @@ static void handle_mouse_buttons(AppState *state, CGPoint point, uint8_t current
     
     // 防止重复处理同一个消息
     if (message_id > 0 && message_id == state->last_message_id) {
-        printf("忽略重复消息 ID: %llu\n", message_id);
+        LOG_DEBUG("忽略重复消息 ID: %llu", (unsigned long long)message_id);
         return;
     }
     
@@ -85,7 +173,7 @@ static void handle_mouse_buttons(AppState *state, CGPoint point, uint8_t current
         if (current_buttons & 0x01) {
             // 如果此时已经处理过点击，忽略重复的按下事件
             if (state->mousedown_sent && !state->mouseup_sent) {
-                printf("忽略重复的mousedown事件\n");
+                LOG_DEBUG("忽略重复的mousedown事件");
                 return;
             }
             
@@ -100,7 +188,7 @@ static void handle_mouse_buttons(AppState *state, CGPoint point, uint8_t current
             
             // 计算与上次点击的时间间隔
             NSTimeInterval click_interval = current_time - state->last_click_time;
-            printf("检测到按下事件，点击间隔: %.3f秒\n", click_interval);
+            LOG_DEBUG("检测到按下事件，点击间隔: %.3f秒", click_interval);
             
             // 检查是否应该触发双击
             if (!state->disable_double_click && 
@@ -109,10 +197,10 @@ static void handle_mouse_buttons(AppState *state, CGPoint point, uint8_t current
                 
                 state->click_count = 2;
                 state->double_click_pending = false;
-                printf("触发双击事件 (间隔: %.3f秒)\n", click_interval);
+                LOG_INFO("触发双击事件 (间隔: %.3f秒)", click_interval);
             } else {
                 state->click_count = 1;
-                printf("触发单击事件\n");
+                LOG_DEBUG("触发单击事件");
             }
             
             // 创建鼠标按下事件
@@ -143,12 +231,12 @@ static void handle_mouse_buttons(AppState *state, CGPoint point, uint8_t current
             
             // 确保定时器在当前运行循环的所有模式下都能运行
             [[NSRunLoop currentRunLoop] addTimer:state->long_press_timer forMode:NSRunLoopCommonModes];
-            printf("已设置长按检测定时器\n");
+            LOG_DEBUG("已设置长按检测定时器");
         } else {
             // 左键释放 - 这里是处理Linux端实际发送的释放消息的关键部分
             // 如果没有对应的按下事件，忽略此释放事件
             if (!state->mousedown_sent || state->mouseup_sent) {
-                printf("忽略孤立的mouseup事件\n");
+                LOG_DEBUG("忽略孤立的mouseup事件");
                 return;
             }
             
@@ -180,11 +268,11 @@ static void handle_mouse_buttons(AppState *state, CGPoint point, uint8_t current
             // 如果是长按释放，重置点击状态
             if (was_long_press || was_in_drag_mode) {
                 state->double_click_pending = false;
-                printf("长按或拖动释放: 重置双击状态\n");
+                LOG_DEBUG("长按或拖动释放: 重置双击状态");
             } else if (state->click_count == 1) {
                 // 如果是普通单击释放，设置双击挂起状态
                 state->double_click_pending = true;
-                printf("设置双击挂起状态\n");
+                LOG_DEBUG("设置双击挂起状态");
             }
             
             // 重置长按状态
@@ -210,7 +298,7 @@ static void handle_mouse_buttons(AppState *state, CGPoint point, uint8_t current
             if (press_duration > 0.5) {
                 state->long_press_sent = true;
                 state->in_drag_mode = true;
-                printf("检测到长按: %.2f秒，启用拖动模式\n", press_duration);
+                LOG_INFO("检测到长按: %.2f秒，启用拖动模式", press_duration);
                 
                 // 发送一个微小的拖动事件以触发系统的拖动操作
                 CGPoint slight_move = point;
@@ -278,6 +366,18 @@ static void handle_mouse_buttons(AppState *state, CGPoint point, uint8_t current
         CFRelease(event);
     }
     
+    // 侧键等其他按钮直接注入，按钮编号从3开始
+    for (int i = 3; i < MOUSE_BUTTON_COUNT; i++) {
+        uint8_t mask = (uint8_t)(1 << i);
+        if (!(changed_buttons & mask)) continue;
+        
+        CGEventType type = (current_buttons & mask) ? kCGEventOtherMouseDown : kCGEventOtherMouseUp;
+        CGEventRef event = CGEventCreateMouseEvent(NULL, type, point, (CGMouseButton)i);
+        CGEventSetIntegerValueField(event, kCGMouseEventButtonNumber, i);
+        CGEventPost(kCGHIDEventTap, event);
+        CFRelease(event);
+    }
+    
     // 若超过双击时间窗，重置双击状态
     if (!button_state_changed && 
         current_time - state->last_click_time > 0.5 && 
@@ -285,7 +385,7 @@ static void handle_mouse_buttons(AppState *state, CGPoint point, uint8_t current
         !(current_buttons & 0x01)) { // 不在按键按下状态才重置
         
         state->double_click_pending = false;
-        printf("超时: 重置双击状态\n");
+        LOG_DEBUG("超时: 重置双击状态");
     }
 }
 
@@ -315,7 +415,7 @@ static void handle_mouse_move(AppState *state, CGPoint point, uint8_t current_bu
         if (press_duration > 0.5) {
             state->long_press_sent = true;
             state->in_drag_mode = true;
-            printf("鼠标移动时检测到长按: %.2f秒，启用拖动模式\n", press_duration);
+            LOG_INFO("鼠标移动时检测到长按: %.2f秒，启用拖动模式", press_duration);
             
             // 停止长按检测定时器
             [state->long_press_timer invalidate];
@@ -350,51 +450,370 @@ static void handle_mouse_move(AppState *state, CGPoint point, uint8_t current_bu
     state->last_move_time = [[NSDate date] timeIntervalSince1970];
 }
 
+// 记录一个阶段的延迟
+static void record_latency(LatencyStats *stats, int stage, int64_t us) {
+    if (us < 0) us = 0; // 时钟偏差估计的误差可能使结果略小于0
+    stats->count[stage]++;
+    stats->sum[stage] += (uint64_t)us;
+    if ((uint64_t)us > stats->max[stage]) {
+        stats->max[stage] = (uint64_t)us;
+    }
+}
+
+// 计算一条移动消息各阶段的延迟
+static void measure_latency(AppState *state, const MouseMoveMessage *mouse_msg) {
+    if (mouse_msg->timestamp == 0 || mouse_msg->receive_us == 0) return;
+    
+    uint64_t done_us = network_time_us();
+    record_latency(&state->latency, LATENCY_CAPTURE, mouse_msg->read_delay_us);
+    record_latency(&state->latency, LATENCY_QUEUE, mouse_msg->queue_delay_us);
+    record_latency(&state->latency, LATENCY_DISPATCH, (int64_t)(done_us - mouse_msg->receive_us));
+    
+    // 发送端时间换算到本地时钟后才能计算网络和端到端延迟
+    int64_t offset;
+    if (network_get_clock_offset(state->network, &offset, NULL)) {
+        int64_t capture_local = (int64_t)mouse_msg->timestamp - offset;
+        int64_t sent_local = capture_local + mouse_msg->read_delay_us + mouse_msg->queue_delay_us;
+        record_latency(&state->latency, LATENCY_NETWORK, (int64_t)mouse_msg->receive_us - sent_local);
+        record_latency(&state->latency, LATENCY_TOTAL, (int64_t)done_us - capture_local);
+    }
+}
+
+// 打印并清空本秒的延迟统计
+static void report_latency(AppState *state) {
+    static const char *names[LATENCY_STAGE_COUNT] = {"采集", "排队", "网络", "注入", "总计"};
+    LatencyStats *stats = &state->latency;
+    
+    if (stats->count[LATENCY_DISPATCH] == 0) return;
+    
+    printf("延迟(微秒, 平均/最大):");
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        if (stats->count[i] == 0) {
+            printf(" %s=-", names[i]);
+        } else {
+            printf(" %s=%llu/%llu", names[i], (unsigned long long)(stats->sum[i] / stats->count[i]),
+                   (unsigned long long)stats->max[i]);
+        }
+    }
+    
+    uint64_t rtt;
+    if (network_get_clock_offset(state->network, NULL, &rtt)) {
+        printf(" 往返=%llu", (unsigned long long)rtt);
+    }
+    if (jitter_buffer_enabled(&state->jitter)) {
+        printf(" 缓冲=%u 抖动=%.0f", state->jitter.delay_us, state->jitter.jitter_us);
+    }
+    printf(" (%llu条)\n", (unsigned long long)stats->count[LATENCY_DISPATCH]);
+    
+    memset(stats, 0, sizeof(LatencyStats));
+}
+
+// 处理滚轮：换算为像素，不足一像素的部分累计到下次
+static void handle_scroll(AppState *state, const ScrollMessage *scroll) {
+    double px_x = state->scroll_rem_x + scroll->delta_x * SCROLL_PIXELS_PER_NOTCH / SCROLL_UNITS_PER_NOTCH;
+    double px_y = state->scroll_rem_y + scroll->delta_y * SCROLL_PIXELS_PER_NOTCH / SCROLL_UNITS_PER_NOTCH;
+    int32_t pixels_x = (int32_t)px_x;
+    int32_t pixels_y = (int32_t)px_y;
+    state->scroll_rem_x = px_x - pixels_x;
+    state->scroll_rem_y = px_y - pixels_y;
+    if (pixels_x == 0 && pixels_y == 0) return;
+    
+    // 系统的水平滚动正值向左，与协议相反
+    CGEventRef event = CGEventCreateScrollWheelEvent(NULL, kCGScrollEventUnitPixel, 2, pixels_y, -pixels_x);
+    if (!event) return;
+    CGEventSetIntegerValueField(event, kCGScrollWheelEventIsContinuous, 1);
+    CGEventPost(kCGHIDEventTap, event);
+    CFRelease(event);
+}
+
+// 注入一个按键
+static void post_key(AppState *state, uint16_t linux_code, uint8_t value) {
+    CGKeyCode mac_code;
+    if (!map_key(linux_code, &mac_code)) return;
+    
+    bool down = value != KEY_VALUE_UP;
+    CGEventFlags flag = modifier_flag(linux_code);
+    if (flag) {
+        state->key_flags = down ? (state->key_flags | flag) : (state->key_flags & ~flag);
+    }
+    
+    CGEventRef event = CGEventCreateKeyboardEvent(NULL, mac_code, down);
+    if (!event) return;
+    CGEventSetFlags(event, state->key_flags);
+    if (value == KEY_VALUE_REPEAT) {
+        CGEventSetIntegerValueField(event, kCGKeyboardEventAutorepeat, 1);
+    }
+    CGEventPost(kCGHIDEventTap, event);
+    CFRelease(event);
+}
+
+// 释放所有已注入按下的键
+static void release_keys(AppState *state) {
+    for (uint16_t code = 0; code < sizeof(state->keys_down) * 8; code++) {
+        if (state->keys_down[code / 8] & (1 << (code % 8))) {
+            post_key(state, code, KEY_VALUE_UP);
+        }
+    }
+    memset(state->keys_down, 0, sizeof(state->keys_down));
+    state->key_flags = 0;
+}
+
+// 注入一帧按键；换了发送端时先释放之前发送端按下的键
+static void handle_keys(AppState *state, const KeyMessage *key_msg) {
+    NetworkPeerInfo peer;
+    if (network_get_current_peer(state->network, &peer) && peer.id != state->keys_owner) {
+        release_keys(state);
+        state->keys_owner = peer.id;
+    }
+    
+    for (uint8_t i = 0; i < key_msg->count; i++) {
+        const KeyEvent *key = &key_msg->keys[i];
+        if (key->code >= sizeof(state->keys_down) * 8) continue;
+        
+        post_key(state, key->code, key->value);
+        if (key->value == KEY_VALUE_UP) {
+            state->keys_down[key->code / 8] &= (uint8_t)~(1 << (key->code % 8));
+        } else {
+            state->keys_down[key->code / 8] |= (uint8_t)(1 << (key->code % 8));
+        }
+    }
+}
+
+// 网络事件：断开的发送端按着的键不会再有释放事件
+static void on_network_event(NetworkContext *ctx, NetworkEvent event, void *user_data) {
+    AppState *state = (AppState *)user_data;
+    NetworkPeerInfo peer;
+    if (event == NETWORK_EVENT_DISCONNECT && network_get_current_peer(ctx, &peer) &&
+        peer.id == state->keys_owner) {
+        release_keys(state);
+    }
+}
+
+// 预测位置需要继续更新时启动定时器，否则停止
+static void schedule_prediction(AppState *state, bool active) {
+    if (!state->predict_timer || active == state->predict_armed) return;
+    
+    uint64_t interval = NSEC_PER_SEC / (state->refresh_hz ? state->refresh_hz : 60);
+    dispatch_source_set_timer(state->predict_timer,
+                              active ? dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval) : DISPATCH_TIME_FOREVER,
+                              interval, interval / 10);
+    state->predict_armed = active;
+}
+
+// 一条移动消息加入预测，得到这次应注入的位置；按钮变化时注入真实位置并暂停外推
+static void predict_move(AppState *state, const MouseMoveMessage *mouse_msg, bool button_changed,
+                         float *x, float *y) {
+    uint64_t now_us = network_time_us();
+    
+    // 换了发送端时之前的样本不能用来估计速度
+    bool new_owner = state->owner_changed;
+    state->owner_changed = false;
+    
+    if (button_changed || new_owner) {
+        predictor_reset(&state->predictor, mouse_msg->rel_x, mouse_msg->rel_y, now_us, button_changed);
+        schedule_prediction(state, false);
+        return;
+    }
+    
+    // 速度按发送端的采集时间估计，外推从采集时刻（换算到本地时钟）算起；还没有时钟偏差估计时从收到的时刻算起
+    uint64_t receive_us = mouse_msg->receive_us ? mouse_msg->receive_us : now_us;
+    uint64_t sample_us = mouse_msg->timestamp ? mouse_msg->timestamp : receive_us;
+    uint64_t local_us = receive_us;
+    int64_t offset;
+    if (mouse_msg->timestamp && network_get_clock_offset(state->network, &offset, NULL)) {
+        local_us = (uint64_t)((int64_t)mouse_msg->timestamp - offset);
+    }
+    
+    predictor_add_sample(&state->predictor, mouse_msg->rel_x, mouse_msg->rel_y, sample_us, local_us, now_us);
+    schedule_prediction(state, predictor_update(&state->predictor, now_us, x, y));
+}
+
+// 预测定时器：移动到推进后的预测位置，位置不再变化时停止
+static void predict_timer_callback(AppState *state) {
+    if (!state->predict_armed) return;
+    
+    float x, y;
+    bool active = predictor_update(&state->predictor, network_time_us(), &x, &y);
+    CGPoint point = CGPointMake(x * state->screen_width, y * state->screen_height);
+    handle_mouse_move(state, point, state->last_buttons, 0);
+    schedule_prediction(state, active);
+}
+
+// 注入一条移动消息
+static void apply_move(AppState *state, const MouseMoveMessage *mouse_msg) {
+    // 当前按钮状态
+    uint8_t current_buttons = mouse_msg->buttons;
+    
+    // 检查按钮状态变化
+    bool button_changed = current_buttons != state->last_buttons;
+    
+    // 计算绝对坐标；开启预测时移动到预测的位置，按钮变化时仍是真实位置
+    float rel_x = mouse_msg->rel_x;
+    float rel_y = mouse_msg->rel_y;
+    if (predictor_enabled(&state->predictor)) {
+        predict_move(state, mouse_msg, button_changed, &rel_x, &rel_y);
+    }
+    CGFloat abs_x = rel_x * state->screen_width;
+    CGFloat abs_y = rel_y * state->screen_height;
+    CGPoint point = CGPointMake(abs_x, abs_y);
+    
+    // 直接处理按钮状态变化
+    if (button_changed) {
+        // 记录旧的按钮状态
+        uint8_t old_buttons = state->last_buttons;
+    
+        // 更新按钮状态
+        state->last_buttons = current_buttons;
+    
+        // 处理按钮事件 - 完全信任Linux端发送的按钮状态
+        handle_mouse_buttons(state, point, current_buttons, old_buttons, mouse_msg->sequence);
+    } else {
+        // 按钮状态没有变化，处理鼠标移动
+        handle_mouse_move(state, point, current_buttons, mouse_msg->sequence);
+    }
+    
+    measure_latency(state, mouse_msg);
+}
+
+// 按缓冲中最早一条消息的播放时间设置定时器，缓冲为空时停止
+static void schedule_playout(AppState *state) {
+    if (!state->playout_timer) return;
+    
+    uint64_t due_us;
+    if (!jitter_buffer_next_due(&state->jitter, &due_us)) {
+        dispatch_source_set_timer(state->playout_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+    
+    uint64_t now_us = network_time_us();
+    int64_t wait_ns = due_us > now_us ? (int64_t)(due_us - now_us) * NSEC_PER_USEC : 0;
+    dispatch_source_set_timer(state->playout_timer, dispatch_time(DISPATCH_TIME_NOW, wait_ns),
+                              DISPATCH_TIME_FOREVER, 100 * NSEC_PER_USEC);
+}
+
+// 移动消息放入播放缓冲，返回true表示已放入或丢弃；按钮变化和没有采集时间的消息立即注入，
+// 缓冲中更早的移动不再播放，按钮变化那一帧的位置就是发送端的真实位置
+static bool buffer_move(AppState *state, const MouseMoveMessage *mouse_msg) {
+    if (mouse_msg->buttons != state->last_buttons || mouse_msg->timestamp == 0) {
+        jitter_buffer_clear(&state->jitter, false);
+        schedule_playout(state);
+        return false;
+    }
+    
+    jitter_buffer_push(&state->jitter, mouse_msg, network_time_us());
+    schedule_playout(state);
+    return true;
+}
+
+// 播放定时器：注入所有已到播放时间的移动消息
+static void playout_timer_callback(AppState *state) {
+    MouseMoveMessage mouse_msg;
+    while (jitter_buffer_pop(&state->jitter, network_time_us(), &mouse_msg)) {
+        apply_move(state, &mouse_msg);
+    }
+    schedule_playout(state);
+}
+
 // 处理消息回调
 void message_callback(const Message* msg, size_t __unused msg_size, void* user_data) {
     AppState *state = (AppState *)user_data;
     
+    // 回复连接请求，告知显示刷新率，发送端按此频率合并移动
+    if (msg->type == MSG_CONNECT) {
+        ConnectMessage reply;
+        reply.type = MSG_CONNECT;
+        reply.version = msg->connect.version;
+        reply.refresh_hz = state->refresh_hz;
+        network_send_message(state->network, (const Message *)&reply, sizeof(reply));
+        LOG_INFO("发送端已连接，告知刷新率 %u Hz", state->refresh_hz);
+        return;
+    }
+    
+    if (msg->type == MSG_SCROLL) {
+        handle_scroll(state, &msg->scroll);
+        return;
+    }
+    
+    if (msg->type == MSG_KEY) {
+        handle_keys(state, &msg->key);
+        return;
+    }
+    
     // 只处理鼠标移动消息
     if (msg->type == MSG_MOUSE_MOVE) {
         const MouseMoveMessage *mouse_msg = (const MouseMoveMessage *)msg;
         
-        // 计算绝对坐标
-        CGFloat abs_x = mouse_msg->rel_x * state->screen_width;
-        CGFloat abs_y = mouse_msg->rel_y * state->screen_height;
-        CGPoint point = CGPointMake(abs_x, abs_y);
-        
         // 检查消息ID，避免重复处理
-        if (mouse_msg->timestamp == state->last_message_id) {
+        if (mouse_msg->sequence == state->last_message_id) {
             return;
         }
         
-        // 当前按钮状态
-        uint8_t current_buttons = mouse_msg->buttons;
-        
-        // 检查按钮状态变化
-        bool button_changed = current_buttons != state->last_buttons;
+        // 换了发送端时之前的样本不能用于预测和排期
+        NetworkPeerInfo peer;
+        if (network_get_current_peer(state->network, &peer) && peer.id != state->move_owner) {
+            state->move_owner = peer.id;
+            state->owner_changed = true;
+            jitter_buffer_clear(&state->jitter, true);
+        }
         
-        // 直接处理按钮状态变化
-        if (button_changed) {
-            // 记录旧的按钮状态
-            uint8_t old_buttons = state->last_buttons;
-            
-            // 更新按钮状态
-            state->last_buttons = current_buttons;
-            
-            // 处理按钮事件 - 完全信任Linux端发送的按钮状态
-            handle_mouse_buttons(state, point, current_buttons, old_buttons, mouse_msg->timestamp);
-        } else {
-            // 按钮状态没有变化，处理鼠标移动
-            handle_mouse_move(state, point, current_buttons, mouse_msg->timestamp);
+        if (jitter_buffer_enabled(&state->jitter) && buffer_move(state, mouse_msg)) {
+            return;
         }
+        apply_move(state, mouse_msg);
     }
 }
 
+// 解析并设置一个发送端优先级：<地址>:<优先级>
+static bool apply_priority(NetworkContext *network, const char *arg) {
+    const char *colon = strchr(arg, ':');
+    if (!colon || colon == arg || (size_t)(colon - arg) >= 16) return false;
+    
+    char address[16];
+    memcpy(address, arg, (size_t)(colon - arg));
+    address[colon - arg] = '\0';
+    return network_set_peer_priority(network, address, atoi(colon + 1));
+}
+
 // 初始化应用程序
 bool init_app(AppState *state, int argc, const char **argv) {
-    // 解析命令行参数
-    state->port = (argc > 1) ? atoi(argv[1]) : DEFAULT_PORT;
+    // 解析命令行参数：[端口] [-u] [-P 地址:优先级]... [-H 毫秒] [-x 毫秒] [-j 毫秒] [-l 级别]
+    state->port = DEFAULT_PORT;
+    state->transport = NETWORK_TRANSPORT_TCP;
+    state->arbitration = NETWORK_ARBITRATION_LAST_ACTIVE;
+    state->hold_ms = NETWORK_DEFAULT_HOLD_MS;
+    state->priority_count = 0;
+    predictor_init(&state->predictor, 0);
+    jitter_buffer_init(&state->jitter, 0);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-u") == 0) {
+            state->transport = NETWORK_TRANSPORT_UDP;
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            // 按地址设置优先级，同时启用优先级仲裁
+            state->arbitration = NETWORK_ARBITRATION_PRIORITY;
+            if (state->priority_count < NETWORK_MAX_PEERS) {
+                state->priorities[state->priority_count++] = argv[++i];
+            } else {
+                i++;
+            }
+        } else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc) {
+            state->hold_ms = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            // 移动预测最多外推的时间
+            predictor_init(&state->predictor, (uint32_t)atoi(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            // 播放缓冲的最大延迟
+            jitter_buffer_init(&state->jitter, (uint32_t)atoi(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            LogLevel level;
+            if (!log_parse_level(argv[++i], &level)) {
+                fprintf(stderr, "无效的日志级别: %s（error、warn、info或debug）\n", argv[i]);
+                return false;
+            }
+            log_set_level(level);
+        } else {
+            state->port = atoi(argv[i]);
+        }
+    }
     state->running = false;
     state->last_buttons = 0; // 初始化按钮状态
     state->last_position = CGPointMake(0, 0);
@@ -412,6 +831,17 @@ bool init_app(AppState *state, int argc, const char **argv) {
     state->click_processed = false;
     state->in_drag_mode = false;
     state->long_press_timer = nil;
+    state->scroll_rem_x = 0;
+    state->scroll_rem_y = 0;
+    memset(state->keys_down, 0, sizeof(state->keys_down));
+    state->keys_owner = 0;
+    state->key_flags = 0;
+    state->move_owner = 0;
+    state->owner_changed = false;
+    state->predict_timer = nil;
+    state->predict_armed = false;
+    state->playout_timer = nil;
+    memset(&state->latency, 0, sizeof(LatencyStats));
     
     // 获取屏幕尺寸
     NSScreen *mainScreen = [NSScreen mainScreen];
@@ -419,6 +849,17 @@ bool init_app(AppState *state, int argc, const char **argv) {
     state->screen_width = screenFrame.size.width;
     state->screen_height = screenFrame.size.height;
     
+    // 获取显示刷新率，部分显示器报告0，按60Hz处理
+    state->refresh_hz = 60;
+    CGDisplayModeRef mode = CGDisplayCopyDisplayMode(CGMainDisplayID());
+    if (mode) {
+        double rate = CGDisplayModeGetRefreshRate(mode);
+        if (rate > 0) {
+            state->refresh_hz = (uint16_t)(rate + 0.5);
+        }
+        CGDisplayModeRelease(mode);
+    }
+    
     // 初始化网络
     state->network = network_init();
     if (!state->network) {
@@ -429,23 +870,40 @@ bool init_app(AppState *state, int argc, const char **argv) {
     // 设置消息回调
     network_set_callback(state->network, message_callback, state);
     
+    // 多个发送端同时连接时的控制权仲裁
+    network_set_arbitration(state->network, state->arbitration, state->hold_ms);
+    for (int i = 0; i < state->priority_count; i++) {
+        if (!apply_priority(state->network, state->priorities[i])) {
+            fprintf(stderr, "无效的优先级设置: %s（格式为 <地址>:<优先级>）\n", state->priorities[i]);
+        }
+    }
+    
     // 开始监听
-    if (!network_start_server(state->network, state->port)) {
+    if (!network_start_server_transport(state->network, state->port, state->transport)) {
         fprintf(stderr, "无法监听端口 %d\n", state->port);
         network_cleanup(state->network);
         return false;
     }
     
     state->running = true;
-    printf("开始监听端口 %d\n", state->port);
-    printf("屏幕分辨率: %d x %d\n", state->screen_width, state->screen_height);
+    printf("开始监听端口 %d (%s)\n", state->port,
+           state->transport == NETWORK_TRANSPORT_UDP ? "UDP" : "TCP");
+    printf("屏幕分辨率: %d x %d, 刷新率: %u Hz\n", state->screen_width, state->screen_height, state->refresh_hz);
     printf("双击功能和长按功能已启用（简化版）\n");
+    if (predictor_enabled(&state->predictor)) {
+        printf("移动预测已开启，最多外推 %u 毫秒\n", state->predictor.horizon_us / 1000);
+    }
+    if (jitter_buffer_enabled(&state->jitter)) {
+        printf("播放缓冲已开启，最多延迟 %u 毫秒\n", state->jitter.max_delay_us / 1000);
+    }
     
     return true;
 }
 
 // 清理应用程序
 void cleanup_app(AppState *state) {
+    release_keys(state);
+    
     if (state->network) {
         network_cleanup(state->network);
         state->network = NULL;
@@ -459,26 +917,64 @@ void cleanup_app(AppState *state) {
 
 // 运行应用程序
 void run_app(AppState *state) {
-    // 创建一个计时器，定期检查接收消息
-    NSTimer *timer = [NSTimer scheduledTimerWithTimeInterval:0.01 // 10毫秒
-                                                     repeats:YES
-                                                       block:^(NSTimer * __unused timer) {
-        Message msg;
-        size_t msg_size;
-        
-        // 尝试接收消息
-        while (network_receive_message(state->network, &msg, &msg_size)) {
-            // 消息已在回调函数中处理
-        }
+    // 网络层的事件循环描述符可读时立即处理：接受连接、读取并分发消息，空闲时不占用CPU
+    int poll_fd = network_get_poll_fd(state->network);
+    if (poll_fd < 0) {
+        fprintf(stderr, "无法创建事件循环\n");
+        return;
+    }
+    dispatch_source_t network_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)poll_fd, 0,
+                                                              dispatch_get_main_queue());
+    dispatch_source_set_event_handler(network_source, ^{
+        network_poll(state->network, 0);
+    });
+    dispatch_resume(network_source);
+    network_set_event_callback(state->network, on_network_event, state);
+    
+    // 开启移动预测时，两条消息之间按显示刷新率移动到预测位置；平时不触发
+    if (predictor_enabled(&state->predictor)) {
+        state->predict_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+        dispatch_source_set_event_handler(state->predict_timer, ^{
+            predict_timer_callback(state);
+        });
+        dispatch_source_set_timer(state->predict_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(state->predict_timer);
+    }
+    
+    // 开启播放缓冲时，按每条移动消息的播放时间注入
+    if (jitter_buffer_enabled(&state->jitter)) {
+        state->playout_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+        dispatch_source_set_event_handler(state->playout_timer, ^{
+            playout_timer_callback(state);
+        });
+        dispatch_source_set_timer(state->playout_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(state->playout_timer);
+    }
+    
+    // 每秒发送心跳估计与发送端的时钟偏差，并打印延迟统计
+    NSTimer *stats_timer = [NSTimer scheduledTimerWithTimeInterval:1.0
+                                                           repeats:YES
+                                                             block:^(NSTimer * __unused timer) {
+        network_send_heartbeat(state->network);
+        report_latency(state);
     }];
     
     // 将计时器添加到当前运行循环的通用模式
-    [[NSRunLoop currentRunLoop] addTimer:timer forMode:NSRunLoopCommonModes];
+    [[NSRunLoop currentRunLoop] addTimer:stats_timer forMode:NSRunLoopCommonModes];
     
     // 启动NSRunLoop
     [[NSRunLoop currentRunLoop] run];
     
-    [timer invalidate];
+    dispatch_source_cancel(network_source);
+    if (state->predict_timer) {
+        dispatch_source_cancel(state->predict_timer);
+        state->predict_timer = nil;
+    }
+    if (state->playout_timer) {
+        dispatch_source_cancel(state->playout_timer);
+        state->playout_timer = nil;
+    }
+    [stats_timer invalidate];
 }
 
 // 主函数
@@ -504,11 +1000,13 @@ int main(int argc, const char **argv) {
             [[NSWorkspace sharedWorkspace] openURL:[NSURL URLWithString:urlString]];
         }
         
-        // 运行应用程序
+        // 运行应用程序，主线程中的日志由后台线程写出
+        log_start();
         run_app(&state);
         
         // 清理资源
         cleanup_app(&state);
+        log_stop();
     }
     
     return 0;